@@ -0,0 +1,24 @@
+#pragma once
+
+#include <new>
+#include <cstdlib>
+
+#include "basic_typedefs.hpp"
+
+/* Counts the heap allocations of every thread, by replacing the global operator new (the array and sized versions forward to these)
+	To check that code that runs every frame does not allocate: read thread_alloc_count before and after it
+	Include in exactly one translation unit (main.cpp)
+*/
+
+thread_local u64 thread_alloc_count = 0;
+
+void* operator new (size_t size) {
+	thread_alloc_count++;
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+void operator delete (void* p) noexcept {
+	free(p);
+}
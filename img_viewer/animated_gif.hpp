@@ -0,0 +1,179 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+
+#include "basic_typedefs.hpp"
+#include "vector_util.hpp"
+#include "colors.hpp"
+
+#include "stbi.hpp"
+#include "image.hpp"
+#include "region_decode.hpp"
+#include "texture.hpp"
+#include "tracing.hpp"
+
+/* Animated GIF playback in the grid
+	The first frame of a gif is a normal still image for the Texture_Streamer (stb decodes the first frame), so offscreen or tiny cells cost nothing extra
+	Visible cells that are at least GIF_MIN_ANIMATED_PX get an Animated_Gif: a decoder that stays alive between jobs and a small ring of frame textures that the jobs fill ahead of the playback
+	Gif frames are drawn on top of the previous ones, so they can only be decoded in order, one job per gif at a time owns the decoder and hands it back with the frames
+	Frames are box filtered down to about the onscreen size while decoding, so uploads and texture memory do not depend on the canvas size
+
+	The decoded pixels per second over all gifs are limited by a global budget (a token bucket refilled every frame), gifs are served round robin,
+	so the cpu cost is bounded no matter how many gifs are visible, if the budget is not enough the playback of all of them simply slows down
+*/
+
+constexpr int GIF_FRAME_RING = 4; // frame textures per playing gif, including the one that is displayed
+constexpr int GIF_MIN_ANIMATED_PX = 96; // cells smaller than this only show the first frame
+
+// browsers show frames with a delay of 0 or 10ms for 100ms, gifs rely on that
+int gif_frame_delay_ms (int delay_ms) {
+	return delay_ms <= 10 ? 100 : delay_ms;
+}
+
+// biggest power of 2 downscale that is still at least the onscreen size
+int calc_gif_frame_scale (iv2 size_px, iv2 onscreen_size_px) {
+	v2 ratio = (v2)size_px / (v2)max(onscreen_size_px, 1);
+	flt r = min(ratio.x, ratio.y);
+	return r <= 1 ? 0 : max((int)floor(log2(r)), 0);
+}
+
+// decoder state, moved into a job and back with the result, so only one thread ever touches it
+struct Gif_Decoder {
+	std::vector<byte>	file_data; // stbi_gif_frames reads from this
+	stbi_gif_frames*	frames = nullptr;
+	iv2					size_px = 0; // canvas size
+	int					next_frame = 0; // index of the frame stbi_gif_next_frame returns next
+	int					frame_count = 0; // 0 until the end was reached once
+
+	Gif_Decoder () {}
+	Gif_Decoder (Gif_Decoder const&) = delete;
+	~Gif_Decoder () {
+		stbi_gif_close(frames);
+	}
+};
+
+struct Gif_Frame {
+	int			index;
+	int			delay_ms; // already with gif_frame_delay_ms applied
+	Image2D		img; // bottom-up like all our images, canvas size downsampled by 2^scale
+};
+
+// decode the next count frames, wraps around to the first frame after the last one, the file is read on the first call
+std::vector<Gif_Frame> decode_gif_frames (Gif_Decoder* d, strcr filepath, int count, int scale) {
+	TRACE_SCOPE("decode_gif_frames");
+
+	if (!d->frames) {
+		d->file_data = Image2D::read_file(filepath);
+		d->frames = stbi_gif_open(d->file_data.data(), (int)d->file_data.size(), &d->size_px.x,&d->size_px.y);
+		if (!d->frames)
+			throw Expt_File_Load_Fail(filepath);
+		d->next_frame = 0;
+	}
+
+	std::vector<Gif_Frame> res;
+
+	for (int i=0; i<count; ++i) {
+		int delay_ms;
+		auto* rgba = (rgba8 const*)stbi_gif_next_frame(d->frames, &delay_ms);
+		if (!rgba) {
+			if (d->next_frame == 0)
+				throw Expt_File_Load_Fail(filepath); // not even one frame
+
+			d->frame_count = d->next_frame;
+			if (d->frame_count == 1)
+				break; // still image
+
+			stbi_gif_rewind(d->frames);
+			d->next_frame = 0;
+
+			rgba = (rgba8 const*)stbi_gif_next_frame(d->frames, &delay_ms);
+			if (!rgba)
+				throw Expt_File_Load_Fail(filepath);
+		}
+
+		Gif_Frame f;
+		f.index = d->next_frame++;
+		f.delay_ms = gif_frame_delay_ms(delay_ms);
+		f.img = Image2D::allocate((d->size_px +(1 << scale) -1) / (1 << scale));
+
+		Row_Box_Filter filter (&f.img, scale, d->size_px.x);
+		for (int y=0; y<d->size_px.y; ++y)
+			filter.add_row(y, rgba +(uptr)y * d->size_px.x);
+		filter.finish();
+
+		res.push_back(std::move(f));
+	}
+
+	return res;
+}
+
+struct Animated_Gif {
+	string					filepath;
+	u32						id = 0; // for Texture_Handle
+
+	iv2						size_px; // canvas size, decode cost per frame
+	unique_ptr<Gif_Decoder>	decoder; // null while a job has it (or before the first job)
+	Gif_Decoder*			decoder_in_job = nullptr; // to recognize the result of our job (a removed and readded gif could get the result of the job of the old one)
+	int						frame_count = 0; // 0 == not known yet, 1 == not animated
+
+	struct Frame {
+		unique_ptr<Texture2D>	tex;
+		int						index;
+		int						delay_ms;
+	};
+	std::deque<Frame>		ring; // front is the displayed frame, the rest are decoded ahead
+	int						frames_uploading = 0; // decoded, on the upload thread, they take ring slots already
+	std::vector<unique_ptr<Texture2D>> spare_textures; // textures of frames that were shown, reused for the next uploads
+
+	f64						front_shown_since = -1; // glfwGetTime
+	int						desired_scale = 0; // frames are decoded downsampled by 2^desired_scale (recalculated every query)
+
+	flt						order_priority = +1;
+	bool					was_queried = false;
+	bool					threadpool_job_queued = false;
+	f64						last_job_t = -INF; // for round robin scheduling of the decode budget
+
+	// ring slots that are not decoded yet
+	int get_free_frames () const {
+		return GIF_FRAME_RING -(int)ring.size() -frames_uploading;
+	}
+
+	// advance the playback to the frame that should be shown at time now, if the next frame is not decoded yet we keep showing the current one (so the playback slows down instead of skipping)
+	void advance (f64 now) {
+		if (ring.size() == 0)
+			return;
+		if (front_shown_since < 0)
+			front_shown_since = now;
+
+		while (ring.size() > 1 && now >= front_shown_since +(f64)ring.front().delay_ms / 1000) {
+			front_shown_since += (f64)ring.front().delay_ms / 1000;
+			if (now -front_shown_since > (f64)ring[1].delay_ms / 1000)
+				front_shown_since = now; // were starved for longer than a frame, do not fast forward to catch up
+
+			spare_textures.push_back(std::move(ring.front().tex));
+			ring.pop_front();
+		}
+	}
+
+	Texture2D* get_displayed_frame () {
+		return ring.size() > 0 ? ring.front().tex.get() : nullptr;
+	}
+
+	uptr get_memory_size () const {
+		uptr sz = 0;
+		for (auto& f : ring) {
+			iv2 s = f.tex->get_size_px();
+			sz += (uptr)s.x * (uptr)s.y * sizeof(rgba8);
+		}
+		return sz;
+	}
+
+	void imgui () {
+		ImGui::Value("frame_count", frame_count);
+		ImGui::Value("desired_scale", desired_scale);
+		ImGui::Value("threadpool_job_queued", threadpool_job_queued);
+		ImGui::Value("displayed frame", ring.size() > 0 ? ring.front().index : -1);
+		ImGui::Value("decoded ahead", max((int)ring.size() -1, 0));
+	}
+};
@@ -0,0 +1,579 @@
+#pragma once
+
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <random>
+#include <cstdio>
+
+#include <string>
+using std::string;
+
+#include "windows.h"
+
+#include "basic_typedefs.hpp"
+#include "prints.hpp"
+
+#include "threadsafe_queue.hpp"
+#include "mpsc_ring.hpp"
+#include "texture_compression.hpp"
+#include "content_model.hpp"
+#include "grid_layout.hpp"
+#include "content_view.hpp"
+
+// Microbenchmarks that can be run from the gui, they block the app while running and print their results to stdout and the gui
+
+// contention of the threadpool result channel: N producers push move-only payloads, one consumer drains with try_pop like queries_end() does
+struct Result_Channel_Benchmark {
+	struct Payload {
+		unique_ptr<u64>	data; // move-only, like the mip images in Threadpool_Result
+		int				producer;
+	};
+
+	static constexpr int ITEMS_PER_PRODUCER = 20000;
+
+	template <typename CHANNEL>
+	static f64 run (int producers) { // returns ns per item
+		auto channel = make_unique<CHANNEL>();
+
+		std::vector<std::thread> threads;
+
+		auto t_begin = std::chrono::steady_clock::now();
+
+		for (int p=0; p<producers; ++p) {
+			threads.emplace_back([&channel, p] () {
+				for (int i=0; i<ITEMS_PER_PRODUCER; ++i) {
+					channel->push({ make_unique<u64>((u64)i), p });
+				}
+			});
+		}
+
+		u64 total = (u64)producers * ITEMS_PER_PRODUCER;
+		u64 received = 0;
+		u64 checksum = 0;
+
+		Payload res;
+		while (received < total) {
+			if (channel->try_pop(&res)) {
+				checksum += *res.data;
+				received++;
+			} else {
+				std::this_thread::yield();
+			}
+		}
+
+		for (auto& t : threads)
+			t.join();
+
+		auto t_end = std::chrono::steady_clock::now();
+
+		assert(checksum == (u64)producers * ((u64)ITEMS_PER_PRODUCER * (ITEMS_PER_PRODUCER -1) / 2));
+
+		return (f64)std::chrono::duration_cast<std::chrono::nanoseconds>(t_end -t_begin).count() / (f64)total;
+	}
+
+	std::vector<string> results;
+
+	void run_all () {
+		results.clear();
+
+		for (int producers : { 2, 4, 8, 16, 32, 64 }) {
+			f64 queue = run< Threadsafe_Queue<Payload> >(producers);
+			f64 ring = run< Mpsc_Ring<Payload> >(producers);
+
+			results.push_back(prints("%2d producers: Threadsafe_Queue %8.1f ns/item  Mpsc_Ring %8.1f ns/item  (%.2fx)", producers, queue, ring, queue / ring));
+			printf("%s\n", results.back().c_str());
+		}
+	}
+
+	void imgui () {
+		if (ImGui::Button("Result channel contention (2-64 producers)"))
+			run_all();
+
+		for (auto& r : results)
+			ImGui::Text("%s", r.c_str());
+	}
+};
+
+// encode speed and quality (psnr of the decoded blocks vs the source) of the block compressors
+struct Texture_Compression_Benchmark {
+	string				filepath = "assets_src/folder_icon.png";
+
+	std::vector<string>	results;
+
+	static f64 calc_psnr (Image2D const& a, Image2D const& b) { // over rgb
+		f64 sum_sqr = 0;
+		for (int y=0; y<a.size.y; ++y) {
+			for (int x=0; x<a.size.x; ++x) {
+				for (int c=0; c<3; ++c) {
+					f64 d = (f64)a.get_pixel(x,y).arr[c] -(f64)b.get_pixel(x,y).arr[c];
+					sum_sqr += d*d;
+				}
+			}
+		}
+		f64 mse = sum_sqr / ((f64)a.size.x * a.size.y * 3);
+		return mse == 0 ? +INF : 10 * log10(255.0*255.0 / mse);
+	}
+
+	// smooth gradients and hard edges, so the benchmark works without any image files
+	static Image2D generate_test_image (iv2 size) {
+		auto img = Image2D::allocate(size);
+		for (int y=0; y<size.y; ++y) {
+			for (int x=0; x<size.x; ++x) {
+				bool checker = ((x / 37) ^ (y / 23)) & 1;
+				img.get_pixel(x,y) = rgba8((u8)(x * 255 / size.x), (u8)(y * 255 / size.y), checker ? 200 : 40, 255);
+			}
+		}
+		return img;
+	}
+
+	void run (string const& name, Image2D const& src) {
+		f64 mpixels = (f64)src.size.x * src.size.y / 1000000;
+
+		for (auto format : { TF_BC1, TF_BC7 }) {
+			auto t_begin = std::chrono::steady_clock::now();
+
+			auto mip = compress_mip(Image2D::copy_from(src.pixels, src.size), format);
+
+			auto t_end = std::chrono::steady_clock::now();
+			f64 sec = (f64)std::chrono::duration_cast<std::chrono::nanoseconds>(t_end -t_begin).count() / 1e9;
+
+			f64 psnr = calc_psnr(src, decompress_mip(mip));
+
+			results.push_back(prints("%-30s %4d x %4d %s: %7.2f MP/s  psnr %6.2f dB  %5.1f%% of RGBA8 size", name.c_str(), src.size.x,src.size.y, texture_format_e_str[format],
+				mpixels / sec, psnr, (f64)mip.get_memory_size() / (f64)calc_texture_memory_size(TF_RGBA8, src.size) * 100));
+			printf("%s\n", results.back().c_str());
+		}
+	}
+
+	void run_all () {
+		results.clear();
+
+		run("synthetic", generate_test_image(iv2(2048, 2048)));
+
+		try {
+			run(filepath, Image2D::load_from_file(filepath));
+		} catch (Expt_File_Load_Fail const& e) {
+			results.push_back(prints("could not load \"%s\"", filepath.c_str()));
+		}
+	}
+
+	void imgui () {
+		ImGui::InputText_str("##compression_benchmark_filepath", &filepath);
+		ImGui::SameLine();
+		if (ImGui::Button("Texture compression (BC1, BC7)"))
+			run_all();
+
+		for (auto& r : results)
+			ImGui::Text("%s", r.c_str());
+	}
+};
+
+// memory per entry and the cost of the per frame walk over the entries of the grid (read type, read size of images), old object per entry layout vs Content_Model
+struct Content_Model_Benchmark {
+	// the layout before Content_Model, one heap object per entry behind a pointer, with a virtual type()
+	struct Content {
+		str		name;
+
+		virtual filetype_e type () = 0;
+		virtual ~Content () {};
+	};
+	struct Image_File : Content {
+		string	filepath;
+		iv2		size_px;
+
+		filetype_e type () { return FT_IMAGE_FILE; };
+	};
+	struct Non_Image_File : Content {
+		filetype_e type () { return FT_NON_IMAGE_FILE; };
+	};
+
+	static constexpr int ENTRIES = 500000;
+	static constexpr int PASSES = 20;
+
+	static uptr string_heap_size (string const& s) { // 0 if the string fits into the small string buffer
+		bool is_inline = s.data() >= (char const*)&s && s.data() < (char const*)(&s +1);
+		return is_inline ? 0 : s.capacity() +1;
+	}
+
+	static f64 ns_per_entry (std::chrono::steady_clock::time_point t_begin, std::chrono::steady_clock::time_point t_end) {
+		return (f64)std::chrono::duration_cast<std::chrono::nanoseconds>(t_end -t_begin).count() / ((f64)ENTRIES * PASSES);
+	}
+
+	std::vector<string> results;
+
+	void run () {
+		results.clear();
+
+		string dir = "D:/photos/2018/some_event/";
+		auto get_name = [] (int i) { return prints("IMG_%06d%s", i, i % 16 == 0 ? ".txt" : ".jpg"); };
+		auto get_size = [] (int i) { return iv2(4000 +(i % 7), 3000 +(i % 5)); };
+
+		// polymorphic objects, malloc overhead not included
+		f64 old_bytes, old_ns;
+		u64 old_checksum = 0;
+		{
+			std::vector< unique_ptr<Content> > files;
+			std::vector<Content*> content;
+
+			for (int i=0; i<ENTRIES; ++i) {
+				string name = get_name(i);
+				if (i % 16 == 0) {
+					auto f = make_unique<Non_Image_File>();
+					f->name = name;
+					files.emplace_back(std::move(f));
+				} else {
+					auto f = make_unique<Image_File>();
+					f->name = name;
+					f->filepath = dir + name;
+					f->size_px = get_size(i);
+					files.emplace_back(std::move(f));
+				}
+				content.push_back(files.back().get());
+			}
+
+			uptr sz = files.capacity() * sizeof(files[0]) + content.capacity() * sizeof(content[0]);
+			for (auto* c : content) {
+				sz += string_heap_size(c->name);
+				if (c->type() == FT_IMAGE_FILE) {
+					sz += sizeof(Image_File) + string_heap_size(((Image_File*)c)->filepath);
+				} else {
+					sz += sizeof(Non_Image_File);
+				}
+			}
+			old_bytes = (f64)sz / ENTRIES;
+
+			auto t_begin = std::chrono::steady_clock::now();
+			for (int pass=0; pass<PASSES; ++pass) {
+				for (auto* c : content) {
+					if (c->type() == FT_IMAGE_FILE)
+						old_checksum += (u64)((Image_File*)c)->size_px.x;
+				}
+			}
+			old_ns = ns_per_entry(t_begin, std::chrono::steady_clock::now());
+		}
+
+		f64 new_bytes, new_ns;
+		u64 new_checksum = 0;
+		{
+			Content_Model m;
+			m.add_entry(FT_DIRECTORY, dir, 0);
+			m.begin_children(Content_Model::ROOT, ENTRIES);
+
+			for (int i=0; i<ENTRIES; ++i) {
+				bool is_image = i % 16 != 0;
+				m.add_entry(is_image ? FT_IMAGE_FILE : FT_NON_IMAGE_FILE, dir + get_name(i), dir.size(), is_image ? get_size(i) : 0);
+			}
+			m.shrink_to_fit();
+
+			new_bytes = (f64)m.get_memory_size() / ENTRIES;
+
+			Index_Range entries = m.get_children(Content_Model::ROOT);
+
+			auto t_begin = std::chrono::steady_clock::now();
+			for (int pass=0; pass<PASSES; ++pass) {
+				for (u32 i=entries.begin; i<entries.end; ++i) {
+					if (m.types[i] == FT_IMAGE_FILE)
+						new_checksum += (u64)m.sizes_px[i].x;
+				}
+			}
+			new_ns = ns_per_entry(t_begin, std::chrono::steady_clock::now());
+		}
+
+		assert(old_checksum == new_checksum);
+
+		results.push_back(prints("%d entries  objects: %6.1f bytes/entry %6.2f ns/entry/frame  Content_Model: %6.1f bytes/entry %6.2f ns/entry/frame  (%.2fx memory, %.2fx iteration)",
+			ENTRIES, old_bytes, old_ns, new_bytes, new_ns, old_bytes / new_bytes, old_ns / new_ns));
+		printf("%s\n", results.back().c_str());
+	}
+
+	void imgui () {
+		if (ImGui::Button("Content model (500k entries)"))
+			run();
+
+		for (auto& r : results)
+			ImGui::Text("%s", r.c_str());
+	}
+};
+
+// cpu time per frame of finding the cells the file grid has to look at, walking every entry (like the grid used to) vs calc_grid_entry_range
+// a 10 x 6 cell view panning through the directory, with the default image_priority_cutoff
+struct Grid_Range_Benchmark {
+	static constexpr int FRAMES = 200;
+
+	std::vector<string> results;
+
+	static f64 run (Content_Model const& m, bool analytic, u64* checksum) { // returns us per frame
+		v2 grid_sz_cells = v2(10.3f, 6.1f);
+		flt max_dist_rows = max(grid_sz_cells.y/2 +0.5f, calc_image_priority_max_dist(600) * length(grid_sz_cells/2));
+
+		Index_Range entries = m.get_children(Content_Model::ROOT);
+
+		auto t_begin = std::chrono::steady_clock::now();
+
+		for (int frame=0; frame<FRAMES; ++frame) {
+			v2 view_coord = v2((flt)entries.size() * frame / FRAMES, 0.3f);
+
+			Index_Range r = { 0, entries.size() };
+			if (analytic)
+				r = calc_grid_entry_range(entries.size(), view_coord, grid_sz_cells, max_dist_rows);
+
+			for (u32 i=r.begin; i<r.end; ++i) {
+				auto cell = calc_grid_cell((int)i, view_coord, grid_sz_cells);
+				if (abs(cell.pos_center_rel.y) <= max_dist_rows && m.types[entries.begin +i] == FT_IMAGE_FILE)
+					*checksum += i;
+			}
+		}
+
+		auto t_end = std::chrono::steady_clock::now();
+		return (f64)std::chrono::duration_cast<std::chrono::nanoseconds>(t_end -t_begin).count() / 1000 / FRAMES;
+	}
+
+	void run_all () {
+		results.clear();
+
+		for (u32 count : { 1000, 10000, 100000, 1000000 }) {
+			Content_Model m;
+			m.add_entry(FT_DIRECTORY, "synthetic/", 0);
+			m.begin_children(Content_Model::ROOT, count);
+			for (u32 i=0; i<count; ++i)
+				m.add_entry(i % 16 ? FT_IMAGE_FILE : FT_NON_IMAGE_FILE, prints("synthetic/%07u.jpg", i), 10, i % 16 ? iv2(4000, 3000) : 0);
+
+			u64 checksum_all = 0, checksum_range = 0;
+			f64 all = run(m, false, &checksum_all);
+			f64 range = run(m, true, &checksum_range);
+
+			results.push_back(prints("%7u entries: every entry %9.2f us/frame  visible range %6.2f us/frame%s", count, all, range,
+				checksum_all == checksum_range ? "" : "  MISMATCH (range misses cells)"));
+			printf("%s\n", results.back().c_str());
+		}
+	}
+
+	void imgui () {
+		if (ImGui::Button("Grid visible range (1k-1M entries)"))
+			run_all();
+
+		for (auto& r : results)
+			ImGui::Text("%s", r.c_str());
+	}
+};
+
+// sorting the root of a 1M entry directory by every key, and filtering it while a substring is typed (every step after the first only narrows the previous result)
+struct Content_View_Benchmark {
+	std::vector<string> results;
+
+	void run () {
+		results.clear();
+
+		static constexpr u32 COUNT = 1000000;
+		static cstr prefixes[] = { "IMG_", "DSC", "Screenshot ", "photo-", "render_v" };
+
+		std::mt19937 rng(0);
+		Content_Model m;
+		m.add_entry(FT_DIRECTORY, "synthetic/", 0);
+		m.begin_children(Content_Model::ROOT, COUNT);
+		for (u32 i=0; i<COUNT; ++i) {
+			u32 r = rng();
+			iv2 size_px = iv2(500 +r % 4000, 500 +(r >> 12) % 4000);
+			m.add_entry(FT_IMAGE_FILE, prints("synthetic/%s%u (%u).jpg", prefixes[r % ARRLEN(prefixes)], rng() % 100000, rng() % 20), 10, size_px, rng(), rng() % 20000000);
+		}
+
+		auto print_result = [&] (string str) {
+			results.push_back(std::move(str));
+			printf("%s\n", results.back().c_str());
+		};
+
+		Content_View view;
+		View_Query q;
+
+		for (int sort=SORT_NAME; sort<=SORT_ASPECT; ++sort) {
+			q.sort = (view_sort_e)sort;
+			view.update_now(&m, q);
+			print_result(prints("sort by %-10s %8.2f ms", view_sort_e_str[sort], view.sort_ms));
+		}
+
+		q.sort = SORT_NAME;
+		view.update_now(&m, q);
+		for (cstr pattern : { "s", "sc", "scr", "scre", "scree", "screen" }) {
+			q.pattern = pattern;
+			view.update_now(&m, q);
+			print_result(prints("filter \"%s\" %8.2f ms  %7u shown%s", pattern, view.filter_ms, (u32)view.entries.size(), view.narrowed ? "  (narrowed)" : ""));
+		}
+
+		q.filter = FILTER_GLOB;
+		q.pattern = "dsc*(1?).jpg";
+		view.update_now(&m, q);
+		print_result(prints("glob  \"%s\" %8.2f ms  %7u shown", q.pattern.c_str(), view.filter_ms, (u32)view.entries.size()));
+
+		q.filter = FILTER_REGEX;
+		q.pattern = "^photo-\\d{3} ";
+		view.update_now(&m, q);
+		print_result(prints("regex \"%s\" %8.2f ms  %7u shown", q.pattern.c_str(), view.filter_ms, (u32)view.entries.size()));
+	}
+
+	void imgui () {
+		if (ImGui::Button("Filter and sort (1M entries)"))
+			run();
+
+		for (auto& r : results)
+			ImGui::Text("%s", r.c_str());
+	}
+};
+
+// uncompressed rgb png (stored deflate blocks), since we have no image writer, only for generating test files
+bool write_png_uncompressed (string const& filepath, iv2 size, std::vector<u8> const& rgb) {
+	auto crc32 = [] (u32 crc, u8 const* data, uptr len) {
+		crc = ~crc;
+		for (uptr i=0; i<len; ++i) {
+			crc ^= data[i];
+			for (int k=0; k<8; ++k)
+				crc = (crc >> 1) ^ (0xedb88320u & (0u -(crc & 1)));
+		}
+		return ~crc;
+	};
+	auto put_u32_be = [] (std::vector<u8>* out, u32 v) {
+		u8 b[4] = { (u8)(v >> 24), (u8)(v >> 16), (u8)(v >> 8), (u8)v };
+		out->insert(out->end(), b, b +4);
+	};
+
+	std::vector<u8> file = { 0x89, 'P','N','G', '\r','\n', 0x1a, '\n' };
+	auto chunk = [&] (cstr type, std::vector<u8> const& data) {
+		put_u32_be(&file, (u32)data.size());
+		uptr begin = file.size();
+		file.insert(file.end(), type, type +4);
+		file.insert(file.end(), data.begin(), data.end());
+		put_u32_be(&file, crc32(0, &file[begin], file.size() -begin));
+	};
+
+	std::vector<u8> ihdr;
+	put_u32_be(&ihdr, (u32)size.x);
+	put_u32_be(&ihdr, (u32)size.y);
+	ihdr.insert(ihdr.end(), { 8, 2, 0, 0, 0 }); // 8 bit rgb, no interlace
+	chunk("IHDR", ihdr);
+
+	std::vector<u8> raw; // rows with filter type 0
+	raw.reserve((uptr)size.y * (size.x * 3 +1));
+	for (int y=0; y<size.y; ++y) {
+		raw.push_back(0);
+		raw.insert(raw.end(), &rgb[(uptr)y * size.x * 3], &rgb[(uptr)(y +1) * size.x * 3]);
+	}
+
+	std::vector<u8> zlib = { 0x78, 0x01 };
+	for (uptr i=0; i<raw.size(); i+=0xffff) {
+		u16 len = (u16)min(raw.size() -i, (uptr)0xffff);
+		u8 header[5] = { (u8)(i +len == raw.size() ? 1 : 0), (u8)len, (u8)(len >> 8), (u8)~len, (u8)((u16)~len >> 8) };
+		zlib.insert(zlib.end(), header, header +5);
+		zlib.insert(zlib.end(), raw.begin() +i, raw.begin() +i +len);
+	}
+	u32 a = 1, b = 0; // adler32
+	for (u8 c : raw) {
+		a = (a +c) % 65521;
+		b = (b +a) % 65521;
+	}
+	put_u32_be(&zlib, (b << 16) | a);
+	chunk("IDAT", zlib);
+	chunk("IEND", {});
+
+	FILE* f = fopen(filepath.c_str(), "wb");
+	if (!f)
+		return false;
+	bool ok = fwrite(file.data(), 1, file.size(), f) == file.size();
+	fclose(f);
+	return ok;
+}
+
+// not a benchmark: rewrites random files of a generated directory at random resolutions every frame while it runs, in place like a renderer or a tethered camera would
+// view the directory with auto_scroll on to have files change under queued and running jobs, textures_resized in the Texture_Streamer panel counts the resolution changes the loader found
+struct Rewrite_Stress_Test {
+	static constexpr cstr DIR = "saves/rewrite_stress/";
+
+	int				file_count = 300;
+	int				rewrites_per_frame = 4;
+	bool			running = false;
+
+	u64				rewrites = 0;
+	u64				failed_writes = 0;
+	std::mt19937	rng;
+
+	// a gradient with the generation in blue, so a rewrite is visible
+	bool write_file (int i) {
+		std::uniform_int_distribution<int> dist (16, 1600);
+		iv2 size = iv2(dist(rng), dist(rng));
+
+		std::vector<u8> rgb ((uptr)size.x * size.y * 3);
+		u8 gen = (u8)(rewrites * 37);
+		for (int y=0; y<size.y; ++y) {
+			for (int x=0; x<size.x; ++x) {
+				u8* px = &rgb[((uptr)y * size.x +x) * 3];
+				px[0] = (u8)(x * 255 / size.x);
+				px[1] = (u8)(y * 255 / size.y);
+				px[2] = gen;
+			}
+		}
+
+		rewrites++;
+		bool ok = write_png_uncompressed(prints("%s%05d.png", DIR, i), size, rgb);
+		if (!ok)
+			failed_writes++;
+		return ok;
+	}
+
+	void generate () {
+		CreateDirectoryA("saves", NULL); // fails if it exists, which is fine
+		CreateDirectoryA(DIR, NULL);
+
+		for (int i=0; i<file_count; ++i)
+			write_file(i);
+	}
+
+	void imgui () {
+		if (ImGui::TreeNode("Rewrite_Stress_Test")) {
+			ImGui::DragInt("file_count", &file_count, 1, 1, 100000);
+			ImGui::DragInt("rewrites_per_frame", &rewrites_per_frame, 0.1f, 0, 1000);
+
+			if (ImGui::Button("Generate"))
+				generate();
+			ImGui::SameLine();
+			ImGui::Checkbox("running", &running);
+
+			ImGui::Text("open %s", DIR);
+			ImGui::Text("rewrites: %llu  failed_writes: %llu", (unsigned long long)rewrites, (unsigned long long)failed_writes);
+
+			ImGui::TreePop();
+		}
+	}
+
+	void update () {
+		if (!running)
+			return;
+
+		std::uniform_int_distribution<int> dist (0, file_count -1);
+		for (int i=0; i<rewrites_per_frame; ++i)
+			write_file(dist(rng));
+	}
+};
+
+void benchmarks_gui () {
+	static Rewrite_Stress_Test rewrite_stress;
+	rewrite_stress.update(); // keeps running with the header closed
+
+	if (!ImGui::CollapsingHeader("Benchmarks"))
+		return;
+
+	static Result_Channel_Benchmark result_channel;
+	result_channel.imgui();
+
+	static Texture_Compression_Benchmark texture_compression;
+	texture_compression.imgui();
+
+	static Content_Model_Benchmark content_model;
+	content_model.imgui();
+
+	static Grid_Range_Benchmark grid_range;
+	grid_range.imgui();
+
+	static Content_View_Benchmark content_view;
+	content_view.imgui();
+
+	rewrite_stress.imgui();
+}
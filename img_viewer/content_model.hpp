@@ -0,0 +1,153 @@
+#pragma once
+
+#include <vector>
+#include <cstring>
+#include <cctype>
+
+#include <string>
+using std::string;
+
+#include "basic_typedefs.hpp"
+#include "vector_util.hpp"
+
+/* Flat content model of a loaded directory tree
+	Every entry (file or directory) is an index into parallel arrays, so the grid touches a few contiguous arrays per cell every frame,
+	instead of chasing a pointer to a separately allocated polymorphic object (and calling a virtual function) per cell
+
+	The path of every entry is stored once in a string pool (directories end in '/'), the name is the end of the path, so it is only an offset into the same string
+	The entries of a directory are a contiguous index range (subdirectories first, like find_files returns them), entry 0 is the root
+*/
+
+enum filetype_e : u8 {
+	FT_IMAGE_FILE,
+	FT_DIRECTORY,
+	FT_NON_IMAGE_FILE,
+};
+
+// what the grid does with a file besides decoding it with stb, from the extension, classified once when the directory is loaded
+enum file_ext_e : u8 {
+	EXT_OTHER,
+	EXT_GIF, // animated (see animated_gif.hpp), icon if it can not be decoded
+	EXT_MP4, // icon if there is no thumbnail provider
+};
+static cstr file_ext_e_str[] = { "EXT_OTHER", "EXT_GIF", "EXT_MP4" };
+
+file_ext_e classify_file_ext (cstr filename) {
+	cstr dot = strrchr(filename, '.');
+	if (!dot)
+		return EXT_OTHER;
+
+	char ext[8];
+	int len = 0;
+	for (cstr c=dot+1; *c; ++c) {
+		if (len == (int)sizeof(ext) -1)
+			return EXT_OTHER;
+		ext[len++] = (char)tolower(*c);
+	}
+	ext[len] = '\0';
+
+	if (strcmp(ext, "gif") == 0)	return EXT_GIF;
+	if (strcmp(ext, "mp4") == 0)	return EXT_MP4;
+	return EXT_OTHER;
+}
+
+// where an object of the Texture_Streamer was last time (see Texture_Streamer::find_by_handle), so finding it again is usually an integer compare instead of a search by filepath
+struct Texture_Handle {
+	u32		slot = (u32)-1; // index in the sorted_vector of the streamer
+	u32		id = 0; // id of the object at slot, 0 == none
+};
+
+struct Index_Range {
+	u32		begin;
+	u32		end;
+
+	u32 size () const {	return end -begin; }
+};
+
+struct Content_Model {
+	// per entry
+	std::vector<filetype_e>		types;
+	std::vector<u32>			path_offsets; // into string_pool, null terminated, the relative or absolute path needed to open the file
+	std::vector<u32>			name_offsets; // into string_pool, inside the path
+	std::vector<iv2>			sizes_px; // images: oriented size (see load_exif_orientation), others: 0
+	std::vector<u64>			mtimes; // last write FILETIME when the entry was scanned, to know what changed since (see dir_index.hpp)
+	std::vector<u64>			file_sizes; // files: in bytes, from the listing, directories: 0
+	std::vector<rgba8>			avg_cols; // images: average color from the first decode, the placeholder of the cell until there are pixels, a == 0: not known yet
+	std::vector<file_ext_e>		exts; // from the name
+	std::vector<Texture_Handle>	tex_handles; // images: the still or tiled texture
+	std::vector<Texture_Handle>	gif_handles; // gifs: the Animated_Gif
+	std::vector<Index_Range>	children; // directories: their entries, files: empty
+
+	std::vector<char>			string_pool;
+
+	static constexpr u32 ROOT = 0;
+	static constexpr u32 NO_ENTRY = (u32)-1;
+
+	u32 size () const {							return (u32)types.size(); }
+
+	filetype_e	get_type (u32 i) const {		return types[i]; }
+	cstr		get_path (u32 i) const {		return &string_pool[path_offsets[i]]; }
+	cstr		get_name (u32 i) const {		return &string_pool[name_offsets[i]]; }
+	Index_Range	get_children (u32 dir) const {	return children[dir]; }
+
+	// name_offset is where the name starts in path
+	u32 add_entry (filetype_e type, string const& path, uptr name_offset, iv2 size_px=0, u64 mtime=0, u64 file_size=0) {
+		return add_entry(type, path.c_str(), path.size(), name_offset, size_px, mtime, file_size);
+	}
+	u32 add_entry (filetype_e type, cstr path, uptr path_len, uptr name_offset, iv2 size_px, u64 mtime, u64 file_size) {
+		u32 i = size();
+
+		u32 path_offset = (u32)string_pool.size();
+		string_pool.insert(string_pool.end(), path, path +path_len +1); // with null terminator
+
+		types.push_back(type);
+		path_offsets.push_back(path_offset);
+		name_offsets.push_back(path_offset +(u32)name_offset);
+		sizes_px.push_back(size_px);
+		mtimes.push_back(mtime);
+		file_sizes.push_back(file_size);
+		avg_cols.push_back(0);
+		exts.push_back(classify_file_ext(&string_pool[name_offsets.back()]));
+		tex_handles.push_back({});
+		gif_handles.push_back({});
+		children.push_back({ 0, 0 });
+		return i;
+	}
+
+	// entry i of another model (the one before a change of the directory, see App::apply_dir_changes), keeps the size, color and texture handles, so the file does not have to be probed again
+	u32 copy_entry (Content_Model const& old, u32 i) {
+		cstr path = old.get_path(i);
+		u32 j = add_entry(old.types[i], path, strlen(path), old.name_offsets[i] -old.path_offsets[i], old.sizes_px[i], old.mtimes[i], old.file_sizes[i]);
+		avg_cols[j] = old.avg_cols[i];
+		tex_handles[j] = old.tex_handles[i];
+		gif_handles[j] = old.gif_handles[i];
+		return j;
+	}
+
+	// the entries of a directory have to be added right after each other, call this before adding them
+	void begin_children (u32 dir, u32 count) {
+		children[dir] = { size(), size() +count };
+	}
+
+	uptr get_memory_size () const {
+		return	types.capacity() * sizeof(types[0]) + path_offsets.capacity() * sizeof(path_offsets[0]) + name_offsets.capacity() * sizeof(name_offsets[0]) +
+				sizes_px.capacity() * sizeof(sizes_px[0]) + mtimes.capacity() * sizeof(mtimes[0]) + file_sizes.capacity() * sizeof(file_sizes[0]) + avg_cols.capacity() * sizeof(avg_cols[0]) + exts.capacity() * sizeof(exts[0]) + tex_handles.capacity() * sizeof(tex_handles[0]) +
+				gif_handles.capacity() * sizeof(gif_handles[0]) + children.capacity() * sizeof(children[0]) +
+				string_pool.capacity();
+	}
+
+	void shrink_to_fit () {
+		types.shrink_to_fit();
+		path_offsets.shrink_to_fit();
+		name_offsets.shrink_to_fit();
+		sizes_px.shrink_to_fit();
+		mtimes.shrink_to_fit();
+		file_sizes.shrink_to_fit();
+		avg_cols.shrink_to_fit();
+		exts.shrink_to_fit();
+		tex_handles.shrink_to_fit();
+		gif_handles.shrink_to_fit();
+		children.shrink_to_fit();
+		string_pool.shrink_to_fit();
+	}
+};
@@ -0,0 +1,587 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <regex>
+#include <cstring>
+
+#include <string>
+using std::string;
+
+#include "basic_typedefs.hpp"
+#include "vector_util.hpp"
+
+#include "content_model.hpp"
+#include "threadpool.hpp"
+#include "tracing.hpp"
+
+/* Filtered and sorted view of the viewed directory, the grid shows the entries of the root in the order of Content_View::entries instead of the listing order
+	Filtering matches the names (case insensitive) by substring, glob (* and ?) or regex, sorting is by natural name order (numbers compared by value), file size, mtime, pixel count or aspect ratio
+	Subdirectories stay before the files, like in the listing
+
+	The grid calls update every frame, a changed query is sorted and filtered on a worker thread while the grid keeps showing the last result (shown)
+	only a new model (directory loaded or changed on disk) is sorted right away, since the old result is of entries of the old model
+	The worker always takes the latest query, so while typing the queries in between are skipped
+
+	All entries are sorted once per sort key (sorted), a filter is a pass over that order, so changing the filter never sorts
+	Typing more characters of a substring can only remove matches, so then only the previous result is filtered again instead of every entry
+	Sorting and filtering split the entries into chunks for a few threads (Helper_Threads started with the view), the sorted chunks are merged pairwise
+	For the name order every entry gets a key where case is folded and digit runs are prefixed with their length, so comparing two names is a strcmp and usually just two integer compares of its first 16 bytes
+*/
+
+enum view_filter_e : u8 {
+	FILTER_SUBSTRING,
+	FILTER_GLOB,
+	FILTER_REGEX,
+};
+static cstr view_filter_e_str[] = { "substring", "glob", "regex" };
+
+enum view_sort_e : u8 {
+	SORT_LISTING, // order of find_files
+	SORT_NAME,
+	SORT_FILE_SIZE,
+	SORT_MTIME,
+	SORT_DIMENSIONS, // pixel count, non-images are 0
+	SORT_ASPECT, // width / height, non-images are 0
+};
+static cstr view_sort_e_str[] = { "listing", "name", "file size", "mtime", "dimensions", "aspect" };
+
+struct View_Query {
+	string			pattern; // empty: no filter
+	view_filter_e	filter = FILTER_SUBSTRING;
+	view_sort_e		sort = SORT_LISTING;
+	bool			descending = false;
+};
+
+//// Helpers
+constexpr u32 PARALLEL_MIN_ITEMS = 1 << 14; // below this waking the helper threads costs more than it saves
+
+int get_parallel_thread_count () {
+	return clamp((int)std::thread::hardware_concurrency(), 1, 16);
+}
+int get_parallel_chunks (u32 count) {
+	if (count < PARALLEL_MIN_ITEMS)
+		return 1;
+	return get_parallel_thread_count();
+}
+u32 get_parallel_chunk_bound (u32 count, int chunks, int i) {
+	return (u32)((u64)count * i / chunks);
+}
+
+// calls f(begin, end, chunk_i) for every chunk of [0, count), on this thread and the idle helper threads
+template <typename FUNC>
+void parallel_chunks (Worker_Helpers& helpers, u32 count, int chunks, FUNC f) {
+	if (chunks == 1) {
+		f(0, count, 0);
+		return;
+	}
+	helpers.parallel_for(chunks, [&] (int i) {
+		f(get_parallel_chunk_bound(count, chunks, i), get_parallel_chunk_bound(count, chunks, i +1), i);
+	});
+}
+
+// std::sort of every chunk in parallel, then the sorted chunks are merged pairwise (the merges of one level in parallel too)
+template <typename T, typename LESS>
+void parallel_sort (Worker_Helpers& helpers, T* data, u32 count, LESS less) {
+	int chunks = get_parallel_chunks(count);
+	if (chunks == 1) {
+		std::sort(data, data +count, less);
+		return;
+	}
+
+	parallel_chunks(helpers, count, chunks, [&] (u32 begin, u32 end, int) {
+		std::sort(data +begin, data +end, less);
+	});
+
+	for (int width=1; width<chunks; width*=2) {
+		int merges = (chunks +width -1) / (width*2); // pairs of i, i +width with i +width < chunks
+		helpers.parallel_for(merges, [&] (int j) {
+			int i = j * width*2;
+			u32 begin =	get_parallel_chunk_bound(count, chunks, i);
+			u32 mid =	get_parallel_chunk_bound(count, chunks, i +width);
+			u32 end =	get_parallel_chunk_bound(count, chunks, min(i +width*2, chunks));
+			std::inplace_merge(data +begin, data +mid, data +end, less);
+		});
+	}
+}
+
+// only ascii, tolower goes through the locale, which is most of the time of building the name keys
+inline char to_lower_ascii (char c) {
+	return c >= 'A' && c <= 'Z' ? c +('a' -'A') : c;
+}
+
+// case folded name where every run of digits becomes '0', (number of digits without leading zeros +1) and the digits, so a byte compare orders numbers by value ("img2" < "img10")
+// the length byte is never 0, so keys can be compared with strcmp
+void append_natural_sort_key (cstr name, std::vector<char>* out) {
+	uptr begin = out->size();
+	out->resize(begin +strlen(name)*3 +1); // a single digit becomes 3 bytes
+	char* dst = out->data() +begin;
+
+	for (cstr c=name; *c;) {
+		if (*c >= '0' && *c <= '9') {
+			cstr digits = c;
+			while (*digits == '0' && digits[1] >= '0' && digits[1] <= '9')
+				++digits; // skip leading zeros, but keep a single 0
+			cstr end = digits;
+			while (*end >= '0' && *end <= '9')
+				++end;
+
+			*dst++ = '0';
+			*dst++ = (char)min((uptr)(end -digits) +1, (uptr)127);
+			while (digits != end)
+				*dst++ = *digits++;
+			c = end;
+		} else {
+			*dst++ = to_lower_ascii(*c++);
+		}
+	}
+	*dst++ = '\0';
+
+	out->resize(dst -out->data());
+}
+
+// first 16 bytes of a null terminated key as two big endian numbers, so comparing the numbers is comparing the prefixes
+// 8 bytes are not enough, names like "Screenshot 2019..." would all need a strcmp of the whole key
+void get_sort_key_prefix (cstr key, u64* prefix0, u64* prefix1) {
+	u64 prefix[2] = {};
+	for (int i=0; i<16; ++i) {
+		prefix[i / 8] = (prefix[i / 8] << 8) | (u8)*key;
+		if (*key)
+			++key;
+	}
+	*prefix0 = prefix[0];
+	*prefix1 = prefix[1];
+}
+
+// pattern is lower case
+bool contains_nocase (cstr str, cstr pattern) {
+	for (;; ++str) {
+		cstr s = str;
+		cstr p = pattern;
+		while (*p && to_lower_ascii(*s) == *p) {
+			++s;
+			++p;
+		}
+		if (!*p)
+			return true;
+		if (!*s)
+			return false;
+	}
+}
+
+// whole name has to match, * is any number of characters, ? one character, pattern is lower case
+bool glob_match_nocase (cstr str, cstr pattern) {
+	cstr star = nullptr; // last * seen, backtrack to it when the rest does not match
+	cstr star_str = nullptr;
+
+	while (*str) {
+		if (*pattern == '*') {
+			star = ++pattern;
+			star_str = str;
+		} else if (*pattern == '?' || *pattern == to_lower_ascii(*str)) {
+			++pattern;
+			++str;
+		} else if (star) {
+			pattern = star;
+			str = ++star_str;
+		} else {
+			return false;
+		}
+	}
+	while (*pattern == '*')
+		++pattern;
+	return !*pattern;
+}
+
+//// View
+struct Content_View {
+	struct Result {
+		std::vector<u32>	entries; // entries of the Content_Model
+		string				error; // of the last pattern, like an invalid regex, entries are of the last valid one then
+		u32					total = 0; // entries before filtering
+
+		// stats
+		flt					sort_ms = 0;
+		flt					filter_ms = 0;
+		bool				narrowed = false; // filter only had to look at the previous result
+	};
+
+	//// main thread
+	Result					shown; // what the grid shows, result of the latest query that finished
+	bool					busy = false; // a query is sorted or filtered, shown is of an older one
+
+	//// worker state, owned by the worker thread while it works on a query, by update_now otherwise
+	std::vector<u32>		entries;
+	string					error;
+
+	flt						sort_ms = 0;
+	flt						filter_ms = 0;
+	bool					narrowed = false;
+
+	struct Sort_Item {
+		u64		key;
+		u64		key2; // names: the second 8 bytes of the key, others 0
+		u32		entry;
+		u32		name_key; // offset into name_keys
+	};
+
+	Content_Model const*	model = nullptr;
+	bool					valid = false;
+
+	View_Query				query; // last one update was called with
+	std::vector<u32>		sorted; // every entry of the root, in the order of query.sort
+	string					filtered_pattern; // lower case pattern entries are filtered with
+	view_filter_e			filtered_mode = FILTER_SUBSTRING;
+
+	Helper_Threads			workers; // for the chunks of sorts and filters, started once
+
+	// worker thread, started once, sorts and filters the latest requested_query
+	std::thread				thread;
+	std::mutex				worker_m;
+	std::condition_variable	worker_c;
+	bool					stop = false; // all protected by worker_m
+	bool					has_request = false; // requested_query changed since the worker took it
+	bool					working = false;
+	bool					has_result = false;
+	Result					result;
+	std::atomic<bool>		cancel {false}; // the running filter stops early, its result is dropped
+
+	Content_Model const*	requested_model = nullptr; // only changed by the main thread while the worker is idle, the worker is only woken for queries of this model
+	View_Query				requested_query; // protected by worker_m
+	bool					requested_valid = false;
+
+	// kept to not allocate (and page fault) tens of MB again for every sort
+	std::vector<Sort_Item>	items;
+	std::vector<char>		name_keys;
+	std::vector<std::vector<char>>	name_key_pools; // of every chunk, appended into name_keys
+
+	Content_View () {
+		workers.start_threads(get_parallel_thread_count() -1); // the worker does chunks too
+		thread = std::thread(&Content_View::worker_thread, this);
+	}
+	~Content_View () {
+		{
+			std::lock_guard<std::mutex> lock(worker_m);
+			stop = true;
+			cancel = true;
+		}
+		worker_c.notify_all();
+		thread.join();
+	}
+
+	// call before the model is changed or freed, waits for the worker to stop reading it (a running filter is cancelled, a running sort finishes)
+	// shown are indices of the old model until the next update
+	void invalidate () {
+		wait_idle();
+		requested_valid = false;
+		valid = false;
+	}
+
+	// call every frame, true if shown changed
+	bool update (Content_Model const* content, View_Query const& q) {
+		if (!requested_valid || content != requested_model) {
+			// the shown entries are of another model, so this can not wait for the worker
+			wait_idle();
+			update_now(content, q);
+
+			requested_model = content;
+			requested_query = q;
+			requested_valid = true;
+			shown = get_result();
+			busy = false;
+			return true;
+		}
+
+		std::lock_guard<std::mutex> lock(worker_m);
+
+		if (!is_same_query(q, requested_query)) {
+			requested_query = q;
+			has_request = true;
+			busy = true;
+			worker_c.notify_all();
+		}
+
+		if (!has_result)
+			return false;
+
+		shown = std::move(result);
+		has_result = false;
+		busy = has_request || working;
+		return true;
+	}
+
+	Result get_result () const {
+		Result res;
+		res.entries = entries;
+		res.error = error;
+		res.total = (u32)sorted.size();
+		res.sort_ms = sort_ms;
+		res.filter_ms = filter_ms;
+		res.narrowed = narrowed;
+		return res;
+	}
+
+	// drops a request the worker has not taken yet and waits for the one it works on
+	void wait_idle () {
+		TRACE_SCOPE("Content_View::wait_idle");
+
+		std::unique_lock<std::mutex> lock(worker_m);
+		has_request = false;
+		cancel = true;
+		worker_c.wait(lock, [this] () { return !working; });
+		cancel = false;
+		has_result = false;
+	}
+
+	void worker_thread () {
+		tracer.set_thread_name("content_view");
+
+		std::unique_lock<std::mutex> lock(worker_m);
+		for (;;) {
+			worker_c.wait(lock, [this] () { return stop || has_request; });
+			if (stop)
+				break;
+
+			View_Query q = requested_query;
+			Content_Model const* content = requested_model;
+			has_request = false;
+			working = true;
+			lock.unlock();
+
+			update_now(content, q);
+			Result res = get_result();
+
+			lock.lock();
+			working = false;
+			if (cancel) {
+				valid = false; // entries were not filtered completely, the next query starts over
+			} else {
+				result = std::move(res);
+				has_result = true;
+			}
+			worker_c.notify_all();
+		}
+	}
+
+	static bool is_same_query (View_Query const& l, View_Query const& r) {
+		return l.pattern == r.pattern && l.filter == r.filter && l.sort == r.sort && l.descending == r.descending;
+	}
+
+	// sort and filter on this thread (only when the worker is idle, see wait_idle), true if entries changed
+	bool update_now (Content_Model const* m, View_Query const& q) {
+		bool same_model = valid && m == model;
+		if (same_model && is_same_query(q, query))
+			return false;
+
+		bool resort = !same_model || q.sort != query.sort || q.descending != query.descending;
+
+		model = m;
+		query = q;
+		valid = true;
+
+		if (!m) {
+			entries.clear();
+			sorted.clear();
+			error.clear();
+			return true;
+		}
+
+		if (resort) {
+			sort_entries();
+			filtered_pattern.clear(); // entries are in the old order
+			if (cancel)
+				return true;
+		}
+		filter_entries(!resort);
+		return true;
+	}
+
+	void sort_entries () {
+		TRACE_SCOPE("Content_View::sort_entries");
+		auto t_begin = std::chrono::steady_clock::now();
+
+		Content_Model const& m = *model;
+		Index_Range children = m.get_children(Content_Model::ROOT);
+
+		// subdirectories are the first entries of the range, they stay first
+		u32 dirs_end = children.begin;
+		while (dirs_end < children.end && m.get_type(dirs_end) == FT_DIRECTORY)
+			++dirs_end;
+
+		sorted.resize(children.size());
+		for (u32 i=0; i<children.size(); ++i)
+			sorted[i] = children.begin +i;
+
+		if (query.sort != SORT_LISTING) {
+			calc_sort_items(children);
+
+			auto sort_range = [&] (u32 begin, u32 end) { // of children
+				Sort_Item* data = items.data() +(begin -children.begin);
+				u32 count = end -begin;
+
+				if (query.sort == SORT_NAME) {
+					char const* keys = name_keys.data();
+					parallel_sort(workers.helpers, data, count, [keys] (Sort_Item const& l, Sort_Item const& r) {
+						if (l.key != r.key)
+							return l.key < r.key;
+						if (l.key2 != r.key2)
+							return l.key2 < r.key2;
+						int c = (l.key2 & 0xff) != 0 ? strcmp(keys +l.name_key +16, keys +r.name_key +16) : 0; // both keys are longer than the prefix
+						return c != 0 ? c < 0 : l.entry < r.entry;
+					});
+				} else {
+					parallel_sort(workers.helpers, data, count, [] (Sort_Item const& l, Sort_Item const& r) {
+						return l.key != r.key ? l.key < r.key : l.entry < r.entry;
+					});
+				}
+			};
+			sort_range(children.begin, dirs_end);
+			sort_range(dirs_end, children.end);
+
+			for (u32 i=0; i<children.size(); ++i)
+				sorted[i] = items[i].entry;
+		}
+
+		if (query.descending) {
+			std::reverse(sorted.begin(), sorted.begin() +(dirs_end -children.begin));
+			std::reverse(sorted.begin() +(dirs_end -children.begin), sorted.end());
+		}
+
+		sort_ms = (flt)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -t_begin).count() / 1000;
+	}
+
+	void calc_sort_items (Index_Range children) {
+		Content_Model const& m = *model;
+		u32 count = children.size();
+		int chunks = get_parallel_chunks(count);
+
+		items.resize(count);
+
+		if (query.sort != SORT_NAME) {
+			parallel_chunks(workers.helpers, count, chunks, [&] (u32 begin, u32 end, int) {
+				for (u32 i=begin; i<end; ++i) {
+					u32 entry = children.begin +i;
+					iv2 size_px = m.sizes_px[entry];
+
+					u64 key;
+					switch (query.sort) {
+						case SORT_FILE_SIZE:	key = m.file_sizes[entry];	break;
+						case SORT_MTIME:		key = m.mtimes[entry];		break;
+						case SORT_DIMENSIONS:	key = (u64)max(size_px.x, 0) * (u64)max(size_px.y, 0);	break;
+						case SORT_ASPECT: {
+							flt aspect = size_px.x > 0 && size_px.y > 0 ? (flt)size_px.x / (flt)size_px.y : 0;
+							u32 bits;
+							memcpy(&bits, &aspect, 4); // positive floats order like their bits
+							key = bits;
+						} break;
+						default: assert(false); key = 0;
+					}
+					items[i] = { key, 0, entry, 0 };
+				}
+			});
+			return;
+		}
+
+		name_key_pools.resize(chunks);
+		parallel_chunks(workers.helpers, count, chunks, [&] (u32 begin, u32 end, int chunk) {
+			auto& pool = name_key_pools[chunk];
+			pool.clear();
+			for (u32 i=begin; i<end; ++i) {
+				u32 entry = children.begin +i;
+				u32 offset = (u32)pool.size();
+				append_natural_sort_key(m.get_name(entry), &pool);
+
+				Sort_Item& item = items[i];
+				get_sort_key_prefix(&pool[offset], &item.key, &item.key2);
+				item.entry = entry;
+				item.name_key = offset;
+			}
+		});
+
+		name_keys.clear();
+		for (int chunk=0; chunk<chunks; ++chunk) {
+			u32 base = (u32)name_keys.size();
+			name_keys.insert(name_keys.end(), name_key_pools[chunk].begin(), name_key_pools[chunk].end());
+			if (base != 0) {
+				for (u32 i=get_parallel_chunk_bound(count, chunks, chunk); i<get_parallel_chunk_bound(count, chunks, chunk +1); ++i)
+					items[i].name_key += base;
+			}
+		}
+	}
+
+	// can_narrow: entries are in the order of sorted, so a more specific pattern only has to filter them
+	void filter_entries (bool can_narrow) {
+		TRACE_SCOPE("Content_View::filter_entries");
+		auto t_begin = std::chrono::steady_clock::now();
+
+		string pattern = query.pattern;
+		if (query.filter != FILTER_REGEX) {
+			for (char& c : pattern)
+				c = to_lower_ascii(c);
+		}
+
+		std::regex re;
+		if (query.filter == FILTER_REGEX && pattern.size() > 0) {
+			try {
+				re = std::regex(pattern, std::regex::ECMAScript | std::regex::icase | std::regex::optimize);
+			} catch (std::regex_error const& e) {
+				error = e.what(); // keep the last result while the regex is being typed, unless it is of another order or model
+				if (!can_narrow) {
+					entries = sorted;
+					filtered_pattern.clear();
+				}
+				return;
+			}
+		}
+		error.clear();
+
+		// a substring that contains the previous one can only match a subset of its matches
+		narrowed = can_narrow && query.filter == FILTER_SUBSTRING && filtered_mode == FILTER_SUBSTRING &&
+			filtered_pattern.size() > 0 && pattern.find(filtered_pattern) != string::npos;
+
+		filtered_pattern = pattern;
+		filtered_mode = query.filter;
+
+		if (pattern.size() == 0) {
+			entries = sorted;
+		} else {
+			std::vector<u32> candidates = narrowed ? std::move(entries) : std::vector<u32>();
+			std::vector<u32> const& from = narrowed ? candidates : sorted;
+
+			Content_Model const& m = *model;
+			cstr p = pattern.c_str();
+			auto match = [&] (cstr name) {
+				switch (query.filter) {
+					case FILTER_SUBSTRING:	return contains_nocase(name, p);
+					case FILTER_GLOB:		return glob_match_nocase(name, p);
+					case FILTER_REGEX:		return std::regex_search(name, re);
+					default: assert(false); return false;
+				}
+			};
+
+			u32 count = (u32)from.size();
+			int chunks = get_parallel_chunks(count);
+			std::vector<std::vector<u32>> matches(chunks);
+
+			parallel_chunks(workers.helpers, count, chunks, [&] (u32 begin, u32 end, int chunk) {
+				for (u32 i=begin; i<end; ++i) {
+					if ((i & 1023) == 0 && cancel)
+						return; // regex filters can take a second
+					if (match(m.get_name(from[i])))
+						matches[chunk].push_back(from[i]);
+				}
+			});
+
+			entries.clear();
+			for (auto& c : matches)
+				entries.insert(entries.end(), c.begin(), c.end());
+		}
+
+		filter_ms = (flt)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -t_begin).count() / 1000;
+	}
+};
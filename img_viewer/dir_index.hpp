@@ -0,0 +1,182 @@
+#pragma once
+
+#include <vector>
+#include <cstdio>
+
+#include "windows.h"
+
+#include "basic_typedefs.hpp"
+#include "vector_util.hpp"
+
+#include "content_model.hpp"
+#include "thumbnail_provider.hpp"
+#include "tracing.hpp"
+
+/* Snapshot of a scanned directory tree (the Content_Model with names, types, image sizes, average colors, mtimes and file sizes), so reopening a huge tree does not have to list and probe every file again
+	One file per root directory in DIR_INDEX_DIR, the arrays of the Content_Model are stored as they are, so loading is mapping the file and copying the arrays out in bulk
+	The snapshot is shown right away and revalidated in the background (see App::start_dir_index_revalidation): directories whose mtime changed are listed again,
+	new files or files with a changed mtime are probed again
+*/
+
+#define DIR_INDEX_DIR "saves/dir_index"
+
+struct Dir_Index_Header {
+	u32		magic;
+	u32		version;
+	u32		entry_count;
+	u32		string_pool_size;
+	// followed by the arrays in the order of write_dir_index, each starting at a multiple of 8 bytes
+};
+constexpr u32 DIR_INDEX_MAGIC = 0x78646e69; // "indx"
+constexpr u32 DIR_INDEX_VERSION = 3; // 2: file_sizes, 3: avg_cols
+
+string get_dir_index_filepath (string const& root_path) {
+	u64 hash = 0xcbf29ce484222325ull; // FNV-1a
+	for (char c : root_path) {
+		hash ^= (u8)c;
+		hash *= 0x100000001b3ull;
+	}
+	return prints(DIR_INDEX_DIR "/%016llx.bin", (unsigned long long)hash);
+}
+
+// calls f(data, size) for every array of the snapshot in file order
+template <typename T, typename FUNC>
+void _foreach_dir_index_array (T& m, FUNC f) {
+	f(m.types.data(),			m.types.size() * sizeof(m.types[0]));
+	f(m.exts.data(),			m.exts.size() * sizeof(m.exts[0]));
+	f(m.path_offsets.data(),	m.path_offsets.size() * sizeof(m.path_offsets[0]));
+	f(m.name_offsets.data(),	m.name_offsets.size() * sizeof(m.name_offsets[0]));
+	f(m.sizes_px.data(),		m.sizes_px.size() * sizeof(m.sizes_px[0]));
+	f(m.mtimes.data(),			m.mtimes.size() * sizeof(m.mtimes[0]));
+	f(m.file_sizes.data(),		m.file_sizes.size() * sizeof(m.file_sizes[0]));
+	f(m.avg_cols.data(),		m.avg_cols.size() * sizeof(m.avg_cols[0]));
+	f(m.children.data(),		m.children.size() * sizeof(m.children[0]));
+	f(m.string_pool.data(),		m.string_pool.size() * sizeof(m.string_pool[0]));
+}
+
+uptr _align_dir_index_offset (uptr offset) {
+	return (offset +7) & ~(uptr)7;
+}
+
+bool write_dir_index (Content_Model const& m) {
+	TRACE_SCOPE("write_dir_index");
+
+	CreateDirectoryA("saves", NULL); // fails if it exists, which is fine
+	CreateDirectoryA(DIR_INDEX_DIR, NULL);
+
+	// write to a temp file and rename, so a crash never leaves a half written snapshot
+	string filepath = get_dir_index_filepath(m.get_path(Content_Model::ROOT));
+	string tmp_filepath = filepath +".tmp";
+
+	FILE* f = fopen(tmp_filepath.c_str(), "wb");
+	if (!f)
+		return false;
+
+	Dir_Index_Header h;
+	h.magic = DIR_INDEX_MAGIC;
+	h.version = DIR_INDEX_VERSION;
+	h.entry_count = m.size();
+	h.string_pool_size = (u32)m.string_pool.size();
+
+	bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+	uptr offset = sizeof(h);
+
+	_foreach_dir_index_array(m, [&] (void const* data, uptr size) {
+		static const u8 zeros[8] = {};
+		uptr padding = _align_dir_index_offset(offset) -offset;
+
+		ok = ok && fwrite(zeros, 1, padding, f) == padding;
+		ok = ok && fwrite(data, 1, size, f) == size;
+		offset += padding +size;
+	});
+	fclose(f);
+
+	if (!ok || !MoveFileExA(tmp_filepath.c_str(), filepath.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+		fprintf(stderr, "Could not write directory index %s\n", filepath.c_str());
+		DeleteFileA(tmp_filepath.c_str());
+		return false;
+	}
+	return true;
+}
+
+// null if there is no (valid) snapshot of root_path
+unique_ptr<Content_Model> read_dir_index (string const& root_path) {
+	TRACE_SCOPE("read_dir_index");
+
+	string filepath = get_dir_index_filepath(root_path);
+
+	HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return nullptr;
+
+	unique_ptr<Content_Model> m;
+
+	LARGE_INTEGER file_size;
+	HANDLE mapping = NULL;
+	u8 const* data = nullptr;
+
+	if (GetFileSizeEx(file, &file_size) && file_size.QuadPart >= (LONGLONG)sizeof(Dir_Index_Header))
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping)
+		data = (u8 const*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if (data) {
+		uptr size = (uptr)file_size.QuadPart;
+		auto* h = (Dir_Index_Header const*)data;
+
+		if (h->magic == DIR_INDEX_MAGIC && h->version == DIR_INDEX_VERSION && h->entry_count > 0) {
+			m = make_unique<Content_Model>();
+
+			m->types		.resize(h->entry_count);
+			m->exts			.resize(h->entry_count);
+			m->path_offsets	.resize(h->entry_count);
+			m->name_offsets	.resize(h->entry_count);
+			m->sizes_px		.resize(h->entry_count);
+			m->mtimes		.resize(h->entry_count);
+			m->file_sizes	.resize(h->entry_count);
+			m->avg_cols		.resize(h->entry_count);
+			m->children		.resize(h->entry_count);
+			m->string_pool	.resize(h->string_pool_size);
+
+			m->tex_handles	.resize(h->entry_count);
+			m->gif_handles	.resize(h->entry_count);
+
+			bool ok = true;
+			uptr offset = sizeof(Dir_Index_Header);
+
+			_foreach_dir_index_array(*m, [&] (void* dst, uptr array_size) {
+				offset = _align_dir_index_offset(offset);
+				ok = ok && offset +array_size <= size;
+				if (ok)
+					memcpy(dst, data +offset, array_size);
+				offset += array_size;
+			});
+
+			// the snapshot is trusted as far as the rest of the app indexes with it
+			ok = ok && h->string_pool_size > 0 && m->string_pool.back() == '\0';
+			for (u32 i=0; ok && i<h->entry_count; ++i) {
+				ok =	m->path_offsets[i] < h->string_pool_size && m->name_offsets[i] >= m->path_offsets[i] && m->name_offsets[i] < h->string_pool_size &&
+						m->children[i].begin <= m->children[i].end && m->children[i].end <= h->entry_count;
+			}
+			ok = ok && root_path.compare(m->get_path(Content_Model::ROOT)) == 0; // hash collision
+
+			if (!ok) {
+				fprintf(stderr, "Directory index %s is corrupt, ignoring it\n", filepath.c_str());
+				m = nullptr;
+			}
+		}
+
+		UnmapViewOfFile(data);
+	}
+	if (mapping)
+		CloseHandle(mapping);
+	CloseHandle(file);
+
+	return m;
+}
+
+// last write FILETIME of a file or directory, 0 if it does not exist
+u64 get_file_mtime (string const& path) {
+	u64 size, mtime;
+	return get_file_size_and_mtime(path, &size, &mtime) ? mtime : 0;
+}
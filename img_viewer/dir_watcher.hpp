@@ -0,0 +1,182 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <vector>
+
+#include <string>
+using std::string;
+
+#include "windows.h"
+
+#include "basic_typedefs.hpp"
+#include "tracing.hpp"
+
+/* Watching the viewed directory tree for changes (files added, removed, renamed or written to)
+	One overlapped ReadDirectoryChangesW on the root with bWatchSubtree, on a thread that waits for it or for stop(), the changes are collected until the main thread polls them
+	The changes are only hints about which directories have to be listed again (see App::apply_dir_changes), so they are not ordered or deduplicated here
+
+	If changes come in faster than we read them the kernel buffer overflows and the changes are lost, poll() then reports overflowed and the whole tree has to be rescanned
+*/
+
+enum file_change_e {
+	FC_ADDED,
+	FC_REMOVED,
+	FC_MODIFIED,
+	FC_RENAMED_OLD, // rename is reported as the old name, followed by the new one
+	FC_RENAMED_NEW,
+};
+static cstr file_change_e_str[] = { "FC_ADDED", "FC_REMOVED", "FC_MODIFIED", "FC_RENAMED_OLD", "FC_RENAMED_NEW" };
+
+struct File_Change {
+	file_change_e	action;
+	string			path; // relative to the watched directory, with '/', files and directories look the same (a removed one can not be checked anymore)
+};
+
+class Directory_Watcher {
+public:
+	static constexpr DWORD BUFFER_SIZE = 64 * 1024; // over the network ReadDirectoryChangesW fails with bigger buffers
+
+	~Directory_Watcher () {
+		stop();
+	}
+
+	// dir_path with '/' at the end, like find_files
+	bool start (string const& dir_path) {
+		stop();
+
+		dir = CreateFileA(dir_path.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE, NULL,
+			OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS|FILE_FLAG_OVERLAPPED, NULL); // BACKUP_SEMANTICS is needed to open a directory
+		if (dir == INVALID_HANDLE_VALUE) {
+			fprintf(stderr, "Directory_Watcher: could not open \"%s\" [%x], changes will not be detected\n", dir_path.c_str(), (u32)GetLastError());
+			return false;
+		}
+
+		stop_event = CreateEventA(NULL, TRUE, FALSE, NULL); // manual reset, stays signaled so the thread sees it wherever it is
+		thread = std::thread(&Directory_Watcher::thread_main, this);
+		return true;
+	}
+
+	void stop () {
+		if (dir == INVALID_HANDLE_VALUE)
+			return;
+
+		SetEvent(stop_event); // the thread cancels its read itself, a CancelIoEx from here could come before the read was issued and be lost
+		thread.join();
+
+		CloseHandle(stop_event);
+		stop_event = NULL;
+		CloseHandle(dir);
+		dir = INVALID_HANDLE_VALUE;
+
+		std::lock_guard<std::mutex> lock(m);
+		changes.clear();
+		overflowed = false;
+	}
+
+	bool is_watching () const {
+		return dir != INVALID_HANDLE_VALUE;
+	}
+
+	// appends all changes since the last call to out, returns true if changes were lost
+	bool poll (std::vector<File_Change>* out) {
+		std::lock_guard<std::mutex> lock(m);
+
+		for (auto& c : changes)
+			out->push_back(std::move(c));
+		changes.clear();
+
+		bool res = overflowed;
+		overflowed = false;
+		return res;
+	}
+
+private:
+	HANDLE						dir = INVALID_HANDLE_VALUE;
+	std::thread					thread;
+	HANDLE						stop_event = NULL;
+
+	std::mutex					m;
+	std::vector<File_Change>	changes; // protected by m
+	bool						overflowed = false; // protected by m
+
+	void thread_main () {
+		tracer.set_thread_name("dir_watcher");
+
+		std::vector<DWORD> buf (BUFFER_SIZE / sizeof(DWORD)); // FILE_NOTIFY_INFORMATION needs DWORD alignment
+
+		std::vector<File_Change> batch;
+
+		OVERLAPPED ov = {};
+		ov.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+
+		for (;;) {
+			ResetEvent(ov.hEvent);
+			BOOL ok = ReadDirectoryChangesW(dir, buf.data(), BUFFER_SIZE, TRUE,
+				FILE_NOTIFY_CHANGE_FILE_NAME|FILE_NOTIFY_CHANGE_DIR_NAME|FILE_NOTIFY_CHANGE_SIZE|FILE_NOTIFY_CHANGE_LAST_WRITE, NULL, &ov, NULL);
+			if (!ok) { // the directory was probably removed
+				fprintf(stderr, "Directory_Watcher: ReadDirectoryChangesW failed [%x]\n", (u32)GetLastError());
+				break;
+			}
+
+			HANDLE events[] = { ov.hEvent, stop_event };
+			DWORD woken = WaitForMultipleObjects(2, events, FALSE, INFINITE);
+
+			DWORD bytes = 0;
+			if (woken != WAIT_OBJECT_0) {
+				CancelIoEx(dir, &ov);
+				GetOverlappedResult(dir, &ov, &bytes, TRUE); // buf and ov have to stay alive until the cancelled read completed
+				break;
+			}
+
+			bool lost = false;
+			if (!GetOverlappedResult(dir, &ov, &bytes, FALSE)) {
+				if (GetLastError() != ERROR_NOTIFY_ENUM_DIR) {
+					fprintf(stderr, "Directory_Watcher: ReadDirectoryChangesW failed [%x]\n", (u32)GetLastError());
+					break;
+				}
+				lost = true; // buffer overflowed
+			}
+
+			batch.clear();
+			lost = lost || bytes == 0; // buffer overflowed
+
+			auto* info = (FILE_NOTIFY_INFORMATION const*)buf.data();
+			while (!lost) {
+				File_Change c;
+				switch (info->Action) {
+					case FILE_ACTION_ADDED:				c.action = FC_ADDED;		break;
+					case FILE_ACTION_REMOVED:			c.action = FC_REMOVED;		break;
+					case FILE_ACTION_MODIFIED:			c.action = FC_MODIFIED;		break;
+					case FILE_ACTION_RENAMED_OLD_NAME:	c.action = FC_RENAMED_OLD;	break;
+					case FILE_ACTION_RENAMED_NEW_NAME:	c.action = FC_RENAMED_NEW;	break;
+					default:							c.action = FC_MODIFIED;
+				}
+
+				// the rest of the app uses ansi paths (FindFirstFileA etc.)
+				int wlen = (int)(info->FileNameLength / sizeof(WCHAR));
+				int len = WideCharToMultiByte(CP_ACP, 0, info->FileName, wlen, NULL, 0, NULL, NULL);
+				c.path.resize(len);
+				WideCharToMultiByte(CP_ACP, 0, info->FileName, wlen, &c.path[0], len, NULL, NULL);
+
+				for (char& ch : c.path) {
+					if (ch == '\\')
+						ch = '/';
+				}
+
+				batch.push_back(std::move(c));
+
+				if (info->NextEntryOffset == 0)
+					break;
+				info = (FILE_NOTIFY_INFORMATION const*)((u8 const*)info +info->NextEntryOffset);
+			}
+
+			std::lock_guard<std::mutex> lock(m);
+			for (auto& c : batch)
+				changes.push_back(std::move(c));
+			overflowed = overflowed || lost;
+		}
+
+		CloseHandle(ov.hEvent);
+	}
+};
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <vector>
+#include <cstdio>
+
+#include "basic_typedefs.hpp"
+#include "vector_util.hpp"
+
+#include "stbi.hpp"
+#include "image.hpp"
+#include "orientation.hpp"
+#include "tracing.hpp"
+
+/* Embedded EXIF thumbnails
+	Most camera JPEGs carry a small (usually 160x120) JPEG thumbnail in the APP1 segment (in IFD1 of the TIFF structure), which is at the start of the file
+	So we only read the first EXIF_READ_SIZE bytes of the file and decode that thumbnail, which takes microseconds instead of the tens of milliseconds a full decode takes
+	The orientation tag is in IFD0 right at the start of the exif data, so probing it only needs EXIF_ORIENTATION_READ_SIZE bytes
+*/
+
+constexpr uptr EXIF_READ_SIZE = 128 * 1024; // APP0 + APP1 (segments are at most 64KB each)
+constexpr uptr EXIF_ORIENTATION_READ_SIZE = 8 * 1024;
+
+bool has_jpeg_extension (string const& filepath) {
+	auto dot = filepath.find_last_of('.');
+	if (dot == string::npos)
+		return false;
+
+	string ext = filepath.substr(dot +1);
+	for (auto& c : ext)
+		c = (char)tolower(c);
+	return ext == "jpg" || ext == "jpeg" || ext == "jpe" || ext == "jfif";
+}
+
+bool read_file_prefix (string const& filepath, uptr max_size, std::vector<byte>* data) {
+	FILE* f = fopen(filepath.c_str(), "rb");
+	if (!f)
+		return false;
+
+	data->resize(max_size);
+	uptr ret = fread(data->data(), 1,max_size, f);
+	fclose(f);
+
+	data->resize(ret);
+	return ret > 0;
+}
+
+struct Tiff_Reader {
+	byte const*	data; // starts at the tiff header
+	uptr		size;
+	bool		little_endian;
+
+	bool get16 (uptr offs, u32* out) const {
+		if (offs +2 > size) return false;
+		byte const* p = data +offs;
+		*out = little_endian ? (p[0] | (p[1] << 8)) : ((p[0] << 8) | p[1]);
+		return true;
+	}
+	bool get32 (uptr offs, u32* out) const {
+		if (offs +4 > size) return false;
+		byte const* p = data +offs;
+		*out = little_endian ?	((u32)p[0] | ((u32)p[1] << 8) | ((u32)p[2] << 16) | ((u32)p[3] << 24)) :
+								(((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | (u32)p[3]);
+		return true;
+	}
+};
+
+// find the tiff structure in the exif segment of a jpeg file (or the start of one), returns false if there is none
+// if the exif segment is cut off by the end of the data, the tiff is only the part that is there
+bool find_exif_tiff (byte const* data, uptr size, Tiff_Reader* tiff) {
+	if (size < 4 || data[0] != 0xff || data[1] != 0xd8)
+		return false; // not a jpeg
+
+	uptr pos = 2;
+	while (pos +4 <= size) {
+		if (data[pos] != 0xff)
+			return false;
+		u8 marker = data[pos +1];
+		if (marker == 0xff) { // fill byte
+			pos++;
+			continue;
+		}
+		if (marker == 0xda || marker == 0xd9)
+			return false; // start of scan or end of image, exif comes before
+
+		uptr seg_len = ((uptr)data[pos +2] << 8) | data[pos +3];
+		if (seg_len < 2)
+			return false;
+
+		byte const* seg = data +pos +4;
+		uptr seg_size = min(seg_len -2, size -(pos +4));
+
+		if (marker == 0xe1 && seg_size >= 6 && memcmp(seg, "Exif\0\0", 6) == 0) {
+			tiff->data = seg +6;
+			tiff->size = seg_size -6;
+
+			if (tiff->size < 8) return false;
+			if		(tiff->data[0] == 'I' && tiff->data[1] == 'I')	tiff->little_endian = true;
+			else if	(tiff->data[0] == 'M' && tiff->data[1] == 'M')	tiff->little_endian = false;
+			else return false;
+			return true;
+		}
+
+		if (pos +2 +seg_len > size)
+			return false; // truncated (or bigger than what we read)
+		pos += 2 +seg_len;
+	}
+	return false;
+}
+
+// find the thumbnail jpeg in the exif data of a jpeg file (or the start of one), returns false if there is none
+bool find_exif_thumbnail (byte const* data, uptr size, byte const** thumb, uptr* thumb_size) {
+	Tiff_Reader tiff;
+	if (!find_exif_tiff(data, size, &tiff))
+		return false;
+
+	u32 ifd0, count, ifd1;
+	if (!tiff.get32(4, &ifd0) || !tiff.get16(ifd0, &count) || !tiff.get32(ifd0 +2 +count * 12, &ifd1) || ifd1 == 0)
+		return false; // no ifd1 == no thumbnail
+
+	if (!tiff.get16(ifd1, &count))
+		return false;
+
+	u32 offset = 0, length = 0;
+	for (u32 i=0; i<count; ++i) {
+		uptr entry = ifd1 +2 +i * 12;
+		u32 tag, value;
+		if (!tiff.get16(entry, &tag) || !tiff.get32(entry +8, &value))
+			return false;
+
+		if (tag == 0x0201) offset = value; // JPEGInterchangeFormat
+		if (tag == 0x0202) length = value; // JPEGInterchangeFormatLength
+	}
+
+	if (offset == 0 || length == 0 || (uptr)offset +length > tiff.size)
+		return false; // no jpeg thumbnail (could be an uncompressed one, which is rare)
+
+	*thumb = tiff.data +offset;
+	*thumb_size = length;
+	return true;
+}
+
+// the orientation tag (0x0112) in IFD0, ORIENT_NORMAL if there is none
+orientation_e find_exif_orientation (byte const* data, uptr size) {
+	Tiff_Reader tiff;
+	if (!find_exif_tiff(data, size, &tiff))
+		return ORIENT_NORMAL;
+
+	u32 ifd0, count;
+	if (!tiff.get32(4, &ifd0) || !tiff.get16(ifd0, &count))
+		return ORIENT_NORMAL;
+
+	for (u32 i=0; i<count; ++i) {
+		uptr entry = ifd0 +2 +i * 12;
+		u32 tag, value;
+		if (!tiff.get16(entry, &tag) || !tiff.get16(entry +8, &value)) // SHORT, in the first 2 bytes of the value field
+			break;
+
+		if (tag == 0x0112)
+			return value >= ORIENT_NORMAL && value <= ORIENT_ROT_90_CCW ? (orientation_e)value : ORIENT_NORMAL;
+	}
+	return ORIENT_NORMAL;
+}
+
+orientation_e load_exif_orientation (string const& filepath) {
+	std::vector<byte> file_data;
+	if (!has_jpeg_extension(filepath) || !read_file_prefix(filepath, EXIF_ORIENTATION_READ_SIZE, &file_data))
+		return ORIENT_NORMAL;
+	return find_exif_orientation(file_data.data(), file_data.size());
+}
+
+// decode the embedded thumbnail of a jpeg file, TOP-DOWN like Image2D::decode_from_memory_top_down (in sensor orientation like the full image, orientation is set even if there is no thumbnail)
+bool load_exif_thumbnail (string const& filepath, Image2D* out, orientation_e* orientation) {
+	TRACE_SCOPE("load_exif_thumbnail");
+
+	*orientation = ORIENT_NORMAL;
+
+	std::vector<byte> file_data;
+	if (!read_file_prefix(filepath, EXIF_READ_SIZE, &file_data))
+		return false;
+
+	*orientation = find_exif_orientation(file_data.data(), file_data.size());
+
+	byte const* thumb;
+	uptr thumb_size;
+	if (!find_exif_thumbnail(file_data.data(), file_data.size(), &thumb, &thumb_size))
+		return false;
+
+	int n;
+	out->pixels = (rgba8*)stbi_load_from_memory(thumb, (int)thumb_size, &out->size.x,&out->size.y, &n, 4);
+	return out->pixels != nullptr;
+}
+
+// cameras letterbox the thumbnail if the image is not 4:3, crop the thumbnail to the aspect ratio of the full image (the bars are centered)
+Image2D crop_thumbnail_to_aspect (Image2D const& thumb, iv2 full_size_px) {
+	flt thumb_aspect = (flt)thumb.size.x / (flt)thumb.size.y;
+	flt full_aspect = (flt)full_size_px.x / (flt)full_size_px.y;
+
+	iv2 crop_size = thumb.size;
+	if (full_aspect > thumb_aspect)
+		crop_size.y = clamp((int)roundf((flt)thumb.size.x / full_aspect), 1, thumb.size.y);
+	else
+		crop_size.x = clamp((int)roundf((flt)thumb.size.y * full_aspect), 1, thumb.size.x);
+
+	iv2 offs = (thumb.size -crop_size) / 2;
+
+	auto dst = Image2D::allocate(crop_size);
+	for (int y=0; y<crop_size.y; ++y)
+		memcpy(&dst.get_pixel(0,y), &thumb.get_pixel(offs.x, offs.y +y), crop_size.x * sizeof(rgba8));
+	return dst;
+}
@@ -34,15 +34,30 @@ namespace n_find_files {
 		// contents
 		std::vector<str>			dirnames;
 		std::vector<str>			filenames;
+		std::vector<u64>			dir_mtimes; // last write FILETIME of each of dirnames
+		std::vector<u64>			file_mtimes; // of each of filenames
+		std::vector<u64>			file_sizes; // in bytes, of each of filenames
 	};
 	struct Directory_Tree {
 		str							name;
+		u64							mtime = 0; // last write FILETIME, from the listing of the parent
 		// contents
 		std::vector<Directory_Tree>	dirs;
 		std::vector<str>			filenames;
+		std::vector<u64>			file_mtimes; // of each of filenames
+		std::vector<u64>			file_sizes; // in bytes, of each of filenames
 	};
 
-	void find_files (strcr dir_path, std::vector<str>* dirnames, std::vector<str>* filenames) {
+	u64 get_mtime (WIN32_FIND_DATA const& data) {
+		return ((u64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+	}
+	u64 get_file_size (WIN32_FIND_DATA const& data) {
+		return ((u64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	}
+
+	// the mtimes and sizes are optional, they come with the listing, so they cost nothing extra
+	void find_files (strcr dir_path, std::vector<str>* dirnames, std::vector<str>* filenames, std::vector<u64>* dir_mtimes=nullptr, std::vector<u64>* file_mtimes=nullptr,
+			std::vector<u64>* file_sizes=nullptr) {
 		WIN32_FIND_DATA data;
 
 		assert(dir_path.size() > 0 && dir_path.back() == '/');
@@ -68,9 +83,15 @@ namespace n_find_files {
 					// found directory represents the current directory or the parent directory, don't include this in the output
 				} else {
 					dirnames->emplace_back(std::move( str(data.cFileName) +'/' ));
+					if (dir_mtimes)
+						dir_mtimes->push_back(get_mtime(data));
 				}
 			} else {
 				filenames->emplace_back(data.cFileName);
+				if (file_mtimes)
+					file_mtimes->push_back(get_mtime(data));
+				if (file_sizes)
+					file_sizes->push_back(get_file_size(data));
 			}
 
 			auto ret = FindNextFile(hFindFile, &data);
@@ -95,25 +116,27 @@ namespace n_find_files {
 	// 
 	Directory find_files (strcr dir_path) {
 		Directory dir;
-		find_files(dir_path, &dir.dirnames, &dir.filenames);
+		find_files(dir_path, &dir.dirnames, &dir.filenames, &dir.dir_mtimes, &dir.file_mtimes, &dir.file_sizes);
 		return dir;
 	}
 
-	Directory_Tree find_files_recursive (strcr dir_path, strcr dir_name) {
+	Directory_Tree find_files_recursive (strcr dir_path, strcr dir_name, u64 mtime=0) {
 		Directory_Tree		dir;
 		dir.name = dir_name;
+		dir.mtime = mtime;
 
 		std::vector<str>	dirnames;
+		std::vector<u64>	dir_mtimes;
 
 		assert(dir_path.size() == 0 ||	dir_path.back() == '/');
 		assert(dir_name.size() > 1 &&	dir_name.back() == '/');
 
 		str dir_full = dir_path+dir_name;
 
-		find_files(dir_full, &dirnames, &dir.filenames);
+		find_files(dir_full, &dirnames, &dir.filenames, &dir_mtimes, &dir.file_mtimes, &dir.file_sizes);
 
-		for (auto& d : dirnames) {
-			dir.dirs.emplace_back( find_files_recursive(dir_full, d) );
+		for (size_t i=0; i<dirnames.size(); ++i) {
+			dir.dirs.emplace_back( find_files_recursive(dir_full, dirnames[i], dir_mtimes[i]) );
 		}
 		return dir;
 	}
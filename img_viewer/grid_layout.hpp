@@ -0,0 +1,64 @@
+#pragma once
+
+#include "basic_typedefs.hpp"
+#include "vector_util.hpp"
+
+#include "content_model.hpp"
+
+/* Layout of the file grid
+	All entries are one long row that is wrapped at the width of the view (grid_sz_cells.x, which is not a whole number of cells),
+	so entry i is at x = i -view_coord.x wrapped into [-w/2, +w/2), and the number of wraps is its row
+	Cells that stick out of the left or right edge of the view are drawn a second time at the other edge in the previous / next row
+
+	Since the position of an entry only depends on its index, the entries that can be visible (or close enough to be prefetched) are an index range,
+	so the grid only looks at those instead of every entry of the directory every frame
+*/
+
+struct Grid_Cell {
+	v2		pos_center_rel; // in cells relative to the center of the view
+	flt		out_of_bounds_l; // how much of the cell sticks out of the left edge [0,1]
+	flt		out_of_bounds_r;
+};
+
+Grid_Cell calc_grid_cell (int i, v2 view_coord, v2 grid_sz_cells) {
+	flt rel_indx = (flt)i -view_coord.x;
+
+	flt quotient;
+	flt remainder = mod_range(rel_indx, -grid_sz_cells.x/2, +grid_sz_cells.x/2, &quotient);
+
+	Grid_Cell c;
+	c.out_of_bounds_l = max(-(remainder -0.5f +grid_sz_cells.x/2), 0.0f);
+	c.out_of_bounds_r = max(  remainder +0.5f -grid_sz_cells.x/2 , 0.0f);
+	c.pos_center_rel = v2(remainder,quotient -view_coord.y);
+	return c;
+}
+
+// dist: distance to the center of the grid normalized by the distance to the corner of the view (0 = center 1 = ~corner of screen)
+// rises steeply outside of the view, so the texture streamer prefers everything onscreen
+flt calc_image_priority (flt dist) {
+	return dist <= 1 ? dist : dist +powf(2, 6 * (dist -1));
+}
+// biggest normalized distance that still has image_priority <= cutoff (slightly too big, which is fine for a bound)
+flt calc_image_priority_max_dist (flt cutoff) {
+	return cutoff <= 1 ? max(cutoff, 0.0f) : 1 +log2f(cutoff) / 6;
+}
+
+// the entries whose cells (or their wrapped second instances) can be within max_dist_rows rows of the center of the view
+Index_Range calc_grid_entry_range (u32 count, v2 view_coord, v2 grid_sz_cells, flt max_dist_rows) {
+	flt w = grid_sz_cells.x;
+	if (!(w > 0) || !(max_dist_rows < (flt)count)) // also catches nan and inf
+		return { 0, count };
+
+	// the wrapped instances are drawn one row up or down
+	flt row_lo = floor(view_coord.y -max_dist_rows) -1;
+	flt row_hi = ceil(view_coord.y +max_dist_rows) +1;
+
+	// row q has the entries with i -view_coord.x in [q*w -w/2, q*w +w/2)
+	flt lo = floor(view_coord.x +row_lo*w -w/2);
+	flt hi = ceil(view_coord.x +row_hi*w +w/2) +1;
+
+	Index_Range r;
+	r.begin = (u32)clamp(lo, 0.0f, (flt)count);
+	r.end = (u32)clamp(hi, (flt)r.begin, (flt)count);
+	return r;
+}
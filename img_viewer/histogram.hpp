@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include <string>
+using std::string;
+
+#include "stdio.h"
+
+#include "basic_typedefs.hpp"
+#include "math.hpp"
+#include "prints.hpp"
+
+// Keeps the last N samples of some measurement (eg. a latency in ms) to show percentiles and a histogram of them
+struct Sample_Histogram {
+	cstr				name;
+
+	std::vector<f32>	samples; // ring buffer
+	int					cur = 0;
+	u64					total_count = 0;
+
+	static constexpr int MAX_SAMPLES = 4096;
+
+	Sample_Histogram (cstr name): name{name} {}
+
+	void add (f32 val) {
+		if ((int)samples.size() < MAX_SAMPLES) {
+			samples.push_back(val);
+		} else {
+			samples[cur] = val;
+			cur = (cur +1) % MAX_SAMPLES;
+		}
+		total_count++;
+	}
+	void clear () {
+		samples.clear();
+		cur = 0;
+		total_count = 0;
+	}
+
+	// p in [0,1]
+	f32 percentile (std::vector<f32> const& sorted, f32 p) const {
+		if (sorted.size() == 0)
+			return 0;
+		int i = clamp((int)roundf(p * (f32)(sorted.size() -1)), 0, (int)sorted.size() -1);
+		return sorted[i];
+	}
+
+	void imgui (cstr unit="ms") const {
+		std::vector<f32> sorted = samples;
+		std::sort(sorted.begin(), sorted.end());
+
+		f32 p50 = percentile(sorted, 0.50f);
+		f32 p95 = percentile(sorted, 0.95f);
+		f32 p99 = percentile(sorted, 0.99f);
+
+		ImGui::Text("%-20s n: %6llu  p50: %8.2f %s  p95: %8.2f %s  p99: %8.2f %s", name, (unsigned long long)total_count, p50,unit, p95,unit, p99,unit);
+
+		if (sorted.size() == 0)
+			return;
+
+		// bucket up to p99 so a few outliers don't squish the rest of the histogram
+		f32 bucket_max = max(p99, 0.001f);
+
+		f32 buckets[64] = {};
+		for (f32 s : sorted) {
+			int b = clamp((int)(s / bucket_max * ARRLEN(buckets)), 0, (int)ARRLEN(buckets) -1);
+			buckets[b] += 1;
+		}
+
+		ImGui::PushItemWidth(-1);
+		ImGui::PlotHistogram(prints("##%s", name).c_str(), buckets, ARRLEN(buckets), 0, prints("0 - %.2f %s", bucket_max, unit).c_str(), 0, FLT_MAX, ImVec2(0,40));
+		ImGui::PopItemWidth();
+	}
+
+	// write the samples as "name,value" lines
+	void write_csv (FILE* f) const {
+		for (int i=0; i<(int)samples.size(); ++i) {
+			int indx = ((int)samples.size() < MAX_SAMPLES ? 0 : cur) +i; // oldest to newest
+			fprintf(f, "%s,%f\n", name, samples[indx % samples.size()]);
+		}
+	}
+};
@@ -4,12 +4,17 @@
 using std::unique_ptr;
 using std::make_unique;
 
+#include <climits>
+
 #include <string>
 typedef std::string str;
 typedef std::string const& strcr;
 
 #include "stbi.hpp"
 
+#include "simple_file_io.hpp"
+#include "tracing.hpp"
+
 #include "vector_util.hpp"
 #include "colors.hpp"
 
@@ -70,18 +75,52 @@ public:
 		return img;
 	}
 
-	static Image2D load_from_file (strcr filepath) {
+	// read the whole file first, so read and decode show up seperately in traces
+	static std::vector<byte> read_file (strcr filepath) {
+		TRACE_SCOPE("read");
+
+		std::vector<byte> file_data;
+		if (!load_binary_file(filepath, &file_data) || file_data.size() > (uptr)INT_MAX)
+			throw Expt_File_Load_Fail(filepath);
+		return file_data;
+	}
+	// TOP-DOWN, unlike all our other images, stbi_set_flip_vertically_on_load is never used, since it is global state (the loader threads decode concurrently) and costs a whole extra pass
+	// the rows are flipped where they are written anyway instead (see generate_mips_from_image, orient_image)
+	static Image2D decode_from_memory_top_down (strcr filepath, std::vector<byte> const& file_data) {
+		TRACE_SCOPE("decode");
+
 		Image2D img;
-		
-		stbi_set_flip_vertically_on_load(true); // OpenGL has textues bottom-up
 
 		int n;
-		img.pixels = (rgba8*)stbi_load(filepath.c_str(), &img.size.x,&img.size.y, &n, 4);
+		img.pixels = (rgba8*)stbi_load_from_memory(file_data.data(), (int)file_data.size(), &img.size.x,&img.size.y, &n, 4);
 		if (!img.pixels) throw Expt_File_Load_Fail(filepath);
 
 		return img;
 	}
 
+	// for small images that are uploaded directly (icons), OpenGL has textues bottom-up
+	static Image2D load_from_file (strcr filepath) {
+		auto img = decode_from_memory_top_down(filepath, read_file(filepath));
+		img.flip_vertical();
+		return img;
+	}
+
+	// 1/8 scale preview from the first scans of a progressive jpeg, only reads as much of the file as needed, false if the file is not a progressive jpeg
+	// TOP-DOWN like decode_from_memory_top_down
+	static bool load_progressive_jpeg_preview (strcr filepath, Image2D* out) {
+		TRACE_SCOPE("load_progressive_jpeg_preview");
+
+		FILE* f = fopen(filepath.c_str(), "rb");
+		if (!f)
+			return false;
+
+		iv2 full_size;
+		out->pixels = (rgba8*)stbi_load_jpeg_dc_preview_from_file(f, &out->size.x,&out->size.y, &full_size.x,&full_size.y);
+		fclose(f);
+
+		return out->pixels != nullptr;
+	}
+
 	rgba8& get_pixel (int x, int y) {					return pixels[y * size.x +x]; }
 	rgba8 const& get_pixel (int x, int y) const {		return pixels[y * size.x +x]; }
 
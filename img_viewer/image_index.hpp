@@ -0,0 +1,385 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <cstdio>
+
+#include <string>
+using std::string;
+
+#include "windows.h"
+
+#include "basic_typedefs.hpp"
+#include "vector_util.hpp"
+#include "simple_file_io.hpp"
+
+#include "image.hpp"
+#include "tracing.hpp"
+
+#if RZ_COMP == RZ_COMP_MSVC
+	#include <intrin.h>
+#endif
+
+/* Content based index of images, to find similar images and duplicates without decoding anything for it
+	The loader threads generate the small mips of every image they load anyway, the signature is computed from the smallest of them that is at least 9x8 px (see compute_image_signature)
+	and comes back with the result (see Texture_Streamer::image_index), so the index fills up with every image that was looked at
+
+	Signature: 64 bit dHash (in a 9x8 grayscale version of the image, is each pixel darker than its right neighbour) and a 4x4x4 rgb histogram
+	Similar images have hashes with a small hamming distance, the histogram separates images with similar structure but different colors
+
+	Finding the images similar to one is a linear scan of the hashes, 8 bytes per image, so 500k images are 4MB and take about a millisecond with popcount
+	Finding all duplicates uses multi-index hashing: two hashes within a distance of 3 have at least one of their 4 16 bit parts equal (pigeonhole),
+	so only images with an equal part are compared instead of all pairs
+
+	Entries are keyed by filepath and saved in IMAGE_INDEX_FILE, the mtime of the file when it was decoded tells if an entry is still valid
+*/
+
+#define IMAGE_INDEX_FILE "saves/image_index.bin"
+
+constexpr int COLOR_HISTOGRAM_BINS = 4*4*4;
+
+struct Color_Histogram {
+	u8		bins[COLOR_HISTOGRAM_BINS]; // fraction of the pixels in 1/255, so the bins sum to about 255
+};
+
+struct Image_Signature {
+	u64				dhash;
+	Color_Histogram	histogram;
+};
+
+inline int popcount64 (u64 x) {
+#if RZ_COMP == RZ_COMP_MSVC
+	return (int)__popcnt64(x);
+#else
+	return __builtin_popcountll(x);
+#endif
+}
+
+int calc_hash_distance (u64 l, u64 r) {
+	return popcount64(l ^ r);
+}
+// [0, 510]
+int calc_histogram_distance (Color_Histogram const& l, Color_Histogram const& r) {
+	int dist = 0;
+	for (int i=0; i<COLOR_HISTOGRAM_BINS; ++i)
+		dist += abs((int)l.bins[i] -(int)r.bins[i]);
+	return dist;
+}
+
+// mips in smallest to biggest order (like the loader generates them), false if none of them is big enough
+bool compute_image_signature (std::vector<Image2D> const& mips, Image_Signature* sig) {
+	TRACE_SCOPE("compute_image_signature");
+
+	Image2D const* src = nullptr;
+	for (auto& m : mips) {
+		if (m.size.x >= 9 && m.size.y >= 8) {
+			src = &m;
+			break;
+		}
+	}
+	if (!src)
+		return false;
+
+	auto img_9x8 = Image2D::rescale_box_filter(*src, iv2(9,8));
+
+	flt luma[8][9];
+	for (int y=0; y<8; ++y) {
+		for (int x=0; x<9; ++x) {
+			rgba8 c = img_9x8.get_pixel(x,y);
+			luma[y][x] = 0.299f * c.x + 0.587f * c.y + 0.114f * c.z;
+		}
+	}
+
+	sig->dhash = 0;
+	for (int y=0; y<8; ++y) {
+		for (int x=0; x<8; ++x)
+			sig->dhash = (sig->dhash << 1) | (luma[y][x] < luma[y][x+1] ? 1 : 0);
+	}
+
+	u32 counts[COLOR_HISTOGRAM_BINS] = {};
+	for (int y=0; y<src->size.y; ++y) {
+		for (int x=0; x<src->size.x; ++x) {
+			rgba8 c = src->get_pixel(x,y);
+			counts[(c.x >> 6) * 16 + (c.y >> 6) * 4 + (c.z >> 6)]++;
+		}
+	}
+	u32 total = (u32)src->size.x * (u32)src->size.y;
+	for (int i=0; i<COLOR_HISTOGRAM_BINS; ++i)
+		sig->histogram.bins[i] = (u8)((counts[i] * 255 + total/2) / total);
+
+	return true;
+}
+
+struct Image_Index_Header {
+	u32		magic;
+	u32		version;
+	u32		entry_count;
+	u32		string_pool_size;
+	// followed by the arrays in the order of _foreach_array, each starting at a multiple of 8 bytes
+};
+constexpr u32 IMAGE_INDEX_MAGIC = 0x78696d69; // "imix"
+constexpr u32 IMAGE_INDEX_VERSION = 1;
+
+struct Image_Index {
+	// per entry
+	std::vector<u64>				hashes; // dhash, separate from the rest since queries scan them
+	std::vector<Color_Histogram>	histograms;
+	std::vector<u64>				mtimes; // last write FILETIME of the file when it was decoded
+	std::vector<u32>				path_offsets; // into string_pool, null terminated
+
+	std::vector<char>				string_pool;
+
+	std::unordered_map<string, u32>	entries_by_path;
+
+	bool							dirty = false; // changed since it was read
+
+	static constexpr u32 NO_ENTRY = (u32)-1;
+
+	u32 size () const {						return (u32)hashes.size(); }
+	cstr get_path (u32 i) const {			return &string_pool[path_offsets[i]]; }
+
+	u32 find (string const& filepath) const {
+		auto it = entries_by_path.find(filepath);
+		return it != entries_by_path.end() ? it->second : NO_ENTRY;
+	}
+
+	// replaces the entry of the file if it has one
+	void add (string const& filepath, u64 mtime, Image_Signature const& sig) {
+		u32 i = find(filepath);
+		if (i == NO_ENTRY) {
+			i = size();
+
+			path_offsets.push_back((u32)string_pool.size());
+			string_pool.insert(string_pool.end(), filepath.c_str(), filepath.c_str() +filepath.size() +1);
+
+			hashes.push_back(0);
+			histograms.push_back({});
+			mtimes.push_back(0);
+
+			entries_by_path.emplace(filepath, i);
+		}
+
+		hashes[i] = sig.dhash;
+		histograms[i] = sig.histogram;
+		mtimes[i] = mtime;
+		dirty = true;
+	}
+
+	struct Match {
+		u32		entry;
+		int		distance; // of the hashes
+		int		histogram_distance;
+	};
+
+	// the entries within max_distance of the signature of entry, most similar first
+	std::vector<Match> find_similar (u32 entry, int max_distance) const {
+		TRACE_SCOPE("Image_Index::find_similar");
+
+		u64 hash = hashes[entry];
+
+		std::vector<Match> matches;
+		for (u32 i=0; i<size(); ++i) {
+			int dist = calc_hash_distance(hashes[i], hash);
+			if (dist <= max_distance && i != entry)
+				matches.push_back({ i, dist, 0 });
+		}
+
+		for (auto& m : matches)
+			m.histogram_distance = calc_histogram_distance(histograms[m.entry], histograms[entry]);
+
+		std::sort(matches.begin(), matches.end(), [] (Match const& l, Match const& r) {
+			if (l.distance != r.distance)
+				return l.distance < r.distance;
+			return l.histogram_distance < r.histogram_distance;
+		});
+		return matches;
+	}
+
+	// groups of entries that are within max_distance (<= 3) of another entry of the group, biggest groups first
+	std::vector<std::vector<u32>> find_duplicates (int max_distance) const {
+		TRACE_SCOPE("Image_Index::find_duplicates");
+
+		assert(max_distance <= 3); // the pigeonhole argument only holds for less differing bits than parts
+		max_distance = clamp(max_distance, 0, 3);
+
+		std::vector<u32> parent (size()); // union-find
+		for (u32 i=0; i<size(); ++i)
+			parent[i] = i;
+
+		auto find_root = [&] (u32 i) {
+			while (parent[i] != i) {
+				parent[i] = parent[parent[i]];
+				i = parent[i];
+			}
+			return i;
+		};
+		auto get_part = [] (u64 hash, int part) { return (u16)(hash >> (part * 16)); };
+
+		// identical hashes (solid colors, copies) are joined first and only one of them is compared further, so they do not make the runs below quadratic
+		std::vector<u32> reps (size());
+		for (u32 i=0; i<size(); ++i)
+			reps[i] = i;
+		std::sort(reps.begin(), reps.end(), [&] (u32 l, u32 r) { return hashes[l] < hashes[r]; });
+
+		u32 unique_count = 0;
+		for (u32 k=0; k<size(); ++k) {
+			if (unique_count > 0 && hashes[reps[unique_count -1]] == hashes[reps[k]])
+				parent[reps[k]] = reps[unique_count -1];
+			else
+				reps[unique_count++] = reps[k];
+		}
+		reps.resize(unique_count);
+
+		std::vector<u64> keys (reps.size()); // part << 32 | entry
+		for (int part=0; part<4; ++part) {
+			for (u32 k=0; k<(u32)reps.size(); ++k)
+				keys[k] = ((u64)get_part(hashes[reps[k]], part) << 32) | reps[k];
+			std::sort(keys.begin(), keys.end());
+
+			for (u32 begin=0, end; begin<(u32)keys.size(); begin=end) {
+				for (end=begin+1; end<(u32)keys.size() && (keys[end] >> 32) == (keys[begin] >> 32); ++end)
+					;
+
+				for (u32 a=begin; a<end; ++a) {
+					u32 i = (u32)keys[a];
+					for (u32 b=a+1; b<end; ++b) {
+						u32 j = (u32)keys[b];
+						if (calc_hash_distance(hashes[i], hashes[j]) <= max_distance && find_root(i) != find_root(j))
+							parent[find_root(i)] = find_root(j);
+					}
+				}
+			}
+		}
+
+		std::vector<u32> group_sizes (size(), 0); // by root
+		for (u32 i=0; i<size(); ++i)
+			group_sizes[find_root(i)]++;
+
+		std::unordered_map<u32, u32> group_by_root;
+		std::vector<std::vector<u32>> groups;
+		for (u32 i=0; i<size(); ++i) {
+			u32 root = find_root(i);
+			if (group_sizes[root] < 2)
+				continue;
+
+			auto it = group_by_root.emplace(root, (u32)groups.size()).first;
+			if (it->second == groups.size())
+				groups.emplace_back();
+			groups[it->second].push_back(i);
+		}
+		std::sort(groups.begin(), groups.end(), [] (std::vector<u32> const& l, std::vector<u32> const& r) { return l.size() > r.size(); });
+		return groups;
+	}
+
+	uptr get_memory_size () const {
+		return	hashes.capacity() * sizeof(hashes[0]) + histograms.capacity() * sizeof(histograms[0]) + mtimes.capacity() * sizeof(mtimes[0]) +
+				path_offsets.capacity() * sizeof(path_offsets[0]) + string_pool.capacity();
+	}
+
+	// calls f(data, size) for every array of the file in file order
+	template <typename T, typename FUNC>
+	static void _foreach_array (T& index, FUNC f) {
+		f(index.hashes.data(),			index.hashes.size() * sizeof(index.hashes[0]));
+		f(index.histograms.data(),		index.histograms.size() * sizeof(index.histograms[0]));
+		f(index.mtimes.data(),			index.mtimes.size() * sizeof(index.mtimes[0]));
+		f(index.path_offsets.data(),	index.path_offsets.size() * sizeof(index.path_offsets[0]));
+		f(index.string_pool.data(),		index.string_pool.size() * sizeof(index.string_pool[0]));
+	}
+	static uptr _align_offset (uptr offset) {
+		return (offset +7) & ~(uptr)7;
+	}
+
+	bool write (string const& filepath) {
+		TRACE_SCOPE("Image_Index::write");
+
+		std::vector<byte> data (sizeof(Image_Index_Header));
+
+		auto* h = (Image_Index_Header*)data.data();
+		h->magic = IMAGE_INDEX_MAGIC;
+		h->version = IMAGE_INDEX_VERSION;
+		h->entry_count = size();
+		h->string_pool_size = (u32)string_pool.size();
+
+		_foreach_array(*this, [&] (void const* array, uptr array_size) {
+			data.resize(_align_offset(data.size())); // zero padding
+			data.insert(data.end(), (byte const*)array, (byte const*)array +array_size);
+		});
+
+		// written next to it and moved over it, so a crash while writing leaves the old index intact
+		string tmp_filepath = filepath +".tmp";
+
+		FILE* f = fopen(tmp_filepath.c_str(), "wb");
+		bool ok = f && fwrite(data.data(), 1, data.size(), f) == data.size();
+		if (f)
+			fclose(f);
+
+		if (!ok || !MoveFileExA(tmp_filepath.c_str(), filepath.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+			fprintf(stderr, "Could not write image index %s\n", filepath.c_str());
+			DeleteFileA(tmp_filepath.c_str());
+			return false;
+		}
+		dirty = false;
+		return true;
+	}
+
+	// keeps the index empty if there is no (valid) file
+	bool read (string const& filepath) {
+		TRACE_SCOPE("Image_Index::read");
+
+		std::vector<byte> data;
+		if (!load_binary_file(filepath, &data) || data.size() < sizeof(Image_Index_Header))
+			return false;
+
+		auto* h = (Image_Index_Header const*)data.data();
+		if (h->magic != IMAGE_INDEX_MAGIC || h->version != IMAGE_INDEX_VERSION)
+			return false;
+
+		// check the counts against the file size before allocating anything for them, a corrupt count could be billions
+		u64 count = h->entry_count;
+		u64 expected_size = sizeof(Image_Index_Header);
+		for (u64 array_size : { count * sizeof(hashes[0]), count * sizeof(histograms[0]), count * sizeof(mtimes[0]), count * sizeof(path_offsets[0]),
+				(u64)h->string_pool_size * sizeof(string_pool[0]) })
+			expected_size = _align_offset((uptr)expected_size) +array_size;
+
+		if (expected_size > data.size()) {
+			fprintf(stderr, "Image index %s is corrupt, ignoring it\n", filepath.c_str());
+			return false;
+		}
+
+		hashes			.resize(h->entry_count);
+		histograms		.resize(h->entry_count);
+		mtimes			.resize(h->entry_count);
+		path_offsets	.resize(h->entry_count);
+		string_pool		.resize(h->string_pool_size);
+
+		bool ok = true;
+		uptr offset = sizeof(Image_Index_Header);
+
+		_foreach_array(*this, [&] (void* array, uptr array_size) {
+			offset = _align_offset(offset);
+			ok = ok && offset +array_size <= data.size();
+			if (ok)
+				memcpy(array, data.data() +offset, array_size);
+			offset += array_size;
+		});
+
+		ok = ok && (h->entry_count == 0 || (h->string_pool_size > 0 && string_pool.back() == '\0'));
+		for (u32 i=0; ok && i<h->entry_count; ++i)
+			ok = path_offsets[i] < h->string_pool_size;
+
+		if (!ok) {
+			fprintf(stderr, "Image index %s is corrupt, ignoring it\n", filepath.c_str());
+			*this = Image_Index();
+			return false;
+		}
+
+		entries_by_path.clear();
+		entries_by_path.reserve(size());
+		for (u32 i=0; i<size(); ++i)
+			entries_by_path.emplace(get_path(i), i);
+
+		dirty = false;
+		return true;
+	}
+};
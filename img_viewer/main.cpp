@@ -24,6 +24,8 @@ using std::string;
 #include "prints.hpp"
 
 #include "texture.hpp"
+#include "tracing.hpp"
+#include "alloc_counter.hpp"
 
 #include "vector_util.hpp"
 #include "simple_file_io.hpp"
@@ -33,6 +35,7 @@ using std::string;
 
 bool ctrl_down = false;
 bool do_toggle_fullscreen = false;
+bool do_dump_trace = false;
 
 void glfw_key_event (GLFWwindow* window, int key, int scancode, int action, int mods) {
 	ImGuiIO& io = ImGui::GetIO();
@@ -54,6 +57,10 @@ void glfw_key_event (GLFWwindow* window, int key, int scancode, int action, int
 			if (action == GLFW_PRESS)
 				do_toggle_fullscreen = true;
 		} break;
+		case GLFW_KEY_F12: {
+			if (action == GLFW_PRESS)
+				do_dump_trace = true;
+		} break;
 	}
 }
 void glfw_char_event (GLFWwindow* window, unsigned int codepoint, int mods) {
@@ -77,15 +84,25 @@ struct MButton {
 };
 
 #include <map>
+#include <set>
 
 #include "threadpool.hpp"
 
 int	frame_i = 0;
 
 #include "texture_streamer.hpp"
+#include "video_thumbnail.hpp"
+#include "content_model.hpp"
+#include "grid_layout.hpp"
+#include "dir_watcher.hpp"
+#include "dir_index.hpp"
+#include "image_index.hpp"
+#include "content_view.hpp"
 
 #include "string_stuff.hpp"
 
+#include "benchmarks.hpp"
+
 struct App {
 	int				swap_interval = 1;
 
@@ -99,6 +116,7 @@ struct App {
 	unique_ptr<Texture2D>	tex_file_icon;
 	unique_ptr<Texture2D>	tex_file_icon_GIF;
 	unique_ptr<Texture2D>	tex_file_icon_mp4;
+	unique_ptr<Texture2D>	tex_white; // 1x1, quads of a single color with draw_textured_quad, so they are drawn in order with the images
 
 	static Texture2D create_null_texture () {
 		auto tex = Texture2D::generate();
@@ -127,86 +145,405 @@ struct App {
 		return std::move(tex);
 	}
 
-	enum filetype_e {
-		FT_IMAGE_FILE,
-		FT_DIRECTORY,
-		FT_NON_IMAGE_FILE,
-	};
+	// probes the file (reads its header) to know if it is an image and its size
+	void _add_file_entry (Content_Model* content, string const& path, string const& fn, u64 mtime, u64 file_size) {
+		string filepath = path + fn;
+		
+		iv2 size_px;
+		bool is_image_file = stbi_info(filepath.c_str(), &size_px.x,&size_px.y, nullptr) != 0;
+		//if (!is_image_file)
+		//	printf("%s\n", stbi_failure_reason());
+
+		if (is_image_file)
+			size_px = orient_size(size_px, load_exif_orientation(filepath)); // the decoded mips are oriented, so the layout has to be too
+		else if (auto* provider = find_thumbnail_provider(filepath))
+			is_image_file = probe_provided_thumbnail(provider, filepath, &size_px); // videos are shown as their representative frame
+
+		if (is_image_file)
+			content->add_entry(FT_IMAGE_FILE, filepath, path.size(), size_px, mtime, file_size);
+		else
+			content->add_entry(FT_NON_IMAGE_FILE, filepath, path.size(), 0, mtime, file_size);
+	}
 
-	struct Content {
-		str		name;
+	// the entries of dir (a directory entry of content, with the path path) from the found files, recursively
+	void _populate (Content_Model* content, u32 dir, n_find_files::Directory_Tree const& found, string const& path) {
+		
+		content->begin_children(dir, (u32)(found.dirs.size() +found.filenames.size()));
 
-		virtual filetype_e type () = 0;
-		virtual ~Content () {};
-	};
+		for (auto& d : found.dirs) {
+			content->add_entry(FT_DIRECTORY, path +d.name, path.size(), 0, d.mtime);
+		}
+		for (size_t i=0; i<found.filenames.size(); ++i) {
+			_add_file_entry(content, path, found.filenames[i], found.file_mtimes[i], found.file_sizes[i]);
+		}
 
-	struct File : Content {
-		//str	name; // just the file name
-		virtual ~File () {};
-	};
-	struct Non_Image_File : File {
-		filetype_e type () { return FT_NON_IMAGE_FILE; };
-	};
-	struct Image_File : File {
-		string	filepath; // the relative or absolute filepath needed to open the file
-		
-		iv2		size_px;
+		// subdirectories after all entries of this one, so every directory is a contiguous range
+		u32 subdir = content->get_children(dir).begin;
+		for (auto& d : found.dirs) {
+			_populate(content, subdir++, d, path +d.name);
+		}
+	}
 
-		filetype_e type () { return FT_IMAGE_FILE; };
+	//// Applying changes of the files on disk to the loaded directory
+	struct Dir_Changes {
+		std::set<string>	dirty_dirs; // have to be listed again, paths like in the Content_Model (with '/')
+		std::set<string>	changed_files; // have to be probed again
+		bool				all_dirty = false; // changes were lost, list every directory again
+		bool				check_mtimes = false; // directories whose mtime changed are dirty too (revalidating a snapshot, see dir_index.hpp)
 	};
-	struct Directory_Tree : Content {
-		//str		name; // for root: full or relative path of directory +'/',  for non-root: directory name +'/'
 
-		std::vector< unique_ptr<Directory_Tree> >	subdirs;
-		std::vector< unique_ptr<File> >				files;
+	// copy of the entries of old_dir in old into dir, only the dirty directories are listed again, and only new or changed files are probed
+	// called from the revalidation thread too, so this must not touch anything of the App but its arguments
+	void _update (Content_Model* content, u32 dir, Content_Model const& old, u32 old_dir, string const& path, Dir_Changes const& changes) {
+		if (dir_index_cancel)
+			return; // result is discarded
 
-		std::vector<Content*>						content;
+		Index_Range old_children = old.get_children(old_dir);
 
-		filetype_e type () { return FT_DIRECTORY; };
-	};
+		u64 mtime = 0;
+		bool dirty = changes.all_dirty || changes.dirty_dirs.count(path) != 0;
+		if (dirty || changes.check_mtimes) {
+			mtime = get_file_mtime(path); // before listing, so a change during the listing is seen the next time
+			dirty = dirty || mtime != old.mtimes[old_dir];
+		}
 
-	void _populate (Directory_Tree* tree, n_find_files::Directory_Tree const& dir, string const& path) {
-		
-		for (auto& d : dir.dirs) {
-			auto subtree = make_unique<Directory_Tree>();
+		if (!dirty) {
+			content->begin_children(dir, old_children.size());
 
-			subtree->name = d.name;
-			_populate(subtree.get(), d, path+subtree->name);
+			for (u32 i=old_children.begin; i<old_children.end; ++i)
+				content->copy_entry(old, i);
 
-			tree->content.emplace_back(subtree.get());
+			u32 subdir = content->get_children(dir).begin;
+			for (u32 i=old_children.begin; i<old_children.end; ++i, ++subdir) {
+				if (old.get_type(i) == FT_DIRECTORY)
+					_update(content, subdir, old, i, old.get_path(i), changes);
+			}
+			return;
+		}
 
-			tree->subdirs.emplace_back( std::move(subtree) );
+		n_find_files::Directory listing;
+		try {
+			listing = n_find_files::find_files(path);
+		} catch (Expt_Path_Not_Found const& e) {
+			// was removed, its parent is dirty too, so this only happens for the root
 		}
-		for (auto& fn : dir.filenames) {
-			string filepath = path + fn;
-			
-			iv2 size_px;
-			bool is_image_file = stbi_info(filepath.c_str(), &size_px.x,&size_px.y, nullptr) != 0;
-			//if (!is_image_file)
-			//	printf("%s\n", stbi_failure_reason());
 
-			unique_ptr<File> file;
+		content->mtimes[dir] = mtime;
+
+		std::map<string, u32> old_by_name; // dirs end in '/', like in the listing
+		for (u32 i=old_children.begin; i<old_children.end; ++i)
+			old_by_name.emplace(old.get_name(i), i);
 
-			if (is_image_file) {
-				auto img = make_unique<Image_File>();
-				img->name = fn;
-				img->filepath = std::move(filepath);
+		content->begin_children(dir, (u32)(listing.dirnames.size() +listing.filenames.size()));
 
-				img->size_px = size_px;
+		for (auto& d : listing.dirnames) {
+			auto it = old_by_name.find(d);
+			// the old mtime, so the recursion can compare it, it gets the new one if it is listed again
+			content->add_entry(FT_DIRECTORY, path +d, path.size(), 0, it != old_by_name.end() ? old.mtimes[it->second] : 0);
+		}
+		for (size_t i=0; i<listing.filenames.size(); ++i) {
+			auto& fn = listing.filenames[i];
+			auto it = old_by_name.find(fn);
+			if (it != old_by_name.end() && old.mtimes[it->second] == listing.file_mtimes[i] && old.file_sizes[it->second] == listing.file_sizes[i] && changes.changed_files.count(path +fn) == 0)
+				content->copy_entry(old, it->second);
+			else
+				_add_file_entry(content, path, fn, listing.file_mtimes[i], listing.file_sizes[i]);
+		}
 
-				file = unique_ptr<File>(std::move( img ));
+		u32 subdir = content->get_children(dir).begin;
+		for (size_t i=0; i<listing.dirnames.size(); ++i) {
+			auto& d = listing.dirnames[i];
+			auto it = old_by_name.find(d);
+			if (it != old_by_name.end()) {
+				_update(content, subdir++, old, it->second, path +d, changes);
 			} else {
-				file = unique_ptr<File>(std::move( make_unique<Non_Image_File>() ));
-				file->name = fn;
+				// new directory (or moved here), everything in it is new
+				n_find_files::Directory_Tree found;
+				try {
+					found = n_find_files::find_files_recursive(path, d, listing.dir_mtimes[i]);
+				} catch (Expt_Path_Not_Found const& e) {
+					// removed again since the listing (bursts of temp directories), shown as empty until the change of its parent is applied
+				}
+				_populate(content, subdir++, found, path +d);
 			}
+		}
+	}
+
+	// keeps the selection on the same file
+	void replace_viewed_dir (unique_ptr<Content_Model> updated) {
+		string selected = image_window_entry != Content_Model::NO_ENTRY ? viewed_dir->get_path(image_window_entry) : "";
+
+		content_view.invalidate(); // before the old model is freed, the worker of the view could be reading it
+		viewed_dir = std::move(updated);
+
+		image_window_entry = Content_Model::NO_ENTRY;
+		for (u32 i=0; i<viewed_dir->size() && selected.size() > 0; ++i) {
+			if (selected.compare(viewed_dir->get_path(i)) == 0) {
+				image_window_entry = i;
+				break;
+			}
+		}
+	}
+
+	Directory_Watcher			dir_watcher;
+	std::vector<File_Change>	pending_dir_changes;
+	f64							dir_changes_first_t;
+	f64							dir_changes_last_t;
+	bool						dir_changes_lost = false;
+	int							dir_changes_applied = 0; // number of changes
+
+	static constexpr f64 DIR_CHANGES_SETTLE_TIME = 0.1; // changes are collected until none came in for this long, so a burst (eg. copying thousands of files) is applied at once
+	static constexpr f64 DIR_CHANGES_MAX_DELAY = 1.0; // but a continuous stream of changes is still applied this often
+
+	// call every frame before the grid, viewed_dir is replaced if something changed
+	void apply_dir_changes () {
+		if (!viewed_dir)
+			return;
+
+		f64 now = glfwGetTime();
+
+		size_t count_before = pending_dir_changes.size();
+		bool lost = dir_watcher.poll(&pending_dir_changes);
+		dir_changes_lost = dir_changes_lost || lost;
+
+		if (pending_dir_changes.size() > count_before || lost) {
+			if (count_before == 0)
+				dir_changes_first_t = now;
+			dir_changes_last_t = now;
+		}
+
+		if (pending_dir_changes.size() == 0 && !dir_changes_lost)
+			return;
+		if (now -dir_changes_last_t < DIR_CHANGES_SETTLE_TIME && now -dir_changes_first_t < DIR_CHANGES_MAX_DELAY)
+			return;
+
+		TRACE_SCOPE("apply_dir_changes");
+
+		string root_path = viewed_dir->get_path(Content_Model::ROOT);
+
+		Dir_Changes changes;
+		changes.all_dirty = dir_changes_lost;
+
+		for (auto& c : pending_dir_changes) {
+			string path = root_path + c.path;
+
+			auto slash = c.path.find_last_of('/');
+			changes.dirty_dirs.insert(root_path + (slash == string::npos ? "" : c.path.substr(0, slash +1)));
+			
+			// changed in any way, even a file that is added could be one that was removed before (editors often save by replacing the file)
+			changes.changed_files.insert(path);
+			tex_streamer.invalidate_file(path);
+		}
+
+		auto updated = make_unique<Content_Model>();
+		u32 root = updated->copy_entry(*viewed_dir, Content_Model::ROOT);
+		_update(updated.get(), root, *viewed_dir, Content_Model::ROOT, root_path, changes);
+		updated->shrink_to_fit();
 
-			tree->content.emplace_back( file.get() );
-			tree->files.emplace_back( std::move(file) );
+		replace_viewed_dir(std::move(updated));
+
+		if (dir_index_thread.joinable()) {
+			// the revalidation result replaces viewed_dir, it might have listed these directories before the changes, so they are applied again after it
+			for (auto& c : pending_dir_changes)
+				changes_during_revalidation.push_back(std::move(c));
+			changes_during_revalidation_lost = changes_during_revalidation_lost || dir_changes_lost;
+		}
+
+		dir_changes_applied += (int)pending_dir_changes.size();
+		pending_dir_changes.clear();
+		dir_changes_lost = false;
+		dir_index_dirty = true;
+	}
+
+	//// Snapshot of the directory tree (see dir_index.hpp)
+	std::thread					dir_index_thread; // revalidating the snapshot that is displayed
+	std::atomic<bool>			dir_index_done {false};
+	std::atomic<bool>			dir_index_cancel {false};
+	unique_ptr<Content_Model>	revalidated_dir; // written by dir_index_thread until dir_index_done
+	flt							revalidated_ms; // same
+	std::vector<File_Change>	changes_during_revalidation;
+	bool						changes_during_revalidation_lost = false;
+	bool						dir_index_dirty = false; // viewed_dir changed since the snapshot was written
+	flt							dir_load_ms = 0; // until the grid could be shown
+	flt							dir_revalidate_ms = 0;
+
+	void start_dir_index_revalidation () {
+		assert(!dir_index_thread.joinable());
+
+		dir_index_done = false;
+		dir_index_cancel = false;
+		changes_during_revalidation.clear();
+		changes_during_revalidation_lost = false;
+
+		// the thread works on its own copy, the grid writes the texture handles of viewed_dir
+		auto snapshot = make_unique<Content_Model>(*viewed_dir);
+
+		dir_index_thread = std::thread([this, snapshot = std::move(snapshot)] () {
+			tracer.set_thread_name("dir_index");
+			TRACE_SCOPE("revalidate dir index");
+
+			auto t_begin = std::chrono::steady_clock::now();
+
+			string root_path = snapshot->get_path(Content_Model::ROOT);
+
+			Dir_Changes changes;
+			changes.check_mtimes = true;
+
+			auto updated = make_unique<Content_Model>();
+			try {
+				u32 root = updated->copy_entry(*snapshot, Content_Model::ROOT);
+				_update(updated.get(), root, *snapshot, Content_Model::ROOT, root_path, changes);
+			} catch (Expt_Path_Not_Found const& e) {
+				// an exception escaping the thread would terminate the app, the directory was removed while we listed it, so it is empty now
+				updated = make_unique<Content_Model>();
+				u32 root = updated->copy_entry(*snapshot, Content_Model::ROOT);
+				updated->begin_children(root, 0);
+			}
+			updated->shrink_to_fit();
+
+			revalidated_ms = (flt)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -t_begin).count() / 1000;
+
+			revalidated_dir = std::move(updated);
+			dir_index_done = true;
+		});
+	}
+
+	void stop_dir_index_revalidation () {
+		if (!dir_index_thread.joinable())
+			return;
+
+		dir_index_cancel = true;
+		dir_index_thread.join();
+		dir_index_cancel = false;
+
+		revalidated_dir = nullptr;
+		changes_during_revalidation.clear();
+	}
+
+	// call every frame, swaps in the revalidated tree once it is done
+	void poll_dir_index_revalidation () {
+		if (!dir_index_thread.joinable() || !dir_index_done)
+			return;
+
+		dir_index_thread.join();
+
+		dir_revalidate_ms = revalidated_ms;
+		replace_viewed_dir(std::move(revalidated_dir));
+		write_dir_index(*viewed_dir);
+		dir_index_dirty = false;
+
+		for (auto& c : changes_during_revalidation)
+			pending_dir_changes.push_back(std::move(c));
+		changes_during_revalidation.clear();
+		dir_changes_lost = dir_changes_lost || changes_during_revalidation_lost;
+		dir_changes_first_t = dir_changes_last_t = -INF; // apply right away
+	}
+
+	void shutdown () {
+		stop_dir_index_revalidation();
+		dir_watcher.stop();
+		tex_streamer.stop_uploader();
+
+		if (viewed_dir && dir_index_dirty)
+			write_dir_index(*viewed_dir);
+
+		if (image_index.dirty)
+			image_index.write(IMAGE_INDEX_FILE);
+	}
+
+	Image_Index					image_index;
+
+	// entries whose file was changed since it was indexed are left out, checking the few results is cheaper than keeping the whole index up to date
+	bool is_index_entry_current (u32 i) {
+		return get_file_mtime(image_index.get_path(i)) == image_index.mtimes[i];
+	}
+
+	// find similar images and duplicates with the signatures the loader computed for every image it decoded (see image_index.hpp)
+	void image_index_gui () {
+		if (!ImGui::CollapsingHeader("image_index"))
+			return;
+
+		static constexpr int MAX_SHOWN = 100;
+
+		ImGui::Text("indexed images: %u", image_index.size());
+		ImGui::Value_Bytes("memory", image_index.get_memory_size());
+
+		static int similar_max_distance = 10;
+		static std::vector<Image_Index::Match> similar;
+		static string similar_to;
+		static flt similar_ms = 0;
+
+		ImGui::SliderInt("similar_max_distance", &similar_max_distance, 0, 32);
+
+		cstr selected = viewed_dir && image_window_entry != Content_Model::NO_ENTRY ? viewed_dir->get_path(image_window_entry) : nullptr;
+		u32 selected_i = selected ? image_index.find(selected) : Image_Index::NO_ENTRY;
+
+		if (!selected) {
+			ImGui::Text("click an image to find similar ones");
+		} else if (selected_i == Image_Index::NO_ENTRY) {
+			ImGui::Text("not indexed yet, images are indexed when they are loaded");
+		} else if (ImGui::Button("Find similar to selected")) {
+			auto t_begin = std::chrono::steady_clock::now();
+			similar = image_index.find_similar(selected_i, similar_max_distance);
+			similar_ms = (flt)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -t_begin).count() / 1000;
+			similar_to = selected;
+
+			// the best MAX_SHOWN current ones, stale entries do not take up the places of valid matches
+			int kept = 0;
+			for (int i=0; i<(int)similar.size() && kept < MAX_SHOWN; ++i) {
+				if (is_index_entry_current(similar[i].entry))
+					similar[kept++] = similar[i];
+			}
+			similar.resize(kept);
+		}
+
+		if (similar_to.size() > 0 && ImGui::TreeNode(prints("similar to %s (%.3f ms)###similar", similar_to.c_str(), similar_ms).c_str())) {
+			for (auto& m : similar)
+				ImGui::Text("%2d %3d  %s", m.distance, m.histogram_distance, image_index.get_path(m.entry));
+			ImGui::TreePop();
+		}
+
+		static int duplicates_max_distance = 2;
+		static std::vector<std::vector<u32>> duplicates;
+		static flt duplicates_ms = 0;
+
+		ImGui::SliderInt("duplicates_max_distance", &duplicates_max_distance, 0, 3);
+
+		if (ImGui::Button("Find duplicates")) {
+			auto t_begin = std::chrono::steady_clock::now();
+			duplicates = image_index.find_duplicates(duplicates_max_distance);
+			duplicates_ms = (flt)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -t_begin).count() / 1000;
+
+			// same for the groups, a group that is left with less than 2 current entries is not a group anymore
+			int kept = 0;
+			for (int i=0; i<(int)duplicates.size() && kept < MAX_SHOWN; ++i) {
+				auto& g = duplicates[i];
+				g.erase(std::remove_if(g.begin(), g.end(), [&] (u32 e) { return !is_index_entry_current(e); }), g.end());
+				if (g.size() < 2)
+					continue;
+				if (kept != i)
+					duplicates[kept] = std::move(g);
+				kept++;
+			}
+			duplicates.resize(kept);
+		}
+
+		if (ImGui::TreeNode(prints("duplicate groups: %d (%.3f ms)###duplicates", (int)duplicates.size(), duplicates_ms).c_str())) {
+			for (auto& g : duplicates) {
+				for (u32 i : g)
+					ImGui::Text("%s", image_index.get_path(i));
+				ImGui::Separator();
+			}
+			ImGui::TreePop();
 		}
 	}
 
 	Texture_Streamer			tex_streamer;
-	unique_ptr<Directory_Tree>	viewed_dir = nullptr;
+	unique_ptr<Content_Model>	viewed_dir = nullptr;
+	Content_View				content_view; // order of the entries in the grid
+
+	bool						image_window_open = false;
+	u32							image_window_entry = Content_Model::NO_ENTRY; // entry of viewed_dir that was clicked
 
 	void init () {
 		glfwSwapInterval(swap_interval);
@@ -217,7 +554,19 @@ struct App {
 		tex_file_icon_GIF =		make_unique<Texture2D>( simple_load_texture("assets_src/file_icon_GIF.png") );
 		tex_file_icon_mp4 =		make_unique<Texture2D>( simple_load_texture("assets_src/file_icon_mp4.png") );
 
+		tex_white = make_unique<Texture2D>(Texture2D::generate());
+		rgba8 white = rgba8(255);
+		tex_white->upload(&white, 1);
+		tex_white->set_filtering_nearest();
+
 		tex_streamer.init_thread_pool();
+		tex_streamer.init_texture_compression();
+		tex_streamer.init_uploader(disp.window);
+
+		image_index.read(IMAGE_INDEX_FILE);
+		tex_streamer.image_index = &image_index;
+
+		register_video_thumbnail_providers();
 	}
 
 	void gui () {
@@ -247,6 +596,10 @@ struct App {
 		
 		bool trigger_load = ImGui::Button("Trigger Directory Load") || frame_i == 0;
 
+		static bool use_dir_index = true; // show the snapshot of the last scan right away and revalidate it in the background, instead of scanning before showing anything
+		ImGui::SameLine();
+		ImGui::Checkbox("use_dir_index", &use_dir_index);
+
 		static string load_msg = "<not loaded yet>";
 		static bool load_ok = false;
 
@@ -254,7 +607,20 @@ struct App {
 			load_ok = false;
 			
 			//tex_streamer.clear();
+			stop_dir_index_revalidation();
+			if (viewed_dir && dir_index_dirty)
+				write_dir_index(*viewed_dir);
+
+			content_view.invalidate();
 			viewed_dir = nullptr;
+			image_window_entry = Content_Model::NO_ENTRY;
+			dir_index_dirty = false;
+
+			dir_watcher.stop();
+			pending_dir_changes.clear();
+			dir_changes_lost = false;
+
+			auto t_begin = std::chrono::steady_clock::now();
 			
 			try {
 				auto fix_dir_path = [&] (string dir) -> string {
@@ -270,12 +636,27 @@ struct App {
 
 				string viewed_dir_path = fix_dir_path(viewed_dir_path_input_text);
 
-				auto new_dir = find_files_recursive(viewed_dir_path);
-				
-				viewed_dir = make_unique<Directory_Tree>();
-				viewed_dir->name = viewed_dir_path;
+				if (use_dir_index)
+					viewed_dir = read_dir_index(viewed_dir_path);
 
-				_populate(viewed_dir.get(), new_dir, viewed_dir->name);
+				if (viewed_dir) {
+					start_dir_index_revalidation();
+				} else {
+					u64 root_mtime = get_file_mtime(viewed_dir_path); // before listing, so changes during the scan are found by the next revalidation
+					auto new_dir = find_files_recursive(viewed_dir_path);
+					
+					viewed_dir = make_unique<Content_Model>();
+					u32 root = viewed_dir->add_entry(FT_DIRECTORY, viewed_dir_path, 0, 0, root_mtime);
+
+					_populate(viewed_dir.get(), root, new_dir, viewed_dir_path);
+					viewed_dir->shrink_to_fit();
+
+					write_dir_index(*viewed_dir);
+				}
+
+				dir_watcher.start(viewed_dir_path);
+
+				dir_load_ms = (flt)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -t_begin).count() / 1000;
 
 				load_ok = true;
 
@@ -290,10 +671,50 @@ struct App {
 
 		ImGui::SameLine();
 		ImGui::TextColored(load_ok ? col_ok : col_err, load_ok ? "OK" : load_msg.c_str());
+
+		ImGui::Value("dir_load_ms", dir_load_ms);
+		ImGui::Value("revalidating dir index", dir_index_thread.joinable());
+		ImGui::Value("dir_revalidate_ms", dir_revalidate_ms);
+		ImGui::Value("watching for changes", dir_watcher.is_watching());
+		ImGui::Value("changes applied", dir_changes_applied);
 	
 	}
 
-	void file_grid (Directory_Tree* dir, int left_bar_size, iv2 mouse_pos_px) {
+	// filter and sort of the grid, after anything that replaces viewed_dir this frame, so the grid never indexes with entries of the old one
+	void content_view_gui () {
+		static View_Query query;
+
+		if (ImGui::CollapsingHeader("filter_sort", ImGuiTreeNodeFlags_DefaultOpen)) {
+			ImGui::InputText_str("filter", &query.pattern);
+
+			int filter = query.filter;
+			ImGui::Combo("filter_mode", &filter, view_filter_e_str, ARRLEN(view_filter_e_str));
+			query.filter = (view_filter_e)filter;
+
+			int sort = query.sort;
+			ImGui::Combo("sort", &sort, view_sort_e_str, ARRLEN(view_sort_e_str));
+			query.sort = (view_sort_e)sort;
+
+			ImGui::SameLine();
+			ImGui::Checkbox("descending", &query.descending);
+
+			if (content_view.shown.error.size() > 0)
+				ImGui::TextColored(ImVec4(1,0,0,1), "%s", content_view.shown.error.c_str());
+		}
+
+		content_view.update(viewed_dir.get(), query);
+
+		if (ImGui::TreeNode("filter_sort_stats")) {
+			ImGui::Text("shown: %u / %u", (u32)content_view.shown.entries.size(), content_view.shown.total);
+			ImGui::Value("busy", content_view.busy);
+			ImGui::Value("sort_ms", content_view.shown.sort_ms);
+			ImGui::Value("filter_ms", content_view.shown.filter_ms);
+			ImGui::Value("narrowed", content_view.shown.narrowed);
+			ImGui::TreePop();
+		}
+	}
+
+	void file_grid (Content_Model* dir, int left_bar_size, iv2 mouse_pos_px) {
 		static flt zoom_multiplier_target = 1 ? 0.1f : 1;
 		static flt zoom_multiplier = zoom_multiplier_target;
 
@@ -347,9 +768,16 @@ struct App {
 
 		static flt loading_icon_sz = 0.25f;
 		static flt loading_icon_alpha = 0.5f;
+
+		static bool draw_placeholders = true; // image cells without pixels yet: average color (or placeholder_col before the first decode) at the aspect of the image, instead of the file icon
+		static v3 placeholder_col = v3(0.15f);
 		
 		static bool draw_offscreen_images = false;
+		static bool draw_tile_outlines = false;
 		static flt image_priority_cutoff = 600;
+		static int visible_entries = 0; // entries looked at last frame
+		static u64 grid_loop_allocs = 0; // heap allocations of the loop over the entries last frame, should be 0 unless new textures were added
+		static flt auto_scroll = 0; // rows per second, to keep the streamer busy without a hand on the mouse (see Rewrite_Stress_Test)
 		
 		if (ImGui::CollapsingHeader("file_grid", ImGuiTreeNodeFlags_DefaultOpen)) {
 			
@@ -377,13 +805,28 @@ struct App {
 			ImGui::DragFloat("loading_icon_sz", &loading_icon_sz, 0.01f);
 			ImGui::DragFloat("loading_icon_alpha", &loading_icon_alpha, 0.01f);
 
+			ImGui::Checkbox("draw_placeholders", &draw_placeholders);
+			ImGui::SameLine();
+			ImGui::ColorEdit3("placeholder_col", &placeholder_col.x, ImGuiColorEditFlags_NoInputs);
+
 
 			IMGUI_SAVEABLE(		"debug_view_size_multiplier", &debug_view_size_multiplier);
 			ImGui::DragFloat(	"debug_view_size_multiplier", &debug_view_size_multiplier, 1.0f/300, 0.01f);
 
 			ImGui::Checkbox("draw_offscreen_images", &draw_offscreen_images);
+			ImGui::Checkbox("draw_tile_outlines", &draw_tile_outlines);
 
 			ImGui::DragFloat("image_priority_cutoff", &image_priority_cutoff);
+			ImGui::Value("visible_entries", visible_entries);
+			ImGui::Text("grid_loop_allocs: %llu", (unsigned long long)grid_loop_allocs);
+
+			ImGui::DragFloat("auto_scroll", &auto_scroll, 0.05f);
+		}
+
+		if (auto_scroll != 0 && dir) { // wraps around at the end of the directory
+			flt rows = max(ceil((flt)content_view.shown.entries.size() / grid_sz_cells.x), 1.0f);
+			flt wraps;
+			view_coord.y = mod_range(view_coord.y +auto_scroll * ImGui::GetIO().DeltaTime, 0, rows, &wraps);
 		}
 
 		v2 mouse_coord;
@@ -424,12 +867,24 @@ struct App {
 		}
 		*/
 
-		static bool image_window_open = false;
-		static string image_window_img;
 		if (!image_window_open)
-			image_window_img = "<null>";
+			image_window_entry = Content_Model::NO_ENTRY;
 		
-		for (int content_i=0; content_i<(dir ? (int)dir->content.size() : 0); content_i++) {
+		std::vector<u32> const& entries = content_view.shown.entries; // filtered and sorted entries of the root
+
+		// only the entries that can be onscreen or prefetched, so the cost per frame does not depend on the size of the directory
+		Index_Range visible = { 0, (u32)entries.size() };
+		if (!draw_offscreen_images) {
+			flt max_dist_rows = max(grid_sz_cells.y/2 +0.5f, calc_image_priority_max_dist(image_priority_cutoff) * length(grid_sz_cells/2));
+			visible = calc_grid_entry_range((u32)entries.size(), dragged_view_coord, grid_sz_cells, max_dist_rows);
+		}
+		visible_entries = (int)visible.size();
+
+		u64 allocs_before = thread_alloc_count;
+
+		for (int content_i=(int)visible.begin; content_i<(int)visible.end; content_i++) {
+			u32 entry = entries[content_i];
+
 			auto img_instance = [&] (v2 pos_center_rel, flt alpha, bool is_original_instance) {
 				bool onscreen =	pos_center_rel.y >= -grid_sz_cells.y/2 -0.5f &&
 									pos_center_rel.y <= +grid_sz_cells.y/2 +0.5f;
@@ -439,14 +894,14 @@ struct App {
 				{
 					flt d = length(pos_center_rel) / length(grid_sz_cells/2); // normalized_dist_to_center_of_grid 0 = center 1 = ~corner of screen
 
-					image_priority = d <= 1 ? d : d +powf(2, 6 * (d -1));
+					image_priority = calc_image_priority(d);
 
 					still_query_textures = image_priority <= image_priority_cutoff;
 				}
 
-				auto* c = dir->content[content_i];
+				filetype_e type = dir->get_type(entry);
 
-				if (!(onscreen || draw_offscreen_images || (still_query_textures && c->type() == FT_IMAGE_FILE)))
+				if (!(onscreen || draw_offscreen_images || (still_query_textures && type == FT_IMAGE_FILE)))
 					return;
 
 				v2 pos_center_rel_px = pos_center_rel * cell_sz;
@@ -458,23 +913,65 @@ struct App {
 					v2 aspect = img_full_size / max(img_full_size.x, img_full_size.y);
 					return (v2)cell_sz * aspect -border_px*2;
 				};
-				auto draw_texture_centered_in_cell = [&] (Texture2D const& tex, iv2 img_size_px, flt alpha) {
-					v2 img_onscreen_sz_px = get_texture_centered_in_cell_onscreen_size(img_size_px);
-
+				auto get_texture_centered_in_cell_onscreen_pos = [&] (v2 img_onscreen_sz_px) {
 					v2 offs_to_center_px = (cell_sz -img_onscreen_sz_px) / 2;
 
 					v2 pos_px = view_center +pos_center_rel_px -cell_sz / 2;
-					pos_px += offs_to_center_px;
+					return pos_px +offs_to_center_px;
+				};
+				auto draw_texture_centered_in_cell = [&] (Texture2D const& tex, iv2 img_size_px, flt alpha) {
+					v2 img_onscreen_sz_px = get_texture_centered_in_cell_onscreen_size(img_size_px);
+					v2 pos_px = get_texture_centered_in_cell_onscreen_pos(img_onscreen_sz_px);
 
 					draw_textured_quad(pos_px, img_onscreen_sz_px, tex, rgba8(255,255,255, (u8)(alpha * 255 +0.5f)));
 				};
+				auto highlight_cell = [&] (bool debug_is_highlighted) {
+					v2 rect_l = view_center +pos_center_rel_px -cell_sz/2;
+					v2 rect_h = view_center +pos_center_rel_px +cell_sz/2;
+					
+					bool highlight = debug_is_highlighted;
+					
+					v2 mouse = (v2)mouse_pos_px +0.5f;
+
+					if (all(mouse >= rect_l && mouse <= rect_h)) {
+						highlight = true;
+						if (lmb.went_down) {
+							image_window_open = true;
+							image_window_entry = entry;
+						}
+					}
+					highlight = highlight || image_window_entry == entry;
+					
+					if (highlight)
+						emit_overlay_rect_outline(rect_l,rect_h, rgba8(0,255,0,255));
+				};
+				// the cell looks like the image will from the first frame on, from the metadata in the Content_Model only, no texture memory per image
+				auto draw_placeholder = [&] (iv2 img_size_px) {
+					if (!draw_placeholders) {
+						Texture2D* tex = tex_file_icon.get();
+						draw_texture_centered_in_cell(*tex, tex->get_size_px(), alpha * file_icon_alpha);
+						return;
+					}
+
+					rgba8 col = dir->avg_cols[entry];
+					if (col.w == 0)
+						col = rgba8((u8)(placeholder_col.x * 255 +0.5f), (u8)(placeholder_col.y * 255 +0.5f), (u8)(placeholder_col.z * 255 +0.5f), 255);
+					col.w = (u8)(alpha * 255 +0.5f);
+
+					v2 img_onscreen_sz_px = get_texture_centered_in_cell_onscreen_size(img_size_px);
+					draw_textured_quad(get_texture_centered_in_cell_onscreen_pos(img_onscreen_sz_px), img_onscreen_sz_px, *tex_white, col);
+				};
+				auto draw_loading_icon = [&] () {
+					v2 pos_px = view_center +pos_center_rel_px +cell_sz * (-0.5f +(1 -loading_icon_sz));
+					draw_textured_quad(pos_px, cell_sz * loading_icon_sz, *tex_loading_icon.get(), rgba8(255,255,255, (int)(alpha * loading_icon_alpha * 255.0f +0.5f)));
+				};
 
 				/*
 				if (list_files)
 					ImGui::PushID(content_i);
 				*/
 
-				switch (c->type()) {
+				switch (type) {
 					case FT_DIRECTORY: {
 
 						Texture2D* tex = tex_folder_icon.get();
@@ -493,28 +990,10 @@ struct App {
 						
 						Texture2D* tex;
 						
-						auto find_file_ext = [] (string const& filepath) {
-							auto dot = filepath.find_last_of(".");
-							
-							string ext = "";
-							
-							if (dot != string::npos) {
-								for (size_t i=dot+1; i<filepath.size(); ++i) {
-									ext.push_back( to_lower(filepath[i]) );
-								}
-							}
-
-							return ext;
-						};
-						
-						string file_ext = find_file_ext(c->name);
-						
-						if (		file_ext.compare("gif") == 0 ) {
-							tex = tex_file_icon_GIF.get();
-						} else if (	file_ext.compare("mp4") == 0 ) {
-							tex = tex_file_icon_mp4.get();
-						} else {
-							tex = tex_file_icon.get();
+						switch (dir->exts[entry]) {
+							case EXT_GIF:	tex = tex_file_icon_GIF.get();	break;
+							case EXT_MP4:	tex = tex_file_icon_mp4.get();	break;
+							default:		tex = tex_file_icon.get();
 						}
 
 						draw_texture_centered_in_cell(*tex, tex->get_size_px(), alpha * file_icon_alpha);
@@ -529,54 +1008,88 @@ struct App {
 					} break;
 
 					case FT_IMAGE_FILE: {
-						auto* img = (Image_File*)c;
+						cstr filepath = dir->get_path(entry);
+						iv2 size_px = dir->sizes_px[entry];
 
-						iv2 onscreen_size_px = get_texture_centered_in_cell_onscreen_size(img->size_px);
+						iv2 onscreen_size_px = get_texture_centered_in_cell_onscreen_size(size_px);
 						if (any(onscreen_size_px <= 0))
 							break;
 
-						auto* tex = tex_streamer.query(img->filepath, onscreen_size_px, img->size_px, image_priority);
+						if (tex_streamer.is_tiled(size_px)) {
+							// only the tiles inside the view get loaded, so zooming into huge images costs memory proportional to the screen size
+							v2 onscreen_sz = get_texture_centered_in_cell_onscreen_size(size_px);
+							v2 onscreen_pos = get_texture_centered_in_cell_onscreen_pos(onscreen_sz);
+
+							v2 view_lo = view_center -grid_sz_px/2;
+							v2 view_hi = view_center +grid_sz_px/2;
+
+							auto* tiled = tex_streamer.query_tiled(filepath, &dir->tex_handles[entry], size_px, onscreen_pos, onscreen_sz, view_lo, view_hi, image_priority);
+
+							if (!(onscreen || draw_offscreen_images))
+								return;
+
+							highlight_cell(false);
+
+							if (tiled->resident_tiles == 0)
+								draw_placeholder(size_px);
+
+							tiled->foreach_drawable_tile(onscreen_pos, onscreen_sz, view_lo, view_hi,
+								[&] (Texture2D const& tex, v2 pos_px, v2 size_px, v2 uv_lo, v2 uv_hi) {
+									draw_textured_quad(pos_px, size_px, tex, rgba8(255,255,255, (u8)(alpha * 255 +0.5f)), uv_lo, uv_hi);
+									if (draw_tile_outlines)
+										emit_overlay_rect_outline(pos_px, pos_px +size_px, rgba8(255,255,0,255));
+								});
+
+							if (!tiled->all_visible_tiles_resident)
+								draw_loading_icon();
+							break;
+						}
+
+						auto* tex = tex_streamer.query(filepath, &dir->tex_handles[entry], onscreen_size_px, size_px, image_priority);
+
+						// the loader found another resolution in the file than it had when it was probed, the cell has the new aspect from the next frame on
+						if (!all(tex->get_full_size_px() == size_px)) {
+							dir->sizes_px[entry] = tex->get_full_size_px();
+							dir_index_dirty = true;
+						}
+						// the placeholder for the next time the cell has no pixels, even after a restart (see dir_index.hpp)
+						if (tex->avg_col.w != 0 && !all(tex->avg_col == dir->avg_cols[entry])) {
+							dir->avg_cols[entry] = tex->avg_col;
+							dir_index_dirty = true;
+						}
 						
 						if (!(onscreen || draw_offscreen_images))
 							return;
 
-						{
-							v2 rect_l = view_center +pos_center_rel_px -cell_sz/2;
-							v2 rect_h = view_center +pos_center_rel_px +cell_sz/2;
-							
-							bool highlight = tex->debug_is_highlighted;
-							
-							v2 mouse = (v2)mouse_pos_px +0.5f;
-
-							if (all(mouse >= rect_l && mouse <= rect_h)) {
-								highlight = true;
-								if (lmb.went_down) {
-									image_window_open = true;
-									image_window_img = img->filepath;
-								}
-							}
-							highlight = highlight || image_window_img.compare(img->filepath) == 0;
-							
-							if (highlight)
-								emit_overlay_rect_outline(rect_l,rect_h, rgba8(0,255,0,255));
-						}
+						highlight_cell(tex->debug_is_highlighted);
 
 						bool image_fully_loaded = tex->all_mips_displayable();
 
 						flt px_dens = tex->get_displayable_pixel_density(onscreen_size_px);
-						if (px_dens == 0) {
 
-							Texture2D* tex = tex_file_icon.get();
-							draw_texture_centered_in_cell(*tex, tex->get_size_px(), alpha * file_icon_alpha);
+						if (onscreen)
+							tex_streamer.report_displayed(tex, px_dens);
+
+						// gifs play in visible cells that are big enough, until their first frames are decoded the still first frame is shown
+						Texture2D* gif_frame = nullptr;
+						if (onscreen && dir->exts[entry] == EXT_GIF)
+							gif_frame = tex_streamer.query_animated_gif(filepath, &dir->gif_handles[entry], size_px, onscreen_size_px, image_priority);
+
+						if (gif_frame) {
+
+							draw_texture_centered_in_cell(*gif_frame, size_px, alpha);
+
+						} else if (px_dens == 0) {
+
+							draw_placeholder(size_px);
 
 						} else {
 							
-							draw_texture_centered_in_cell(*tex->tex, img->size_px, alpha);
+							draw_texture_centered_in_cell(*tex->tex, size_px, alpha);
 						}
 
 						if (!image_fully_loaded && px_dens < 1) { // display_loading_icon if some mips of the texture are loaded, but the mip that is at least onscreen_size_px is not (ie. displayed pixel density < 1, ie. image is still blurry)
-							v2 pos_px = view_center +pos_center_rel_px +cell_sz * (-0.5f +(1 -loading_icon_sz));
-							draw_textured_quad(pos_px, cell_sz * loading_icon_sz, *tex_loading_icon.get(), rgba8(255,255,255, (int)(alpha * loading_icon_alpha * 255.0f +0.5f)));
+							draw_loading_icon();
 						}
 
 						/*
@@ -602,34 +1115,30 @@ struct App {
 				*/
 			};
 
-			flt rel_indx = (flt)content_i -dragged_view_coord.x;
+			auto cell = calc_grid_cell(content_i, dragged_view_coord, grid_sz_cells);
 
-			flt quotient;
-			flt remainder = mod_range(rel_indx, -grid_sz_cells.x/2, +grid_sz_cells.x/2, &quotient);
+			assert((cell.out_of_bounds_l +cell.out_of_bounds_r) <= 1);
+			img_instance(cell.pos_center_rel, content_i == (int)roundf(dragged_view_coord.x) ? 1 : 1 -cell.out_of_bounds_l -cell.out_of_bounds_r, true);
 
-			flt out_of_bounds_l = max(-(remainder -0.5f +grid_sz_cells.x/2), 0.0f);
-			flt out_of_bounds_r = max(  remainder +0.5f -grid_sz_cells.x/2 , 0.0f);
-			
-			v2 pos_center_rel = v2(remainder,quotient -dragged_view_coord.y);
-
-			assert((out_of_bounds_l +out_of_bounds_r) <= 1);
-			img_instance(pos_center_rel, content_i == (int)roundf(dragged_view_coord.x) ? 1 : 1 -out_of_bounds_l -out_of_bounds_r, true);
-
-			if (out_of_bounds_l > 0) {
-				img_instance((pos_center_rel -v2(-grid_sz_cells.x,1)), out_of_bounds_l, false);
+			if (cell.out_of_bounds_l > 0) {
+				img_instance((cell.pos_center_rel -v2(-grid_sz_cells.x,1)), cell.out_of_bounds_l, false);
 			}
-			if (out_of_bounds_r > 0) {
-				img_instance((pos_center_rel +v2(-grid_sz_cells.x,1)), out_of_bounds_r, false);
+			if (cell.out_of_bounds_r > 0) {
+				img_instance((cell.pos_center_rel +v2(-grid_sz_cells.x,1)), cell.out_of_bounds_r, false);
 			}
 
 		}
 		
+		grid_loop_allocs = thread_alloc_count -allocs_before;
+
 		tex_streamer.queries_end();
 
 		if (image_window_open) {
-			if (ImGui::Begin(prints("Image: %s###image_window", image_window_img.c_str()).c_str(), &image_window_open)) {
+			cstr filepath = image_window_entry != Content_Model::NO_ENTRY ? dir->get_path(image_window_entry) : "<null>";
+
+			if (ImGui::Begin(prints("Image: %s###image_window", filepath).c_str(), &image_window_open)) {
 				
-				tex_streamer.imgui_texture_info(image_window_img);
+				tex_streamer.imgui_texture_info(filepath);
 			}
 			ImGui::End();
 		}
@@ -645,6 +1154,10 @@ struct App {
 
 	std::vector<Triangle> overlay_tris;
 
+	// swap to swap, one per upload mode so toggling async_uploads while scrolling through a big directory compares them
+	Sample_Histogram frame_times_async = Sample_Histogram("frame time (async uploads)");
+	Sample_Histogram frame_times_sync = Sample_Histogram("frame time (main thread uploads)");
+
 	void emit_overlay_rect_outline (v2 A, v2 B, rgba8 col) {
 		v2 a = A;
 		v2 b = v2(B.x,A.y);
@@ -675,7 +1188,7 @@ struct App {
 
 	bool draw_wireframe = false;
 
-	void draw_textured_quad (v2 pos_px, v2 sz_px, Texture2D const& tex, rgba8 col=rgba8(255)) {
+	void draw_textured_quad (v2 pos_px, v2 sz_px, Texture2D const& tex, rgba8 col=rgba8(255), v2 uv_lo=0, v2 uv_hi=1) { // uv rect top-down
 
 		struct Textured_Vertex {
 			v2		pos_screen;
@@ -689,8 +1202,10 @@ struct App {
 		
 		vbo_data.clear();
 		
-		for (v2 p : { v2(1,0),v2(1,1),v2(0,0), v2(0,0),v2(1,1),v2(0,1) })
-			vbo_data.emplace_back( pos_px +sz_px * p, v2(p.x, 1 -p.y), col ); // flip uv, since we send positions as top-down in the gui code
+		for (v2 p : { v2(1,0),v2(1,1),v2(0,0), v2(0,0),v2(1,1),v2(0,1) }) {
+			v2 uv = lerp(uv_lo, uv_hi, p);
+			vbo_data.emplace_back( pos_px +sz_px * p, v2(uv.x, 1 -uv.y), col ); // flip uv, since we send positions as top-down in the gui code
+		}
 		
 		static GLuint vbo = [] () {
 			GLuint vbo;
@@ -829,6 +1344,31 @@ struct App {
 
 		ImGui::Checkbox("draw_wireframe", &draw_wireframe);
 
+		// frame pacing, should not get worse while many textures are uploaded (see texture_uploader.hpp)
+		if (ImGui::TreeNode("frame_times")) {
+			ImGui::Checkbox("async_uploads", &tex_streamer.async_uploads);
+			ImGui::SameLine();
+			if (ImGui::Button("Reset")) {
+				frame_times_async.clear();
+				frame_times_sync.clear();
+			}
+			frame_times_async.imgui();
+			frame_times_sync.imgui();
+			ImGui::TreePop();
+		}
+
+		{
+			bool enabled = tracer.enabled;
+			ImGui::Checkbox("tracing", &enabled);
+			tracer.enabled = enabled;
+
+			ImGui::SameLine();
+			if (ImGui::Button("Dump trace (F12)") || do_dump_trace) {
+				if (!tracer.dump_chrome_trace("trace.json"))
+					fprintf(stderr, "Could not write trace.json\n");
+			}
+		}
+
 		{
 			auto tmp = ImGui::GetWindowSize();
 			imgui_left_bar_size = (iv2)v2(tmp.x,tmp.y);
@@ -836,10 +1376,16 @@ struct App {
 
 		
 		gui();
+		poll_dir_index_revalidation();
+		apply_dir_changes();
+		content_view_gui();
 		file_grid(viewed_dir.get(), imgui_left_bar_size.x, mouse_pos_px);
+		image_index_gui();
 		
 		//gui_file_tree(viewed_dir.get());
 
+		benchmarks_gui();
+
 		ImGui::Separator();
 
 		{
@@ -855,7 +1401,8 @@ struct App {
 	}
 	
 	bool frame () {
-		
+		TRACE_SCOPE("frame");
+
 		overlay_tris.clear();
 
 		iv2 mouse_pos_px;
@@ -888,15 +1435,23 @@ struct App {
 		glClearColor(0,0,0,1);
 		glClear(GL_COLOR_BUFFER_BIT);
 
+		u64 phase_begin_ns = tracer.get_time_ns();
+
 		render_all(mouse_pos_px);
 
+		tracer.phase("render_all", &phase_begin_ns);
+
 		draw_triangles_solid(overlay_tris);
 
 		imgui_context.draw(disp.framebuffer_size_px);
 
+		tracer.phase("draw", &phase_begin_ns);
+
 		// display to screen
 		glfwSwapBuffers(disp.window);
 
+		tracer.phase("glfwSwapBuffers", &phase_begin_ns);
+
 		{
 			f64 now = glfwGetTime();
 			static f64 prev_frame_end = now;
@@ -905,6 +1460,11 @@ struct App {
 
 			prev_frame_end = now;
 
+			if (frame_i > 0) {
+				bool async = tex_streamer.uploads_async();
+				(async ? frame_times_async : frame_times_sync).add(dt * 1000);
+			}
+
 			//printf("%d dt: %f\n", frame_i, dt);
 		}
 
@@ -930,6 +1490,8 @@ void glfw_refresh_callback (GLFWwindow* window) { // refresh callback so window
 
 int main (int argc, char** argv) {
 	
+	tracer.set_thread_name("main");
+
 	init_engine();
 
 	glfwSetWindowRefreshCallback(disp.window, glfw_refresh_callback);
@@ -943,6 +1505,7 @@ int main (int argc, char** argv) {
 		
 		mouse_wheel_diff = 0;
 		do_toggle_fullscreen = false;
+		do_dump_trace = false;
 
 		glfwPollEvents(); // calls async input callbacks and glfw_refresh_callback ()
 		
@@ -954,8 +1517,13 @@ int main (int argc, char** argv) {
 		glfw_refresh_callback_called_inside_frame_call = false;
 	}
 
+	app.shutdown();
+
 	disp.save_window_positioning();
 
+	if (tracer.enabled && !tracer.dump_chrome_trace("trace.json"))
+		fprintf(stderr, "Could not write trace.json\n");
+
 	glfwDestroyWindow(disp.window);
 	glfwTerminate();
 
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+#include "basic_typedefs.hpp"
+
+// Bounded lock-free multiple producer single consumer queue
+// based on Dmitry Vyukov's bounded MPMC queue (http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue), but with only one consumer the dequeue side needs no atomics
+// every slot stores its element inline, so there are no per-item heap allocations (other than what T itself allocates), T only needs to be default constructible and movable
+// push spins (yielding) while the ring is full, which acts as backpressure on the producers, until stop_all is called (then elements that do not fit are dropped)
+template <typename T, u32 CAPACITY=256>
+class Mpsc_Ring {
+	static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY -1)) == 0, "CAPACITY needs to be a power of two");
+public:
+
+	Mpsc_Ring () {
+		for (u32 i=0; i<CAPACITY; ++i)
+			slots[i].seq.store(i, std::memory_order_relaxed);
+	}
+
+	// can be called from multiple threads, false if the element was dropped because the ring was full after stop_all
+	bool push (T elem) {
+		while (!try_push(elem)) {
+			if (stop.load(std::memory_order_acquire))
+				return false; // consumer no longer drains, spinning would block forever
+			std::this_thread::yield();
+		}
+		return true;
+	}
+
+	// the consumer stops draining (shutdown), producers blocked on a full ring return from push
+	void stop_all () {
+		stop.store(true, std::memory_order_release);
+	}
+
+	// elem is only moved from if the push succeeded
+	bool try_push (T& elem) {
+		u64 pos = enqueue_pos.load(std::memory_order_relaxed);
+		for (;;) {
+			Slot& s = slots[pos & (CAPACITY -1)];
+			u64 seq = s.seq.load(std::memory_order_acquire);
+			s64 diff = (s64)seq -(s64)pos;
+
+			if (diff == 0) {
+				// slot is free for this position, try to claim it
+				if (enqueue_pos.compare_exchange_weak(pos, pos +1, std::memory_order_relaxed)) {
+					s.val = std::move(elem);
+					s.seq.store(pos +1, std::memory_order_release); // publish to consumer
+					return true;
+				}
+				// pos was updated by compare_exchange_weak, retry
+			} else if (diff < 0) {
+				return false; // full, the consumer has not freed this slot yet
+			} else {
+				pos = enqueue_pos.load(std::memory_order_relaxed); // another producer claimed this slot, retry with the new position
+			}
+		}
+	}
+
+	// deque one element if there is one, must only be called from one thread (the single consumer)
+	bool try_pop (T* out) {
+		Slot& s = slots[dequeue_pos & (CAPACITY -1)];
+		u64 seq = s.seq.load(std::memory_order_acquire);
+
+		if ((s64)seq -(s64)(dequeue_pos +1) < 0)
+			return false; // empty (or the producer that claimed this slot has not finished writing yet)
+
+		*out = std::move(s.val);
+		s.seq.store(dequeue_pos +CAPACITY, std::memory_order_release); // free the slot for the producers one lap later
+		dequeue_pos++;
+		return true;
+	}
+
+private:
+	struct alignas(64) Slot { // own cache line per slot to avoid false sharing between producers
+		std::atomic<u64>	seq;
+		T					val;
+	};
+
+	Slot					slots[CAPACITY];
+
+	alignas(64) std::atomic<u64>	enqueue_pos {0};
+	std::atomic<bool>				stop {false};
+	alignas(64) u64					dequeue_pos = 0;
+};
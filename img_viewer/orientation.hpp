@@ -0,0 +1,109 @@
+#pragma once
+
+#include "basic_typedefs.hpp"
+#include "vector_util.hpp"
+#include "colors.hpp"
+
+#include "image.hpp"
+
+/* Image orientation (the EXIF orientation tag, see find_exif_orientation)
+	Cameras store the pixels in sensor orientation and only tag how they should be displayed, phones held upright store ORIENT_ROT_90_CW
+	Instead of rotating the decoded image in a separate pass, the rows are written to their oriented position where they are stored anyway (see Mip_Stream),
+	for the transposing orientations in ORIENT_TILE x ORIENT_TILE tiles, so both the reads and the writes stay within a few cache lines
+*/
+
+enum orientation_e {
+	ORIENT_NORMAL=1,
+	ORIENT_MIRROR_X,
+	ORIENT_ROT_180,
+	ORIENT_MIRROR_Y,
+	ORIENT_TRANSPOSE,
+	ORIENT_ROT_90_CW,
+	ORIENT_TRANSVERSE,
+	ORIENT_ROT_90_CCW,
+};
+static cstr orientation_e_str[] = { "<invalid>", "ORIENT_NORMAL", "ORIENT_MIRROR_X", "ORIENT_ROT_180", "ORIENT_MIRROR_Y", "ORIENT_TRANSPOSE", "ORIENT_ROT_90_CW", "ORIENT_TRANSVERSE", "ORIENT_ROT_90_CCW" };
+
+constexpr int ORIENT_TILE = 16;
+
+bool is_transposed (orientation_e o) {
+	return o >= ORIENT_TRANSPOSE;
+}
+
+iv2 orient_size (iv2 size, orientation_e o) {
+	return is_transposed(o) ? iv2(size.y, size.x) : size;
+}
+
+// position of pixel p (top-down) of an image of src_size in the oriented image (top-down)
+iv2 orient_px (iv2 p, iv2 src_size, orientation_e o) {
+	iv2 m = src_size -1 -p; // mirrored
+	switch (o) {
+		case ORIENT_MIRROR_X:		return iv2(m.x, p.y);
+		case ORIENT_ROT_180:		return m;
+		case ORIENT_MIRROR_Y:		return iv2(p.x, m.y);
+		case ORIENT_TRANSPOSE:		return iv2(p.y, p.x);
+		case ORIENT_ROT_90_CW:		return iv2(m.y, p.x);
+		case ORIENT_TRANSVERSE:		return iv2(m.y, m.x);
+		case ORIENT_ROT_90_CCW:		return iv2(p.y, m.x);
+		default:					return p;
+	}
+}
+
+// every orientation is its own inverse except for the 90 degree rotations
+orientation_e inverse_orientation (orientation_e o) {
+	switch (o) {
+		case ORIENT_ROT_90_CW:		return ORIENT_ROT_90_CCW;
+		case ORIENT_ROT_90_CCW:		return ORIENT_ROT_90_CW;
+		default:					return o;
+	}
+}
+
+// rect [lo,hi) of the oriented image (top-down) to the rect of the source image it comes from
+void unorient_rect (iv2 lo, iv2 hi, iv2 src_size, orientation_e o, iv2* src_lo, iv2* src_hi) {
+	iv2 a = orient_px(lo, orient_size(src_size, o), inverse_orientation(o));
+	iv2 b = orient_px(hi -1, orient_size(src_size, o), inverse_orientation(o));
+	*src_lo = min(a, b);
+	*src_hi = max(a, b) +1;
+}
+
+// write rows [y0, y0 +count) (top-down) of an image of src_size to their oriented position in dst (bottom-up like all our images, of the oriented size)
+// row i is at first_row + i * stride (stride is negative for bottom-up sources)
+void write_rows_oriented (rgba8 const* first_row, sptr stride, int y0, int count, iv2 src_size, orientation_e o, Image2D* dst) {
+	// the mapping is affine, so the dst index of (x,y) is index(0,y) + x * step
+	auto index = [&] (iv2 d) { return (sptr)(dst->size.y -1 -d.y) * dst->size.x +d.x; };
+	sptr step = index(orient_px(iv2(1,0), src_size, o)) -index(orient_px(iv2(0,0), src_size, o));
+
+	if (step == 1) { // not mirrored in x and not transposed: whole rows
+		for (int y=0; y<count; ++y)
+			memcpy(&dst->pixels[index(orient_px(iv2(0, y0 +y), src_size, o))], first_row +y * stride, src_size.x * sizeof(rgba8));
+		return;
+	}
+
+	for (int ty=0; ty<count; ty += ORIENT_TILE) {
+		int ty1 = min(ty +ORIENT_TILE, count);
+
+		for (int tx=0; tx<src_size.x; tx += ORIENT_TILE) {
+			int tx1 = min(tx +ORIENT_TILE, src_size.x);
+
+			for (int y=ty; y<ty1; ++y) {
+				rgba8 const* row = first_row +y * stride;
+				rgba8* out = &dst->pixels[index(orient_px(iv2(0, y0 +y), src_size, o))];
+
+				for (int x=tx; x<tx1; ++x)
+					out[x * step] = row[x];
+			}
+		}
+	}
+}
+
+// oriented copy of a whole image, bottom-up like all our images, src can be top-down (see Image2D::decode_from_memory_top_down), the flip is free
+Image2D orient_image (Image2D const& src, orientation_e o, bool src_top_down=false) {
+	TRACE_SCOPE("orient_image");
+
+	auto dst = Image2D::allocate(orient_size(src.size, o));
+	if (src_top_down)
+		write_rows_oriented(src.pixels, src.size.x, 0, src.size.y, src.size, o, &dst);
+	else
+		write_rows_oriented(&src.pixels[(uptr)(src.size.y -1) * src.size.x], -(sptr)src.size.x, 0, src.size.y, src.size, o, &dst);
+	return dst;
+}
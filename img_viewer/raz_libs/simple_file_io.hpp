@@ -3,6 +3,8 @@
 #include <string>
 using std::string;
 
+#include <vector>
+
 #include "stdio.h"
 
 #include "basic_typedefs.hpp"
@@ -25,6 +27,29 @@ bool load_text_file (string const& filepath, string* text) {
 	return true;
 }
 
+bool load_binary_file (string const& filepath, std::vector<byte>* data) {
+
+	FILE* f = fopen(filepath.c_str(), "rb");
+	if (!f)
+		return false;
+
+	fseek(f, 0, SEEK_END);
+	long filesize = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	if (filesize < 0) {
+		fclose(f);
+		return false;
+	}
+
+	data->resize((uptr)filesize);
+
+	uptr ret = fread(data->data(), 1,data->size(), f);
+	fclose(f);
+
+	return ret == (uptr)filesize;
+}
+
 bool load_fixed_size_binary_file (string const& filepath, void* data, uptr sz) {
 
 	FILE* f = fopen(filepath.c_str(), "rb");
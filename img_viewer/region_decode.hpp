@@ -0,0 +1,132 @@
+#pragma once
+
+#include <vector>
+
+#include "basic_typedefs.hpp"
+#include "vector_util.hpp"
+#include "colors.hpp"
+
+#include "stbi.hpp"
+#include "image.hpp"
+#include "orientation.hpp"
+#include "tracing.hpp"
+
+/* Decoding only a rect of an image, so tiles of huge images do not need the whole image decoded into memory
+	The decoders in stbi.cpp pass the rows of the rect top-down and we box filter them down by 2^scale on the fly,
+	so the memory needed is only the (downsampled) output plus a few rows in the decoder
+	Formats the region decoders can not do (progressive jpeg, interlaced png) fall back to decoding the whole image
+	Everything is in the oriented image, the rect is mapped to the file's orientation for decoding and the (small) downsampled region is oriented afterwards
+*/
+
+struct Image_Region {
+	Image2D		img; // bottom-up like all our images, size is ceil(rect_size / 2^scale)
+	iv2			full_size_px; // of the whole (oriented) image
+	iv2			lo_px; // rect that was actually decoded (after clamping) in px of the full image, top-down
+	iv2			hi_px;
+	int			scale; // img pixel (x,y) is the average of the full image pixels lo_px + (x,y) * 2^scale .. +2^scale
+};
+
+// averages blocks of 2^scale x 2^scale input pixels (smaller at the right and bottom edge), input rows come in top-down
+struct Row_Box_Filter {
+	Image2D*			dst;
+	int					scale;
+	int					width; // input width
+
+	std::vector<u32>	sums; // rgba per output pixel of the current output row
+	int					out_y = 0;
+	int					rows_in_sums = 0;
+
+	Row_Box_Filter (Image2D* dst, int scale, int width): dst{dst}, scale{scale}, width{width} {
+		sums.assign((uptr)dst->size.x * 4, 0);
+	}
+
+	void emit_row () {
+		rgba8* out = &dst->pixels[(uptr)(dst->size.y -1 -out_y) * dst->size.x]; // bottom-up
+
+		for (int x=0; x<dst->size.x; ++x) {
+			int cols = min(width -(x << scale), 1 << scale);
+			u32 count = (u32)(cols * rows_in_sums);
+
+			u32* s = &sums[x * 4];
+			for (int c=0; c<4; ++c)
+				out[x].arr[c] = (u8)((s[c] +count/2) / count);
+		}
+
+		std::fill(sums.begin(), sums.end(), 0);
+		rows_in_sums = 0;
+	}
+
+	void add_row (int y, rgba8 const* row) {
+		if (rows_in_sums > 0 && (y >> scale) != out_y)
+			emit_row();
+		out_y = y >> scale;
+
+		for (int x=0; x<width; ++x) {
+			u32* s = &sums[(x >> scale) * 4];
+			for (int c=0; c<4; ++c)
+				s[c] += row[x].arr[c];
+		}
+		rows_in_sums++;
+	}
+
+	void finish () {
+		if (rows_in_sums > 0)
+			emit_row();
+	}
+};
+
+// decode the rect [rect_lo, rect_hi) (px top-down, clamped to the image) of an image file, downsampled by 2^scale
+// with a mirroring orientation the partial 2^scale blocks end up at the low edge of the rect instead of the high one, which is less than one region pixel off
+Image_Region decode_region (std::vector<byte> const& file_data, strcr filepath, iv2 rect_lo, iv2 rect_hi, int scale, orientation_e orientation) {
+	TRACE_SCOPE("decode_region");
+
+	Image_Region r;
+
+	iv2 file_size;
+	int n;
+	if (!stbi_info_from_memory(file_data.data(), (int)file_data.size(), &file_size.x,&file_size.y, &n))
+		throw Expt_File_Load_Fail(filepath);
+
+	r.full_size_px = orient_size(file_size, orientation);
+	r.lo_px = clamp(rect_lo, 0, r.full_size_px);
+	r.hi_px = clamp(rect_hi, r.lo_px, r.full_size_px);
+	r.scale = scale;
+
+	if (any(r.hi_px -r.lo_px <= 0))
+		throw Expt_File_Load_Fail(filepath);
+
+	// rect in the file
+	iv2 lo, hi;
+	unorient_rect(r.lo_px, r.hi_px, file_size, orientation, &lo, &hi);
+	iv2 size = hi -lo;
+
+	Image2D img = Image2D::allocate((size +(1 << scale) -1) / (1 << scale));
+
+	Row_Box_Filter filter (&img, scale, size.x);
+
+	auto row_cb = [] (void* user, int y, stbi_uc const* rgba) {
+		((Row_Box_Filter*)user)->add_row(y, (rgba8 const*)rgba);
+	};
+
+	int res = stbi_decode_region(file_data.data(), (int)file_data.size(), lo.x,lo.y, hi.x,hi.y, row_cb, &filter);
+
+	if (res == STBI_REGION_UNSUPPORTED) {
+		auto full = Image2D::decode_from_memory_top_down(filepath, file_data);
+		if (!equal(full.size, file_size))
+			throw Expt_File_Load_Fail(filepath);
+
+		filter = Row_Box_Filter(&img, scale, size.x);
+		for (int y=lo.y; y<hi.y; ++y)
+			filter.add_row(y -lo.y, &full.pixels[(uptr)y * full.size.x +lo.x]);
+	} else if (res != STBI_REGION_OK) {
+		throw Expt_File_Load_Fail(filepath);
+	}
+
+	filter.finish();
+
+	r.img = orientation == ORIENT_NORMAL ? std::move(img) : orient_image(img, orientation);
+	return r;
+}
+Image_Region decode_region (strcr filepath, iv2 rect_lo, iv2 rect_hi, int scale, orientation_e orientation) {
+	return decode_region(Image2D::read_file(filepath), filepath, rect_lo, rect_hi, scale, orientation);
+}
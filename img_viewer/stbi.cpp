@@ -2,3 +2,1058 @@
 #define STB_IMAGE_IMPLEMENTATION
 
 #include "stbi.hpp"
+
+#include <mutex>
+#include <condition_variable>
+
+// Decoders that need the stb_image internals, so they have to live in this translation unit
+
+//// Region decoding
+// Rows are passed to the callback top-down, only the pixels in [x0,x1) of rows [y0,y1) are decoded (as far as the format allows)
+
+//// JPEG: baseline only, MCUs outside the region are still huffman decoded (needed for the dc prediction) but not idct'd,
+// and whole restart intervals that do not contain any needed MCU are skipped by scanning for the next RST marker
+// The component planes are only a ring of 3 MCU rows of the region (plus one MCU margin for the chroma upsampling), so memory does not depend on the image size
+
+static int min (int a, int b) {				return a < b ? a : b; }
+static int max (int a, int b) {				return a > b ? a : b; }
+static int clamp (int x, int lo, int hi) {	return min(max(x, lo), hi); }
+
+// skip entropy coded data until the next marker, returns the marker
+static int jpeg_skip_to_marker (stbi__jpeg* z) {
+	stbi__context* s = z->s;
+	for (;;) {
+		if (!s->read_from_callbacks) { // in memory, memchr to the next 0xff is many times faster than reading byte by byte
+			auto* p = (stbi_uc*)memchr(s->img_buffer, 0xff, s->img_buffer_end -s->img_buffer);
+			s->img_buffer = p ? p : s->img_buffer_end;
+		}
+		if (stbi__at_eof(z->s))
+			return STBI__MARKER_none;
+		if (stbi__get8(z->s) != 0xff)
+			continue;
+
+		int m = stbi__get8(z->s);
+		while (m == 0xff)
+			m = stbi__get8(z->s); // fill bytes
+		if (m != 0x00) // 0xff00 is a stuffed 0xff
+			return m;
+	}
+}
+
+// does the restart interval of MCUs [first, last] contain any MCU of the region
+static bool jpeg_interval_needed (int first, int last, int mcus_x, int mx0, int mx1, int my0, int my1) {
+	int r0 = first / mcus_x, c0 = first % mcus_x;
+	int r1 = last / mcus_x, c1 = last % mcus_x;
+
+	auto row_needed = [&] (int r, int c_lo, int c_hi) { // columns inclusive
+		return r >= my0 && r < my1 && c_lo < mx1 && c_hi >= mx0;
+	};
+
+	if (r0 == r1)
+		return row_needed(r0, c0, c1);
+	if (row_needed(r0, c0, mcus_x -1) || row_needed(r1, 0, c1))
+		return true;
+	for (int r=r0+1; r<r1; ++r) // full rows in between
+		if (row_needed(r, 0, mcus_x -1))
+			return true;
+	return false;
+}
+
+// color convert one row of w pixels of the (already upsampled) components to rgba, same as load_jpeg_image
+static void jpeg_color_convert (stbi__jpeg* z, stbi_uc* rgba, stbi_uc* coutput[4], int w) {
+	int is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+
+	stbi_uc* out = rgba;
+	stbi_uc* yc = coutput[0];
+	if (z->s->img_n == 3) {
+		if (is_rgb) {
+			for (int i=0; i<w; ++i, out += 4) {
+				out[0] = yc[i];
+				out[1] = coutput[1][i];
+				out[2] = coutput[2][i];
+				out[3] = 255;
+			}
+		} else {
+			z->YCbCr_to_RGB_kernel(out, yc, coutput[1], coutput[2], w, 4);
+		}
+	} else if (z->s->img_n == 4) {
+		if (z->app14_color_transform == 0) { // CMYK
+			for (int i=0; i<w; ++i, out += 4) {
+				stbi_uc m = coutput[3][i];
+				out[0] = stbi__blinn_8x8(coutput[0][i], m);
+				out[1] = stbi__blinn_8x8(coutput[1][i], m);
+				out[2] = stbi__blinn_8x8(coutput[2][i], m);
+				out[3] = 255;
+			}
+		} else if (z->app14_color_transform == 2) { // YCCK
+			z->YCbCr_to_RGB_kernel(out, yc, coutput[1], coutput[2], w, 4);
+			for (int i=0; i<w; ++i, out += 4) {
+				stbi_uc m = coutput[3][i];
+				out[0] = stbi__blinn_8x8(255 -out[0], m);
+				out[1] = stbi__blinn_8x8(255 -out[1], m);
+				out[2] = stbi__blinn_8x8(255 -out[2], m);
+			}
+		} else {
+			z->YCbCr_to_RGB_kernel(out, yc, coutput[1], coutput[2], w, 4);
+		}
+	} else {
+		for (int i=0; i<w; ++i, out += 4) {
+			out[0] = out[1] = out[2] = yc[i];
+			out[3] = 255;
+		}
+	}
+}
+
+struct Jpeg_Region_Decoder {
+	stbi__jpeg*	z;
+	int			x0, y0, x1, y1;
+
+	stbi_region_row_callback	cb;
+	void*						user;
+
+	int			mx0, mx1, my0, my1; // decoded MCU range
+	int			px0, px_w; // pixel column of the first decoded MCU column and width of the decoded columns
+
+	int			ring_rows[4]; // rows per component in the plane ring (3 MCU rows)
+
+	stbi_uc*	rgba_row = nullptr;
+
+	stbi_uc* get_comp_row (int k, int row) {
+		return z->img_comp[k].data + (row % ring_rows[k]) * z->img_comp[k].w2;
+	}
+
+	bool alloc () {
+		for (int k=0; k<z->s->img_n; ++k) {
+			auto& c = z->img_comp[k];
+			c.w2 = (mx1 -mx0) * c.h * 8;
+			ring_rows[k] = 3 * c.v * 8;
+
+			c.raw_data = stbi__malloc_mad2(c.w2, ring_rows[k], 15);
+			c.linebuf = (stbi_uc*)stbi__malloc(px_w +3);
+			if (!c.raw_data || !c.linebuf)
+				return false;
+			c.data = (stbi_uc*)(((size_t)c.raw_data +15) & ~15);
+		}
+		rgba_row = (stbi_uc*)stbi__malloc_mad2(px_w, 4, 0);
+		return rgba_row != nullptr;
+	}
+	void release () {
+		stbi__free_jpeg_components(z, z->s->img_n, 0);
+		STBI_FREE(rgba_row);
+	}
+
+	// resample and color convert one row of pixels (same logic as load_jpeg_image, but for any row of the ring)
+	void convert_row (int y) {
+		stbi_uc* coutput[4];
+
+		for (int k=0; k<z->s->img_n; ++k) {
+			auto& c = z->img_comp[k];
+			int hs = z->img_h_max / c.h;
+			int vs = z->img_v_max / c.v;
+			int w_lores = (px_w +hs-1) / hs;
+
+			int near_row = y / vs;
+			int far_row = vs == 2 ? near_row +((y & 1) ? +1 : -1) : near_row;
+			if (far_row < 0 || far_row >= c.y)
+				far_row = near_row; // image edge
+
+			stbi_uc* near_p = get_comp_row(k, near_row);
+			stbi_uc* far_p = get_comp_row(k, far_row);
+
+			if		(hs == 1 && vs == 1)	coutput[k] = near_p;
+			else if (hs == 1 && vs == 2)	coutput[k] = stbi__resample_row_v_2(c.linebuf, near_p, far_p, w_lores, hs);
+			else if (hs == 2 && vs == 1)	coutput[k] = stbi__resample_row_h_2(c.linebuf, near_p, far_p, w_lores, hs);
+			else if (hs == 2 && vs == 2)	coutput[k] = z->resample_row_hv_2_kernel(c.linebuf, near_p, far_p, w_lores, hs);
+			else							coutput[k] = stbi__resample_row_generic(c.linebuf, near_p, far_p, w_lores, hs);
+		}
+
+		jpeg_color_convert(z, rgba_row, coutput, px_w);
+
+		cb(user, y -y0, rgba_row +(x0 -px0) * 4);
+	}
+
+	// convert the rows of the region in [begin,end)
+	int converted_until;
+	void convert_rows_until (int end) {
+		end = clamp(end, 0, y1);
+		for (int y=max(converted_until, y0); y<end; ++y)
+			convert_row(y);
+		converted_until = max(converted_until, end);
+	}
+
+	int decode () {
+		z->restart_interval = 0;
+		for (int k=0; k<4; ++k) {
+			z->img_comp[k].raw_data = NULL;
+			z->img_comp[k].raw_coeff = NULL;
+			z->img_comp[k].linebuf = NULL;
+		}
+
+		if (!stbi__decode_jpeg_header(z, STBI__SCAN_header))
+			return STBI_REGION_FAIL;
+		if (z->progressive)
+			return STBI_REGION_UNSUPPORTED;
+
+		// frame header only parsed the components for STBI__SCAN_header, compute the rest like stbi__process_frame_header
+		int h_max = 1, v_max = 1;
+		for (int k=0; k<z->s->img_n; ++k) {
+			h_max = max(h_max, z->img_comp[k].h);
+			v_max = max(v_max, z->img_comp[k].v);
+		}
+		z->img_h_max = h_max;
+		z->img_v_max = v_max;
+		z->img_mcu_w = h_max * 8;
+		z->img_mcu_h = v_max * 8;
+		z->img_mcu_x = (z->s->img_x +z->img_mcu_w-1) / z->img_mcu_w;
+		z->img_mcu_y = (z->s->img_y +z->img_mcu_h-1) / z->img_mcu_h;
+		for (int k=0; k<z->s->img_n; ++k) {
+			z->img_comp[k].x = (z->s->img_x * z->img_comp[k].h +h_max-1) / h_max;
+			z->img_comp[k].y = (z->s->img_y * z->img_comp[k].v +v_max-1) / v_max;
+		}
+
+		if (z->s->img_n == 1 && (z->img_comp[0].h != 1 || z->img_comp[0].v != 1))
+			return STBI_REGION_UNSUPPORTED; // non-interleaved block order differs from the MCU order
+
+		// region in MCUs, with one MCU margin so the chroma upsampling at the region edges is the same as in a full decode
+		mx0 = max(x0 / z->img_mcu_w -1, 0);
+		mx1 = clamp((x1 +z->img_mcu_w-1) / z->img_mcu_w +1, 0, z->img_mcu_x);
+		my0 = max(y0 / z->img_mcu_h -1, 0);
+		my1 = clamp((y1 +z->img_mcu_h-1) / z->img_mcu_h +1, 0, z->img_mcu_y);
+
+		px0 = mx0 * z->img_mcu_w;
+		px_w = min(mx1 * z->img_mcu_w, z->s->img_x) -px0;
+
+		// tables and the scan header
+		int m = stbi__get_marker(z);
+		while (!stbi__SOS(m)) {
+			if (m == STBI__MARKER_none) { // padding
+				if (stbi__at_eof(z->s))
+					return STBI_REGION_FAIL;
+			} else {
+				if (stbi__EOI(m) || !stbi__process_marker(z, m))
+					return STBI_REGION_FAIL;
+			}
+			m = stbi__get_marker(z);
+		}
+		if (!stbi__process_scan_header(z))
+			return STBI_REGION_FAIL;
+		if (z->scan_n != z->s->img_n)
+			return STBI_REGION_UNSUPPORTED; // non-interleaved baseline, one scan per component
+
+		if (!alloc())
+			return STBI_REGION_FAIL;
+
+		converted_until = y0;
+
+		STBI_SIMD_ALIGN(short, data[64]);
+
+		stbi__jpeg_reset(z);
+
+		int mcu_count = my1 * z->img_mcu_x; // we never need to look past the last row of the region
+		for (int idx=0; idx<mcu_count;) {
+			int j = idx / z->img_mcu_x;
+			int i = idx % z->img_mcu_x;
+
+			// at the start of a restart interval, skip it entirely if we don't need any of its MCUs
+			if (z->restart_interval && z->todo == z->restart_interval &&
+					!jpeg_interval_needed(idx, min(idx +z->restart_interval, z->img_mcu_x * z->img_mcu_y) -1, z->img_mcu_x, mx0,mx1, my0,my1)) {
+				m = jpeg_skip_to_marker(z);
+				if (!STBI__RESTART(m))
+					break; // end of scan
+				stbi__jpeg_reset(z);
+				idx += z->restart_interval;
+
+				if (idx / z->img_mcu_x != j)
+					convert_rows_until((idx / z->img_mcu_x -1) * z->img_mcu_h);
+				continue;
+			}
+
+			bool inside = j >= my0 && i >= mx0 && i < mx1;
+
+			for (int k=0; k<z->scan_n; ++k) {
+				int n = z->order[k];
+				auto& c = z->img_comp[n];
+				for (int y=0; y<c.v; ++y) {
+					for (int x=0; x<c.h; ++x) {
+						int ha = c.ha;
+						if (!stbi__jpeg_decode_block(z, data, z->huff_dc +c.hd, z->huff_ac +ha, z->fast_ac[ha], n, z->dequant[c.tq]))
+							return STBI_REGION_FAIL;
+						if (inside) {
+							int x2 = ((i -mx0) * c.h +x) * 8;
+							int y2 = (j * c.v +y) * 8;
+							z->idct_block_kernel(get_comp_row(n, y2) +x2, c.w2, data);
+						}
+					}
+				}
+			}
+
+			if (--z->todo <= 0) {
+				if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+				if (!STBI__RESTART(z->marker))
+					break; // end of scan
+				stbi__jpeg_reset(z);
+			}
+
+			idx++;
+
+			// MCU row j is done, so the rows of MCU row j-1 have all their neighbours for the vertical chroma upsampling
+			if (idx % z->img_mcu_x == 0)
+				convert_rows_until(j * z->img_mcu_h);
+		}
+
+		convert_rows_until(y1);
+		return STBI_REGION_OK;
+	}
+};
+
+static int jpeg_decode_region (stbi__context* s, int x0, int y0, int x1, int y1, stbi_region_row_callback cb, void* user) {
+	auto* z = (stbi__jpeg*)stbi__malloc(sizeof(stbi__jpeg));
+	if (!z)
+		return STBI_REGION_FAIL;
+	z->s = s;
+	stbi__setup_jpeg(z);
+
+	Jpeg_Region_Decoder d;
+	d.z = z;
+	d.x0 = x0; d.y0 = y0; d.x1 = x1; d.y1 = y1;
+	d.cb = cb;
+	d.user = user;
+
+	int res = d.decode();
+
+	d.release();
+	STBI_FREE(z);
+	return res;
+}
+
+int stbi_jpeg_restart_interval (stbi_uc const* buffer, int len) {
+	stbi__context s;
+	stbi__start_mem(&s, buffer, len);
+	if (!stbi__jpeg_test(&s))
+		return 0;
+	stbi__start_mem(&s, buffer, len);
+
+	auto* z = (stbi__jpeg*)stbi__malloc(sizeof(stbi__jpeg));
+	if (!z)
+		return 0;
+	z->s = &s;
+	stbi__setup_jpeg(z);
+	z->restart_interval = 0;
+
+	int interval = 0;
+	if (stbi__decode_jpeg_header(z, STBI__SCAN_header) && !z->progressive) {
+		// DRI comes with the tables before the scan
+		int m = stbi__get_marker(z);
+		while (!stbi__SOS(m) && !stbi__EOI(m)) {
+			if (m == STBI__MARKER_none ? stbi__at_eof(z->s) : !stbi__process_marker(z, m))
+				break;
+			m = stbi__get_marker(z);
+		}
+		if (stbi__SOS(m))
+			interval = z->restart_interval;
+	}
+
+	STBI_FREE(z);
+	return interval;
+}
+
+//// Progressive JPEG DC preview
+// The first scans of a progressive jpeg are usually the DC coefficients of all components, which are the averages of the 8x8 blocks, ie. a 1/8 scale image
+// So we stop reading the file as soon as every component got its DC scan, which is usually a small part of the file
+
+static stbi_uc* jpeg_dc_preview (stbi__jpeg* z, int* x, int* y) {
+	z->restart_interval = 0;
+	for (int k=0; k<4; ++k) {
+		z->img_comp[k].raw_data = NULL;
+		z->img_comp[k].raw_coeff = NULL;
+		z->img_comp[k].linebuf = NULL;
+	}
+
+	// can't rewind a file context to parse the header twice, so this already allocates the component buffers (which are not touched for baseline jpegs)
+	if (!stbi__decode_jpeg_header(z, STBI__SCAN_load) || !z->progressive)
+		return NULL; // not progressive, so there is no early scan to stop after
+
+	int n = z->s->img_n;
+	bool dc_done[4] = {};
+	auto all_dc_done = [&] () {
+		for (int k=0; k<n; ++k)
+			if (!dc_done[k]) return false;
+		return true;
+	};
+
+	int m = stbi__get_marker(z);
+	while (!stbi__EOI(m) && !all_dc_done()) {
+		if (stbi__SOS(m)) {
+			if (!stbi__process_scan_header(z) || !stbi__parse_entropy_coded_data(z))
+				return NULL;
+
+			if (z->spec_start == 0 && z->succ_high == 0) // first DC scan of these components
+				for (int k=0; k<z->scan_n; ++k)
+					dc_done[z->order[k]] = true;
+
+			if (all_dc_done())
+				break; // don't read the rest of the file
+
+			if (z->marker == STBI__MARKER_none) { // same as stbi__decode_jpeg_image
+				while (!stbi__at_eof(z->s)) {
+					if (stbi__get8(z->s) == 255) {
+						z->marker = stbi__get8(z->s);
+						break;
+					}
+				}
+			}
+		} else if (!stbi__process_marker(z, m)) {
+			return NULL;
+		}
+		m = stbi__get_marker(z);
+	}
+	if (!all_dc_done())
+		return NULL;
+
+	// preview pixel = one 8x8 block of the full size image
+	int w = (z->s->img_x +7) / 8;
+	int h = (z->s->img_y +7) / 8;
+
+	auto* out = (stbi_uc*)stbi__malloc_mad3(w, h, 4, 0);
+	auto* rows = (stbi_uc*)stbi__malloc_mad2(w, n, 0); // one row per component
+	if (!out || !rows) {
+		STBI_FREE(out);
+		STBI_FREE(rows);
+		return NULL;
+	}
+
+	for (int py=0; py<h; ++py) {
+		stbi_uc* coutput[4];
+
+		for (int k=0; k<n; ++k) {
+			auto& c = z->img_comp[k];
+			int hs = z->img_h_max / c.h;
+			int vs = z->img_v_max / c.v;
+			stbi__uint16* dequant = z->dequant[c.tq];
+
+			int by = min(py / vs, (c.y +7) / 8 -1);
+			stbi_uc* row = rows +k * w;
+			for (int px=0; px<w; ++px) {
+				int bx = min(px / hs, (c.x +7) / 8 -1); // nearest upsampling of the subsampled components, good enough for a preview
+				int dc = c.coeff[64 * (bx +by * c.coeff_w)] * dequant[0];
+				row[px] = (stbi_uc)clamp(((dc +4) >> 3) +128, 0, 255); // idct of a block with only a DC coefficient
+			}
+			coutput[k] = row;
+		}
+
+		jpeg_color_convert(z, out +(size_t)py * w * 4, coutput, w);
+	}
+
+	STBI_FREE(rows);
+
+	*x = w;
+	*y = h;
+	return out;
+}
+
+stbi_uc* stbi_load_jpeg_dc_preview_from_file (FILE* f, int* x, int* y, int* full_x, int* full_y) {
+	stbi__context s;
+	stbi__start_file(&s, f);
+
+	if (!stbi__jpeg_test(&s))
+		return NULL;
+
+	auto* z = (stbi__jpeg*)stbi__malloc(sizeof(stbi__jpeg));
+	if (!z)
+		return NULL;
+	z->s = &s;
+	stbi__setup_jpeg(z);
+
+	stbi_uc* res = jpeg_dc_preview(z, x, y);
+	if (res) {
+		*full_x = z->s->img_x;
+		*full_y = z->s->img_y;
+	}
+
+	stbi__free_jpeg_components(z, z->s->img_n, 0);
+	STBI_FREE(z);
+	return res;
+}
+
+//// PNG: non-interlaced only, inflates into a 32KB sliding window instead of the whole image and unfilters row by row,
+// so only two rows of the image are ever in memory, decoding stops after the last row of the region
+
+// zlib inflate that pushes its output to a callback in chunks and only keeps the 32KB window needed for back references
+struct Zlib_Stream {
+	static constexpr int WINDOW = 32 * 1024;
+	static constexpr int BUF_SIZE = WINDOW + 96 * 1024; // has to fit WINDOW + the biggest single write (one stored block piece or one match)
+
+	stbi__zbuf	a;
+	char*		flushed; // output before this was passed to the callback
+
+	int			(*flush_cb) (void* user, stbi_uc const* data, int len); // return 0 to stop
+	void*		user;
+	bool		stopped = false;
+
+	bool flush (char* zout) {
+		if (zout > flushed && !flush_cb(user, (stbi_uc const*)flushed, (int)(zout -flushed)))
+			stopped = true;
+		flushed = zout;
+		return !stopped;
+	}
+
+	// make room for n bytes by flushing and sliding the window back to the start of the buffer
+	bool make_room (char** zout, int n) {
+		if (*zout +n <= a.zout_end)
+			return true;
+		if (!flush(*zout))
+			return false;
+
+		int keep = min(WINDOW, (int)(*zout -a.zout_start));
+		memmove(a.zout_start, *zout -keep, keep);
+		*zout = a.zout_start +keep;
+		flushed = *zout;
+		return true;
+	}
+
+	// stbi__parse_huffman_block with make_room instead of stbi__zexpand
+	int parse_huffman_block () {
+		char* zout = a.zout;
+		for (;;) {
+			int z = stbi__zhuffman_decode(&a, &a.z_length);
+			if (z < 256) {
+				if (z < 0) return stbi__err("bad huffman code","Corrupt PNG");
+				if (!make_room(&zout, 1)) return 0;
+				*zout++ = (char)z;
+			} else {
+				if (z == 256) {
+					a.zout = zout;
+					return 1;
+				}
+				z -= 257;
+				int len = stbi__zlength_base[z];
+				if (stbi__zlength_extra[z]) len += stbi__zreceive(&a, stbi__zlength_extra[z]);
+				z = stbi__zhuffman_decode(&a, &a.z_distance);
+				if (z < 0) return stbi__err("bad huffman code","Corrupt PNG");
+				int dist = stbi__zdist_base[z];
+				if (stbi__zdist_extra[z]) dist += stbi__zreceive(&a, stbi__zdist_extra[z]);
+				if (!make_room(&zout, len)) return 0;
+				if (zout -a.zout_start < dist) return stbi__err("bad dist","Corrupt PNG");
+
+				stbi_uc* p = (stbi_uc*)(zout -dist);
+				if (dist == 1) {
+					stbi_uc v = *p;
+					while (len--) *zout++ = v;
+				} else {
+					while (len--) *zout++ = *p++;
+				}
+			}
+		}
+	}
+
+	int parse_uncompressed_block () {
+		stbi_uc header[4];
+		if (a.num_bits & 7)
+			stbi__zreceive(&a, a.num_bits & 7); // discard
+		int k = 0;
+		while (a.num_bits > 0) {
+			header[k++] = (stbi_uc)(a.code_buffer & 255);
+			a.code_buffer >>= 8;
+			a.num_bits -= 8;
+		}
+		while (k < 4)
+			header[k++] = stbi__zget8(&a);
+		int len  = header[1] * 256 + header[0];
+		int nlen = header[3] * 256 + header[2];
+		if (nlen != (len ^ 0xffff)) return stbi__err("zlib corrupt","Corrupt PNG");
+		if (a.zbuffer +len > a.zbuffer_end) return stbi__err("read past buffer","Corrupt PNG");
+
+		char* zout = a.zout;
+		while (len > 0) {
+			int piece = min(len, BUF_SIZE -WINDOW);
+			if (!make_room(&zout, piece)) return 0;
+			memcpy(zout, a.zbuffer, piece);
+			a.zbuffer += piece;
+			zout += piece;
+			len -= piece;
+		}
+		a.zout = zout;
+		return 1;
+	}
+
+	// returns 1 when the stream was decoded completely or the callback stopped it
+	int inflate (stbi_uc const* data, int len) {
+		char* buf = (char*)stbi__malloc(BUF_SIZE);
+		if (!buf) return stbi__err("outofmem", "Out of memory");
+
+		a.zbuffer = (stbi_uc*)data;
+		a.zbuffer_end = (stbi_uc*)data +len;
+		a.zout_start = a.zout = flushed = buf;
+		a.zout_end = buf +BUF_SIZE;
+		a.z_expandable = 0;
+
+		int res = stbi__parse_zlib_header(&a);
+		if (res) {
+			a.num_bits = 0;
+			a.code_buffer = 0;
+			int final;
+			do {
+				final = stbi__zreceive(&a, 1);
+				int type = stbi__zreceive(&a, 2);
+				if (type == 0) {
+					res = parse_uncompressed_block();
+				} else if (type == 3) {
+					res = 0;
+				} else {
+					if (type == 1) {
+						res = stbi__zbuild_huffman(&a.z_length, stbi__zdefault_length, 288) &&
+						      stbi__zbuild_huffman(&a.z_distance, stbi__zdefault_distance, 32);
+					} else {
+						res = stbi__compute_huffman_codes(&a);
+					}
+					res = res && parse_huffman_block();
+				}
+			} while (res && !final);
+
+			if (res)
+				flush(a.zout);
+		}
+
+		STBI_FREE(buf);
+		return res || stopped;
+	}
+};
+
+// inflate on another thread while the decoder unfilters on its own, the output is handed over in chunks through a small ring
+// the inflating side waits while the ring is full, so memory stays bounded like with the single threaded streaming
+struct Inflate_Pipe {
+	static constexpr int CHUNK = 64 * 1024;
+	static constexpr int CHUNKS = 8;
+
+	stbi_uc			chunks[CHUNKS][CHUNK];
+	int				lens[CHUNKS];
+	int				filled = 0; // chunks pushed and popped so far, the ring holds filled -popped chunks
+	int				popped = 0;
+	bool			inflated = false; // inflate returned
+	bool			stop = false; // the decoder does not need more data
+	int				inflate_res = 0;
+
+	std::mutex				m;
+	std::condition_variable	c;
+
+	Zlib_Stream		z;
+	stbi_uc const*	data;
+	int				len;
+
+	// inflating thread
+	int push (stbi_uc const* d, int n) {
+		while (n > 0) {
+			{
+				std::unique_lock<std::mutex> lock(m);
+				while (filled -popped == CHUNKS && !stop)
+					c.wait(lock);
+				if (stop)
+					return 0;
+			}
+
+			int i = filled % CHUNKS;
+			lens[i] = min(n, CHUNK);
+			memcpy(chunks[i], d, lens[i]);
+			d += lens[i];
+			n -= lens[i];
+
+			std::lock_guard<std::mutex> lock(m);
+			filled++;
+			c.notify_all();
+		}
+		return 1;
+	}
+	static int push_cb (void* user, stbi_uc const* d, int n) {
+		return ((Inflate_Pipe*)user)->push(d, n);
+	}
+	static void inflate_task (void* arg) {
+		auto* p = (Inflate_Pipe*)arg;
+		int res = p->z.inflate(p->data, p->len);
+
+		std::lock_guard<std::mutex> lock(p->m);
+		p->inflate_res = res;
+		p->inflated = true;
+		p->c.notify_all();
+	}
+
+	// decoding thread, chunk stays valid until release
+	bool pop (stbi_uc const** d, int* n) {
+		std::unique_lock<std::mutex> lock(m);
+		while (filled == popped && !inflated)
+			c.wait(lock);
+		if (filled == popped)
+			return false;
+		int i = popped % CHUNKS;
+		*d = chunks[i];
+		*n = lens[i];
+		return true;
+	}
+	void release () {
+		std::lock_guard<std::mutex> lock(m);
+		popped++;
+		c.notify_all();
+	}
+	void stop_inflate () {
+		std::lock_guard<std::mutex> lock(m);
+		stop = true;
+		c.notify_all();
+	}
+};
+
+static stbi__uint32 png_get32 (stbi_uc const* p) {
+	return ((stbi__uint32)p[0] << 24) | ((stbi__uint32)p[1] << 16) | ((stbi__uint32)p[2] << 8) | p[3];
+}
+
+struct Png_Region_Decoder {
+	int			x0, y0, x1, y1;
+
+	stbi_region_row_callback	cb;
+	void*						user;
+
+	stbi_async const*			async = nullptr;
+
+	int			w, h, depth, color, img_n;
+	int			bpp; // bytes per complete pixel for the filters, at least 1
+	int			row_bytes;
+
+	stbi_uc		palette[256][4];
+	bool		has_trns = false;
+	stbi__uint16 trns_key[3] = {}; // for gray and rgb
+
+	// row assembly
+	stbi_uc*	raw;	// filter byte + row_bytes
+	int			raw_fill = 0;
+	stbi_uc*	cur;	// unfiltered current and previous row
+	stbi_uc*	prev;
+	stbi_uc*	rgba_row;
+	int			y = 0;
+
+	int sample (stbi_uc const* row, int x, int c) const { // value of channel c of pixel x at the original bit depth
+		if (depth == 8)		return row[x * img_n +c];
+		if (depth == 16)	return (row[(x * img_n +c) * 2] << 8) | row[(x * img_n +c) * 2 +1];
+		int bit = x * depth;
+		return (row[bit >> 3] >> (8 -depth -(bit & 7))) & ((1 << depth) -1);
+	}
+	stbi_uc to8 (int v) const {
+		return depth == 16 ? (stbi_uc)(v >> 8) : (stbi_uc)(v * stbi__depth_scale_table[depth]); // same as stb
+	}
+
+	void unfilter () {
+		int filter = raw[0];
+		stbi_uc const* r = raw +1;
+		for (int i=0; i<row_bytes; ++i) {
+			int a = i >= bpp ? cur[i -bpp] : 0;
+			int b = y > 0 ? prev[i] : 0;
+			int c = i >= bpp && y > 0 ? prev[i -bpp] : 0;
+			switch (filter) {
+				case STBI__F_none:	cur[i] = r[i]; break;
+				case STBI__F_sub:	cur[i] = STBI__BYTECAST(r[i] +a); break;
+				case STBI__F_up:	cur[i] = STBI__BYTECAST(r[i] +b); break;
+				case STBI__F_avg:	cur[i] = STBI__BYTECAST(r[i] +((a +b) >> 1)); break;
+				case STBI__F_paeth:	cur[i] = STBI__BYTECAST(r[i] +stbi__paeth(a,b,c)); break;
+			}
+		}
+	}
+
+	void convert_row () {
+		stbi_uc* out = rgba_row;
+		for (int x=x0; x<x1; ++x, out += 4) {
+			switch (color) {
+				case 0: { // gray
+					int v = sample(cur, x, 0);
+					out[0] = out[1] = out[2] = to8(v);
+					out[3] = has_trns && v == trns_key[0] ? 0 : 255;
+				} break;
+				case 2: { // rgb
+					int r = sample(cur, x, 0), g = sample(cur, x, 1), b = sample(cur, x, 2);
+					out[0] = to8(r); out[1] = to8(g); out[2] = to8(b);
+					out[3] = has_trns && r == trns_key[0] && g == trns_key[1] && b == trns_key[2] ? 0 : 255;
+				} break;
+				case 3: { // palette
+					memcpy(out, palette[sample(cur, x, 0)], 4);
+				} break;
+				case 4: { // gray alpha
+					out[0] = out[1] = out[2] = to8(sample(cur, x, 0));
+					out[3] = to8(sample(cur, x, 1));
+				} break;
+				case 6: { // rgba
+					for (int c=0; c<4; ++c)
+						out[c] = to8(sample(cur, x, c));
+				} break;
+			}
+		}
+	}
+
+	// zlib output
+	int consume (stbi_uc const* data, int len) {
+		while (len > 0) {
+			int n = min(len, row_bytes +1 -raw_fill);
+			memcpy(raw +raw_fill, data, n);
+			raw_fill += n;
+			data += n;
+			len -= n;
+
+			if (raw_fill == row_bytes +1) {
+				if (raw[0] > 4)
+					return 0; // corrupt, stop
+				unfilter();
+				if (y >= y0) {
+					convert_row();
+					cb(user, y -y0, rgba_row);
+				}
+
+				stbi_uc* tmp = prev; prev = cur; cur = tmp;
+				raw_fill = 0;
+				if (++y >= y1)
+					return 0; // rest of the image is not needed
+			}
+		}
+		return 1;
+	}
+	static int consume_cb (void* user, stbi_uc const* data, int len) {
+		return ((Png_Region_Decoder*)user)->consume(data, len);
+	}
+
+	// returns 0 if the inflate failed or the data ended early
+	int inflate_and_consume (stbi_uc const* idat, int idat_len) {
+		if (async) {
+			auto* pipe = new Inflate_Pipe;
+			pipe->z.flush_cb = Inflate_Pipe::push_cb;
+			pipe->z.user = pipe;
+			pipe->data = idat;
+			pipe->len = idat_len;
+
+			void* handle = async->start(async->user, Inflate_Pipe::inflate_task, pipe);
+			if (handle) {
+				stbi_uc const* d;
+				int n;
+				while (pipe->pop(&d, &n)) {
+					int ok = consume(d, n);
+					pipe->release();
+					if (!ok) {
+						pipe->stop_inflate();
+						break;
+					}
+				}
+				async->join(async->user, handle);
+
+				int res = pipe->inflate_res;
+				delete pipe;
+				return res && y >= y1;
+			}
+			delete pipe; // no free thread, inflate on this one
+		}
+
+		Zlib_Stream z;
+		z.flush_cb = consume_cb;
+		z.user = this;
+		return z.inflate(idat, idat_len) && y >= y1;
+	}
+
+	int decode (stbi_uc const* buf, int len) {
+		static const stbi_uc png_sig[8] = { 137,80,78,71,13,10,26,10 };
+		if (len < 8 || memcmp(buf, png_sig, 8) != 0)
+			return STBI_REGION_FAIL;
+
+		for (int i=0; i<256; ++i) {
+			palette[i][0] = palette[i][1] = palette[i][2] = 0;
+			palette[i][3] = 255;
+		}
+
+		// idat chunks concatenated, only the compressed data is in memory
+		stbi_uc* idat = nullptr;
+		int idat_len = 0;
+		bool got_ihdr = false;
+
+		int res = STBI_REGION_OK;
+
+		stbi_uc const* p = buf +8;
+		stbi_uc const* end = buf +len;
+		while (p +8 <= end) {
+			stbi__uint32 chunk_len = png_get32(p);
+			stbi__uint32 type = png_get32(p +4);
+			stbi_uc const* d = p +8;
+			if (chunk_len > (stbi__uint32)(end -d)) { res = STBI_REGION_FAIL; break; }
+
+			if (type == STBI__PNG_TYPE('I','H','D','R')) {
+				if (chunk_len != 13) { res = STBI_REGION_FAIL; break; }
+				w = (int)png_get32(d);
+				h = (int)png_get32(d +4);
+				depth = d[8];
+				color = d[9];
+				if (d[12] != 0) { res = STBI_REGION_UNSUPPORTED; break; } // interlaced
+				if (w <= 0 || h <= 0 || color > 6 || color == 1 || color == 5) { res = STBI_REGION_FAIL; break; }
+				img_n = color == 0 ? 1 : color == 2 ? 3 : color == 3 ? 1 : color == 4 ? 2 : 4;
+				if (depth != 1 && depth != 2 && depth != 4 && depth != 8 && depth != 16) { res = STBI_REGION_FAIL; break; }
+				if (depth < 8 && color != 0 && color != 3) { res = STBI_REGION_FAIL; break; }
+				got_ihdr = true;
+			} else if (type == STBI__PNG_TYPE('C','g','B','I')) {
+				res = STBI_REGION_UNSUPPORTED; break; // apple png
+			} else if (type == STBI__PNG_TYPE('P','L','T','E')) {
+				if (chunk_len > 256*3 || chunk_len % 3) { res = STBI_REGION_FAIL; break; }
+				for (stbi__uint32 i=0; i<chunk_len/3; ++i) {
+					palette[i][0] = d[i*3 +0];
+					palette[i][1] = d[i*3 +1];
+					palette[i][2] = d[i*3 +2];
+				}
+			} else if (type == STBI__PNG_TYPE('t','R','N','S')) {
+				if (!got_ihdr) { res = STBI_REGION_FAIL; break; }
+				if (color == 3) {
+					for (stbi__uint32 i=0; i<chunk_len && i<256; ++i)
+						palette[i][3] = d[i];
+				} else if (color == 0 && chunk_len == 2) {
+					has_trns = true;
+					trns_key[0] = (stbi__uint16)((d[0] << 8) | d[1]);
+				} else if (color == 2 && chunk_len == 6) {
+					has_trns = true;
+					for (int c=0; c<3; ++c)
+						trns_key[c] = (stbi__uint16)((d[c*2] << 8) | d[c*2 +1]);
+				}
+			} else if (type == STBI__PNG_TYPE('I','D','A','T')) {
+				stbi_uc* q = (stbi_uc*)STBI_REALLOC_SIZED(idat, idat_len, idat_len +chunk_len);
+				if (!q) { res = STBI_REGION_FAIL; break; }
+				idat = q;
+				memcpy(idat +idat_len, d, chunk_len);
+				idat_len += chunk_len;
+			} else if (type == STBI__PNG_TYPE('I','E','N','D')) {
+				break;
+			}
+
+			p = d +chunk_len +4; // skip crc
+		}
+
+		if (res == STBI_REGION_OK && (!got_ihdr || !idat))
+			res = STBI_REGION_FAIL;
+		if (res == STBI_REGION_OK && (x0 < 0 || y0 < 0 || x1 > w || y1 > h || x0 >= x1 || y0 >= y1))
+			res = STBI_REGION_FAIL;
+
+		if (res == STBI_REGION_OK) {
+			bpp = max(img_n * depth / 8, 1);
+			row_bytes = (int)(((long long)img_n * w * depth +7) / 8);
+
+			raw = (stbi_uc*)stbi__malloc(row_bytes +1);
+			cur = (stbi_uc*)stbi__malloc(row_bytes);
+			prev = (stbi_uc*)stbi__malloc(row_bytes);
+			rgba_row = (stbi_uc*)stbi__malloc_mad2(x1 -x0, 4, 0);
+
+			if (raw && cur && prev && rgba_row) {
+				if (!inflate_and_consume(idat, idat_len))
+					res = STBI_REGION_FAIL;
+			} else {
+				res = STBI_REGION_FAIL;
+			}
+
+			STBI_FREE(raw);
+			STBI_FREE(cur);
+			STBI_FREE(prev);
+			STBI_FREE(rgba_row);
+		}
+
+		STBI_FREE(idat);
+		return res;
+	}
+};
+
+int stbi_decode_region (stbi_uc const* buffer, int len, int x0, int y0, int x1, int y1, stbi_region_row_callback cb, void* user) {
+	return stbi_decode_region_async(buffer, len, x0,y0,x1,y1, cb, user, nullptr);
+}
+int stbi_decode_region_async (stbi_uc const* buffer, int len, int x0, int y0, int x1, int y1, stbi_region_row_callback cb, void* user, stbi_async const* async) {
+	stbi__context s;
+	stbi__start_mem(&s, buffer, len);
+
+	if (stbi__jpeg_test(&s)) {
+		stbi__start_mem(&s, buffer, len);
+		return jpeg_decode_region(&s, x0,y0,x1,y1, cb, user);
+	}
+
+	stbi__start_mem(&s, buffer, len);
+	if (stbi__png_test(&s)) {
+		Png_Region_Decoder d;
+		d.x0 = x0; d.y0 = y0; d.x1 = x1; d.y1 = y1;
+		d.cb = cb;
+		d.user = user;
+		d.async = async;
+		return d.decode(buffer, len);
+	}
+
+	return STBI_REGION_UNSUPPORTED;
+}
+
+//// GIF: frame by frame, stbi__gif_load_next draws the next frame onto the canvas in g.out
+// disposal mode 3 restores the pixels of the frame before to the canvas as it was before that frame, so we keep a copy of the last two canvases (stbi__load_gif_main keeps all frames for that)
+
+struct stbi_gif_frames {
+	stbi_uc const*	buffer;
+	int				len;
+
+	stbi__context	s;
+	stbi__gif		g;
+
+	stbi_uc*		canvas[2]; // copies of the last two frames, canvas[frame & 1] is the current one
+	int				frame; // frames decoded since the start
+
+	void free_canvases () {
+		STBI_FREE(g.out);
+		STBI_FREE(g.history);
+		STBI_FREE(g.background);
+		memset(&g, 0, sizeof(g));
+	}
+	void start () {
+		free_canvases();
+		stbi__start_mem(&s, buffer, len);
+		frame = 0;
+	}
+};
+
+stbi_gif_frames* stbi_gif_open (stbi_uc const* buffer, int len, int* x, int* y) {
+	stbi__context s;
+	stbi__start_mem(&s, buffer, len);
+	if (!stbi__gif_test(&s) || !stbi__gif_info_raw(&s, x, y, NULL) || *x <= 0 || *y <= 0)
+		return NULL;
+
+	auto* f = (stbi_gif_frames*)stbi__malloc(sizeof(stbi_gif_frames)); // stbi__gif has the 8192 lzw codes, too big for the stack of the caller
+	if (!f)
+		return NULL;
+	memset(f, 0, sizeof(*f));
+	f->buffer = buffer;
+	f->len = len;
+
+	f->canvas[0] = (stbi_uc*)stbi__malloc_mad3(*x, *y, 4, 0);
+	f->canvas[1] = (stbi_uc*)stbi__malloc_mad3(*x, *y, 4, 0);
+	if (!f->canvas[0] || !f->canvas[1]) {
+		stbi_gif_close(f);
+		return NULL;
+	}
+
+	f->start();
+	return f;
+}
+
+stbi_uc const* stbi_gif_next_frame (stbi_gif_frames* f, int* delay_ms) {
+	int comp;
+	stbi_uc* two_back = f->frame >= 2 ? f->canvas[f->frame & 1] : NULL; // frame -2 is in the slot this frame is copied to next
+
+	stbi_uc* u = stbi__gif_load_next(&f->s, &f->g, &comp, 4, two_back);
+	if (u == NULL || u == (stbi_uc*)&f->s) // corrupt or end of animation marker
+		return NULL;
+
+	stbi_uc* cur = f->canvas[f->frame & 1];
+	memcpy(cur, u, (size_t)f->g.w * f->g.h * 4);
+	f->frame++;
+
+	*delay_ms = f->g.delay;
+	return cur;
+}
+
+void stbi_gif_rewind (stbi_gif_frames* f) {
+	f->start();
+}
+
+void stbi_gif_close (stbi_gif_frames* f) {
+	if (!f)
+		return;
+	f->free_canvases();
+	STBI_FREE(f->canvas[0]);
+	STBI_FREE(f->canvas[1]);
+	STBI_FREE(f);
+}
@@ -7,6 +7,49 @@
 #define STBI_ONLY_PNG	1
 //#define STBI_ONLY_TGA	1
 #define STBI_ONLY_JPEG	1
+#define STBI_ONLY_GIF	1 // first frame as still image, see stbi_gif_open for the animation
 //#define STBI_ONLY_HDR	1
 
 #include "stb_image.h"
+
+// region decoding, implemented in stbi.cpp
+#define STBI_REGION_OK			1
+#define STBI_REGION_FAIL		0
+#define STBI_REGION_UNSUPPORTED	-1 // format or variant (progressive jpeg, interlaced png) not supported, decode the whole image instead
+
+// called for every row of the region top-down, y is relative to the region, rgba has (x1 -x0) pixels
+typedef void (*stbi_region_row_callback) (void* user, int y, stbi_uc const* rgba);
+
+// decode only the pixels [x0,x1) x [y0,y1) (top-down) of a jpeg or png in memory as rgba8
+int stbi_decode_region (stbi_uc const* buffer, int len, int x0, int y0, int x1, int y1, stbi_region_row_callback cb, void* user);
+
+// lets a decoder run part of its work on another thread (see Worker_Helpers)
+struct stbi_async {
+	void*	(*start) (void* user, void (*task) (void* arg), void* arg); // returns null if no thread is free right now, then task is not run
+	void	(*join) (void* user, void* handle);
+	void*	user;
+};
+
+// same as stbi_decode_region, but pngs inflate on another thread while this one unfilters (if async can start one)
+int stbi_decode_region_async (stbi_uc const* buffer, int len, int x0, int y0, int x1, int y1, stbi_region_row_callback cb, void* user, stbi_async const* async);
+
+// restart interval in MCUs of a baseline jpeg in memory, 0 if it has none (or is not a baseline jpeg)
+// with restart markers stbi_decode_region can skip to the rows it needs, so horizontal bands of the image can be decoded independently
+int stbi_jpeg_restart_interval (stbi_uc const* buffer, int len);
+
+// progressive jpegs only: decode only the first scans until every component has its DC coefficients, which is a 1/8 scale image (one pixel per 8x8 block)
+// reads only as much of the file as needed, returns rgba8 of ceil(full_size / 8) top-down or null (also if the jpeg is not progressive)
+stbi_uc* stbi_load_jpeg_dc_preview_from_file (FILE* f, int* x, int* y, int* full_x, int* full_y);
+
+// animated gifs one frame at a time, unlike stbi_load_gif_from_memory, which decodes all frames at once
+// every frame is drawn on top of the previous ones, so frames can only be decoded in order, the decoder keeps the canvas (and the one before it for disposal mode 3) between calls
+struct stbi_gif_frames;
+
+// buffer has to stay alive until stbi_gif_close, returns null if it is not a gif
+stbi_gif_frames* stbi_gif_open (stbi_uc const* buffer, int len, int* x, int* y);
+// decode the next frame, returns rgba8 of the whole canvas top-down (owned by the decoder, valid until the next call) or null after the last frame (or on a corrupt one)
+// delay_ms is how long the frame should be shown (0 if the file does not say)
+stbi_uc const* stbi_gif_next_frame (stbi_gif_frames* f, int* delay_ms);
+// start over at the first frame, to loop the animation
+void stbi_gif_rewind (stbi_gif_frames* f);
+void stbi_gif_close (stbi_gif_frames* f);
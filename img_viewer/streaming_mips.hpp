@@ -0,0 +1,315 @@
+#pragma once
+
+#include <vector>
+
+#include "basic_typedefs.hpp"
+#include "vector_util.hpp"
+#include "colors.hpp"
+
+#include "stbi.hpp"
+#include "image.hpp"
+#include "orientation.hpp"
+#include "tracing.hpp"
+#include "threadpool.hpp"
+
+/* Generating the mips while decoding, instead of decoding the full image and then downsampling it level by level
+	The decoder passes the rows top-down (see stbi_decode_region), every level box filters pairs of rows of the level above into its next row,
+	so every level only needs to keep the even row until the odd one arrives
+	Only the lowest keep_count levels are stored, the bigger ones only stream through, so if the full size is not desired the peak memory is a few rows per level plus the stored mips
+	A stream can also cover only a horizontal band of the image, so bands can be decoded in parallel (see generate_mips_in_bands)
+	The levels are filtered in the orientation of the file, only the stored rows are written to their oriented position (see write_rows_oriented)
+*/
+
+// sizes of all levels and the images of the stored ones
+struct Mip_Levels {
+	std::vector<iv2>		sizes; // level 0 is the full size, in the orientation of the file
+	std::vector<Image2D>	imgs; // bottom-up like all our images and oriented, only allocated for the stored levels
+	int						keep_count;
+	orientation_e			orientation;
+
+	int						source_copy_level = -1; // this level is also stored unoriented into source_copy (see generate_mips_in_bands)
+	Image2D					source_copy;
+
+	Mip_Levels (iv2 full_size_px, int keep_count, orientation_e orientation): keep_count{keep_count}, orientation{orientation} {
+		// same sizes as Texture_Streamer::find_mipmap_sizes_px
+		for (iv2 sz = full_size_px;; sz = max(sz / 2, 1)) {
+			sizes.push_back(sz);
+			if (all(sz == 1))
+				break;
+		}
+
+		imgs.resize(sizes.size());
+		for (int i=0; i<(int)sizes.size(); ++i) {
+			if (is_kept(i))
+				imgs[i] = Image2D::allocate(orient_size(sizes[i], orientation));
+		}
+	}
+
+	bool is_kept (int i) const { return i >= (int)sizes.size() -keep_count; }
+
+	// the stored levels in smallest to biggest order
+	std::vector<Image2D> get_mips () {
+		std::vector<Image2D> mips;
+		for (int i=(int)sizes.size()-1; i>=0; --i) {
+			if (is_kept(i))
+				mips.push_back(std::move(imgs[i]));
+		}
+		return mips;
+	}
+};
+
+// streams the rows [y0,y1) of level first_level down through the levels until last_level
+// streams of horizontal bands of the image are independent of each other, as long as y0 is a multiple of 2^(last_level -first_level) so the row pairs line up
+struct Mip_Stream {
+	struct Level {
+		int					index; // in Mip_Levels
+		iv2					size; // of the whole level
+		int					row0; // rows [row0, row1) of the level pass through this stream
+		int					row1;
+
+		std::vector<rgba8>	pending; // even row waiting for its odd partner
+		std::vector<rgba8>	out_row; // row of the next level
+
+		std::vector<rgba8>	block; // for transposing orientations, ORIENT_TILE rows are collected and then written as columns in tiles
+		int					block_y0;
+		int					block_rows;
+	};
+	Mip_Levels*				mips;
+	std::vector<Level>		levels;
+
+	bool					opaque = true; // checked on the first level rows, since averaging can round small alpha differences away
+
+	Mip_Stream (Mip_Levels* mips, int first_level, int last_level, int y0, int y1): mips{mips} {
+		bool bottom = y1 == mips->sizes[first_level].y;
+
+		for (int i=first_level; i<=last_level; ++i) {
+			Level l;
+			l.index = i;
+			l.size = mips->sizes[i];
+			l.row0 = y0 >> (i -first_level);
+			l.row1 = bottom ? l.size.y : y1 >> (i -first_level); // the bottom band gets the rest (odd heights drop the last row)
+			l.pending.resize(l.size.x);
+			if (i < last_level)
+				l.out_row.resize(mips->sizes[i +1].x);
+			if (is_transposed(mips->orientation) && mips->imgs[i].pixels)
+				l.block.resize((uptr)ORIENT_TILE * l.size.x);
+			l.block_rows = 0;
+			levels.push_back(std::move(l));
+		}
+	}
+
+	void store_row (Level& l, int y, rgba8 const* row) {
+		if (l.index == mips->source_copy_level) {
+			rgba8* dst = &mips->source_copy.pixels[(uptr)(l.size.y -1 -y) * l.size.x];
+			if (dst != row)
+				memcpy(dst, row, l.size.x * sizeof(rgba8));
+		}
+
+		auto& img = mips->imgs[l.index];
+		if (!img.pixels)
+			return;
+
+		if (l.block.empty()) {
+			write_rows_oriented(row, 0, y, 1, l.size, mips->orientation, &img);
+			return;
+		}
+
+		if (l.block_rows == 0)
+			l.block_y0 = y;
+		memcpy(&l.block[(uptr)l.block_rows * l.size.x], row, l.size.x * sizeof(rgba8));
+		l.block_rows++;
+
+		if (l.block_rows == ORIENT_TILE || y +1 == l.row1) {
+			write_rows_oriented(l.block.data(), l.size.x, l.block_y0, l.block_rows, l.size, mips->orientation, &img);
+			l.block_rows = 0;
+		}
+	}
+
+	// row y (top-down, of the whole level) of level i of this stream, row has levels[i].size.x pixels
+	void add_row (int i, int y, rgba8 const* row) {
+		auto& l = levels[i];
+
+		store_row(l, y, row);
+
+		if (i +1 == (int)levels.size())
+			return;
+		auto& next = levels[i +1];
+
+		rgba8 const* even;
+		if ((y & 1) == 0) {
+			memcpy(l.pending.data(), row, l.size.x * sizeof(rgba8));
+
+			if (y +1 < l.row1 || y / 2 >= next.row1)
+				return; // wait for the odd row (or it's the dropped last row of an odd height)
+			even = row; // single row level (height 1), filter the row with itself
+		} else {
+			even = l.pending.data();
+		}
+
+		// 2x2 box filter, the last column of odd widths is dropped like the last row, except for single column levels
+		rgba8* out = l.out_row.data();
+		for (int x=0; x<next.size.x; ++x) {
+			int x0 = x * 2;
+			int x1 = min(x0 +1, l.size.x -1);
+			for (int c=0; c<4; ++c) {
+				u32 sum = (u32)even[x0].arr[c] +even[x1].arr[c] +row[x0].arr[c] +row[x1].arr[c];
+				out[x].arr[c] = (u8)((sum +2) / 4);
+			}
+		}
+
+		add_row(i +1, y / 2, out);
+	}
+
+	// row y relative to the first row of this stream
+	void add_first_level_row (int y, rgba8 const* row) {
+		if (opaque) {
+			for (int x=0; x<levels[0].size.x; ++x)
+				opaque = opaque && row[x].w == 255;
+		}
+		add_row(0, levels[0].row0 +y, row);
+	}
+};
+
+/* Decoding huge images on multiple workers (see Worker_Helpers)
+	Jpegs with restart markers are decoded in horizontal bands of 2^PARALLEL_BAND_LEVELS rows, every band skips to its rows via the restart markers (see stbi_jpeg_restart_interval)
+	and streams its rows through its own Mip_Stream for the first PARALLEL_BAND_LEVELS levels, the rest is generated from the (small) last of those levels afterwards
+	Images that had to be decoded as a whole are split into the same bands
+	Pngs can not be split (inflate and the filters depend on everything before), so they only inflate on a second worker while this one unfilters
+*/
+constexpr uptr	PARALLEL_DECODE_MIN_PX = 16 * 1000 * 1000;
+constexpr int	PARALLEL_BAND_LEVELS = 9; // 512 row bands, a multiple of every jpeg MCU height
+
+static stbi_async make_stbi_async (Worker_Helpers* helpers) {
+	stbi_async async;
+	async.start = [] (void* user, void (*task) (void* arg), void* arg) -> void* {
+		return ((Worker_Helpers*)user)->try_run_async([=] () { task(arg); });
+	};
+	async.join = [] (void* user, void* handle) {
+		((Worker_Helpers*)user)->join((Worker_Helpers::Task*)handle);
+	};
+	async.user = helpers;
+	return async;
+}
+
+static void stream_row_cb (void* user, int y, stbi_uc const* rgba) {
+	((Mip_Stream*)user)->add_first_level_row(y, (rgba8 const*)rgba);
+}
+
+// stream bands of 2^PARALLEL_BAND_LEVELS rows through their own Mip_Streams in parallel, then generate the rest of the levels from the last level of the bands
+// feed_band(Mip_Stream* stream, int y0, int y1) passes the rows [y0,y1) of level 0 via add_first_level_row and returns a stbi_decode_region result
+template <typename FEED_BAND>
+int generate_mips_in_bands (Mip_Levels* levels, Worker_Helpers* helpers, bool* opaque, FEED_BAND feed_band) {
+	iv2 size = levels->sizes[0];
+	int last = (int)levels->sizes.size() -1;
+	int band_levels = min(PARALLEL_BAND_LEVELS, last);
+	int band_rows = 1 << PARALLEL_BAND_LEVELS;
+	int bands = (size.y +band_rows -1) / band_rows;
+
+	// the rest of the levels are generated from this one
+	levels->source_copy_level = band_levels;
+	levels->source_copy = Image2D::allocate(levels->sizes[band_levels]);
+
+	std::vector<int> results (bands);
+	std::vector<char> band_opaque (bands);
+
+	helpers->parallel_for(bands, [&] (int b) {
+		TRACE_SCOPE("mips band");
+
+		int y0 = b * band_rows;
+		int y1 = min(y0 +band_rows, size.y);
+
+		Mip_Stream stream (levels, 0, band_levels, y0, y1);
+		results[b] = feed_band(&stream, y0, y1);
+		band_opaque[b] = stream.opaque;
+	});
+
+	for (int b=0; b<bands; ++b) {
+		if (results[b] != STBI_REGION_OK)
+			return results[b];
+	}
+
+	*opaque = true;
+	for (int b=0; b<bands; ++b)
+		*opaque = *opaque && band_opaque[b];
+
+	auto& src = levels->source_copy;
+	Mip_Stream stream (levels, band_levels, last, 0, src.size.y);
+	for (int y=0; y<src.size.y; ++y)
+		stream.add_row(0, y, &src.pixels[(uptr)(src.size.y -1 -y) * src.size.x]);
+
+	levels->source_copy_level = -1;
+	levels->source_copy = Image2D();
+	return STBI_REGION_OK;
+}
+
+bool use_bands (iv2 size, Worker_Helpers* helpers) {
+	return helpers && (uptr)size.x * (uptr)size.y >= PARALLEL_DECODE_MIN_PX && size.y > (1 << PARALLEL_BAND_LEVELS);
+}
+
+// generate the lowest keep_count mips (rotated/flipped by orientation) of an image that was decoded as a whole (see Image2D::decode_from_memory_top_down)
+// the flip to bottom-up happens where the rows are stored, so it costs no extra pass
+std::vector<Image2D> generate_mips_from_image (Image2D const& top_down, int keep_count, orientation_e orientation, bool* opaque, Worker_Helpers* helpers=nullptr) {
+	TRACE_SCOPE("generate_mips_from_image");
+
+	Mip_Levels levels (top_down.size, keep_count, orientation);
+
+	auto feed_band = [&] (Mip_Stream* stream, int y0, int y1) {
+		for (int y=y0; y<y1; ++y)
+			stream->add_first_level_row(y -y0, &top_down.pixels[(uptr)y * top_down.size.x]);
+		return STBI_REGION_OK;
+	};
+
+	if (use_bands(top_down.size, helpers)) {
+		generate_mips_in_bands(&levels, helpers, opaque, feed_band);
+	} else {
+		Mip_Stream stream (&levels, 0, (int)levels.sizes.size() -1, 0, top_down.size.y);
+		feed_band(&stream, 0, top_down.size.y);
+		*opaque = stream.opaque;
+	}
+
+	return levels.get_mips();
+}
+
+// decode the file and generate its lowest keep_count mips (rotated/flipped by orientation) while decoding, false if the decoder can not stream the format (progressive jpeg, interlaced png)
+// full_size_px: oriented size of the image in the file, which the mips are the lowest of (the file might have changed since its size was probed)
+// huge images use idle workers of helpers (if not null)
+bool decode_mips_streaming (std::vector<byte> const& file_data, strcr filepath, int keep_count, orientation_e orientation, std::vector<Image2D>* mips, bool* opaque, iv2* full_size_px, Worker_Helpers* helpers=nullptr) {
+	TRACE_SCOPE("decode_mips_streaming");
+
+	iv2 size;
+	int n;
+	if (!stbi_info_from_memory(file_data.data(), (int)file_data.size(), &size.x,&size.y, &n))
+		throw Expt_File_Load_Fail(filepath);
+
+	*full_size_px = orient_size(size, orientation);
+
+	Mip_Levels levels (size, keep_count, orientation);
+
+	bool parallel = helpers && (uptr)size.x * (uptr)size.y >= PARALLEL_DECODE_MIN_PX;
+
+	// bands of jpegs only help if every band has restart markers to skip to (MCUs are at most 16x16 px)
+	int restart_interval = parallel ? stbi_jpeg_restart_interval(file_data.data(), (int)file_data.size()) : 0;
+	bool bands = use_bands(size, helpers) && restart_interval > 0 && restart_interval <= size.x / 16 * ((1 << PARALLEL_BAND_LEVELS) / 16);
+
+	int res;
+	if (bands) {
+		TRACE_SCOPE("decode in bands");
+		res = generate_mips_in_bands(&levels, helpers, opaque, [&] (Mip_Stream* stream, int y0, int y1) {
+			return stbi_decode_region(file_data.data(), (int)file_data.size(), 0,y0, size.x,y1, stream_row_cb, stream);
+		});
+	} else {
+		Mip_Stream stream (&levels, 0, (int)levels.sizes.size() -1, 0, size.y);
+
+		auto async = make_stbi_async(helpers);
+		res = stbi_decode_region_async(file_data.data(), (int)file_data.size(), 0,0, size.x,size.y, stream_row_cb, &stream, parallel ? &async : nullptr);
+		*opaque = stream.opaque;
+	}
+
+	if (res == STBI_REGION_UNSUPPORTED)
+		return false;
+	if (res != STBI_REGION_OK)
+		throw Expt_File_Load_Fail(filepath);
+
+	*mips = levels.get_mips();
+	return true;
+}
@@ -14,6 +14,21 @@ typedef std::string const& strcr;
 #include "vector_util.hpp"
 
 #include "colors.hpp"
+#include "tracing.hpp"
+
+// our glad only has core 3.3, these are from EXT_texture_compression_s3tc and ARB_texture_compression_bptc
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT		0x83F0
+#define GL_COMPRESSED_RGBA_BPTC_UNORM_ARB	0x8E8C
+
+bool gl_has_extension (cstr name) {
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i=0; i<count; ++i) {
+		if (strcmp((cstr)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+			return true;
+	}
+	return false;
+}
 
 class Texture2D {
 	friend void bind_texture (int tet_unit, Texture2D const& tex);
@@ -76,7 +91,23 @@ public:
 
 		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-		glTexImage2D(GL_TEXTURE_2D, mip, GL_RGBA8, size_px.x,size_px.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+		{
+			TRACE_SCOPE("glTexImage2D");
+			glTexImage2D(GL_TEXTURE_2D, mip, GL_RGBA8, size_px.x,size_px.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+		}
+
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+	// data are 4x4 blocks in a GL_COMPRESSED_* internal_format
+	void upload_compressed_mipmap (int mip, GLenum internal_format, void const* data, uptr data_size, iv2 size_px) {
+		this->size_px = -1;
+
+		glBindTexture(GL_TEXTURE_2D, gpu_handle);
+
+		{
+			TRACE_SCOPE("glCompressedTexImage2D");
+			glCompressedTexImage2D(GL_TEXTURE_2D, mip, internal_format, size_px.x,size_px.y, 0, (GLsizei)data_size, data);
+		}
 
 		glBindTexture(GL_TEXTURE_2D, 0);
 	}
@@ -0,0 +1,554 @@
+#pragma once
+
+#include <vector>
+
+#include "basic_typedefs.hpp"
+#include "math.hpp"
+#include "vector_util.hpp"
+#include "colors.hpp"
+
+#include "image.hpp"
+#include "tracing.hpp"
+
+/* Block compression of mips on the loader threads, so that the gpu memory and the upload bandwidth of a mip is 4x (BC7) or 8x (BC1) smaller than RGBA8
+	BC1:	8 bytes per 4x4 block, rgb only (we only use it for opaque mips), very fast to encode, used for thumbnails or everything in TC_FAST mode
+	BC7:	16 bytes per 4x4 block, rgba, we only encode mode 6 (single subset, 7bit endpoints + pbit, 4bit indices) which is still a lot better than BC1
+
+	Both encoders work on one block at a time with plain loops over the 16 pixels, written so the compiler can vectorize them (no intrinsics to keep it portable)
+*/
+
+enum texture_format_e {
+	TF_RGBA8 =0,
+	TF_BC1,
+	TF_BC7,
+};
+static cstr texture_format_e_str[] = { "RGBA8", "BC1", "BC7" };
+
+enum texture_compression_e {
+	TC_NONE =0,
+	TC_FAST,		// BC1 for everything opaque
+	TC_QUALITY,		// BC1 for small opaque images, BC7 for bigger images and images with alpha
+};
+static cstr texture_compression_e_str[] = { "TC_NONE", "TC_FAST", "TC_QUALITY" };
+
+constexpr int COMPRESSION_THUMBNAIL_SIZE = 256; // images where both sides are <= this are considered thumbnails
+
+// one format for all mips of a texture, gl considers a texture with different internal formats per level incomplete (samples as black)
+// so this is decided by the size of the full image, never by the size of the single mip
+texture_format_e choose_texture_format (texture_compression_e mode, iv2 full_size_px, bool opaque) {
+	switch (mode) {
+		case TC_FAST:		return opaque ? TF_BC1 : TF_RGBA8;
+		case TC_QUALITY: {
+			bool thumbnail = all(full_size_px <= COMPRESSION_THUMBNAIL_SIZE);
+			return thumbnail && opaque ? TF_BC1 : TF_BC7;
+		}
+		default:			return TF_RGBA8;
+	}
+}
+
+uptr calc_texture_memory_size (texture_format_e format, iv2 size_px) {
+	uptr blocks = (uptr)((size_px.x +3) / 4) * (uptr)((size_px.y +3) / 4);
+	switch (format) {
+		case TF_BC1:		return blocks * 8;
+		case TF_BC7:		return blocks * 16;
+		default:			return (uptr)size_px.x * (uptr)size_px.y * sizeof(rgba8);
+	}
+}
+
+// pixel data of one mip in the format it will be uploaded as
+struct Mip_Image {
+	texture_format_e	format = TF_RGBA8;
+	Image2D				rgba;	// format == TF_RGBA8
+	std::vector<u8>		blocks;	// format == TF_BC1 or TF_BC7, 4x4 blocks in row order (same row order as the rgba pixels)
+	iv2					size = 0;
+
+	uptr get_memory_size () const {
+		return calc_texture_memory_size(format, size);
+	}
+};
+
+bool is_opaque (Image2D const& img) {
+	uptr count = (uptr)img.size.x * (uptr)img.size.y;
+	u8 min_alpha = 255;
+	for (uptr i=0; i<count; ++i)
+		min_alpha = img.pixels[i].w < min_alpha ? img.pixels[i].w : min_alpha;
+	return min_alpha == 255;
+}
+
+//
+static void load_block (Image2D const& img, int bx, int by, u8 block[16][4]) {
+	for (int y=0; y<4; ++y) {
+		int py = min(by*4 +y, img.size.y -1); // replicate edge pixels for partial blocks
+		for (int x=0; x<4; ++x) {
+			int px = min(bx*4 +x, img.size.x -1);
+			rgba8 c = img.get_pixel(px, py);
+			block[y*4 +x][0] = c.x;
+			block[y*4 +x][1] = c.y;
+			block[y*4 +x][2] = c.z;
+			block[y*4 +x][3] = c.w;
+		}
+	}
+}
+
+// principal axis of the block colors (channels = 3 or 4) via a few power iterations on the covariance matrix
+static void block_principal_axis (u8 const block[16][4], int channels, f32 mean[4], f32 axis[4]) {
+	for (int c=0; c<4; ++c) mean[c] = 0;
+	for (int i=0; i<16; ++i)
+		for (int c=0; c<channels; ++c)
+			mean[c] += block[i][c];
+	for (int c=0; c<channels; ++c) mean[c] /= 16;
+
+	f32 cov[4][4] = {};
+	for (int i=0; i<16; ++i) {
+		f32 d[4] = {};
+		for (int c=0; c<channels; ++c) d[c] = block[i][c] -mean[c];
+		for (int a=0; a<channels; ++a)
+			for (int b=0; b<channels; ++b)
+				cov[a][b] += d[a] * d[b];
+	}
+
+	for (int c=0; c<4; ++c) axis[c] = c < channels ? 1.0f : 0;
+	for (int iter=0; iter<4; ++iter) {
+		f32 v[4] = {};
+		for (int a=0; a<channels; ++a)
+			for (int b=0; b<channels; ++b)
+				v[a] += cov[a][b] * axis[b];
+
+		f32 len = 0;
+		for (int c=0; c<channels; ++c) len = max(len, abs(v[c]));
+		if (len < 1e-6f)
+			break; // all pixels the same color, any axis works
+		for (int c=0; c<channels; ++c) axis[c] = v[c] / len;
+	}
+}
+
+//// BC1
+static u16 pack_565 (f32 r, f32 g, f32 b) {
+	int ri = clamp((int)(r * 31 / 255 +0.5f), 0, 31);
+	int gi = clamp((int)(g * 63 / 255 +0.5f), 0, 63);
+	int bi = clamp((int)(b * 31 / 255 +0.5f), 0, 31);
+	return (u16)((ri << 11) | (gi << 5) | bi);
+}
+static void unpack_565 (u16 c, int out[3]) {
+	int r = (c >> 11) & 31;
+	int g = (c >> 5) & 63;
+	int b = c & 31;
+	out[0] = (r << 3) | (r >> 2);
+	out[1] = (g << 2) | (g >> 4);
+	out[2] = (b << 3) | (b >> 2);
+}
+
+static void bc1_palette (u16 c0, u16 c1, int pal[4][3]) {
+	unpack_565(c0, pal[0]);
+	unpack_565(c1, pal[1]);
+	for (int c=0; c<3; ++c) {
+		pal[2][c] = (2*pal[0][c] +pal[1][c]) / 3;
+		pal[3][c] = (pal[0][c] +2*pal[1][c]) / 3;
+	}
+}
+
+// returns total squared error
+static int bc1_find_indices (u8 const block[16][4], u16 c0, u16 c1, u8 indices[16]) {
+	int pal[4][3];
+	bc1_palette(c0, c1, pal);
+
+	int total_err = 0;
+	for (int i=0; i<16; ++i) {
+		int best = 0, best_err = INT_MAX;
+		for (int p=0; p<4; ++p) {
+			int dr = block[i][0] -pal[p][0];
+			int dg = block[i][1] -pal[p][1];
+			int db = block[i][2] -pal[p][2];
+			int err = dr*dr +dg*dg +db*db;
+			if (err < best_err) { best_err = err; best = p; }
+		}
+		indices[i] = (u8)best;
+		total_err += best_err;
+	}
+	return total_err;
+}
+
+// least squares fit of the two endpoints given the current indices
+static bool bc1_refine_endpoints (u8 const block[16][4], u8 const indices[16], u16* c0, u16* c1) {
+	static const f32 w1_of_index[4] = { 0, 1, 1.0f/3, 2.0f/3 }; // weight of endpoint 1 for palette index
+
+	f32 aa = 0, bb = 0, ab = 0;
+	f32 ax[3] = {}, bx[3] = {};
+	for (int i=0; i<16; ++i) {
+		f32 b = w1_of_index[indices[i]];
+		f32 a = 1 -b;
+		aa += a*a; bb += b*b; ab += a*b;
+		for (int c=0; c<3; ++c) {
+			ax[c] += a * block[i][c];
+			bx[c] += b * block[i][c];
+		}
+	}
+
+	f32 det = aa*bb -ab*ab;
+	if (abs(det) < 1e-6f)
+		return false;
+
+	f32 e0[3], e1[3];
+	for (int c=0; c<3; ++c) {
+		e0[c] = (ax[c]*bb -bx[c]*ab) / det;
+		e1[c] = (bx[c]*aa -ax[c]*ab) / det;
+	}
+	*c0 = pack_565(e0[0],e0[1],e0[2]);
+	*c1 = pack_565(e1[0],e1[1],e1[2]);
+	return true;
+}
+
+static void bc1_encode_block (u8 const block[16][4], u8 out[8]) {
+	f32 mean[4], axis[4];
+	block_principal_axis(block, 3, mean, axis);
+
+	// extremes along the axis
+	f32 min_t = +INF, max_t = -INF;
+	for (int i=0; i<16; ++i) {
+		f32 t = 0;
+		for (int c=0; c<3; ++c) t += (block[i][c] -mean[c]) * axis[c];
+		min_t = min(min_t, t);
+		max_t = max(max_t, t);
+	}
+	f32 axis_len2 = axis[0]*axis[0] +axis[1]*axis[1] +axis[2]*axis[2];
+	if (axis_len2 > 0) {
+		min_t /= axis_len2;
+		max_t /= axis_len2;
+	}
+
+	u16 c0 = pack_565(mean[0] +axis[0]*max_t, mean[1] +axis[1]*max_t, mean[2] +axis[2]*max_t);
+	u16 c1 = pack_565(mean[0] +axis[0]*min_t, mean[1] +axis[1]*min_t, mean[2] +axis[2]*min_t);
+
+	u8 indices[16];
+	int err = bc1_find_indices(block, c0, c1, indices);
+
+	{ // one refinement step, keep it only if it is better
+		u16 r0, r1;
+		u8 r_indices[16];
+		if (bc1_refine_endpoints(block, indices, &r0, &r1)) {
+			int r_err = bc1_find_indices(block, r0, r1, r_indices);
+			if (r_err < err) {
+				err = r_err;
+				c0 = r0; c1 = r1;
+				memcpy(indices, r_indices, 16);
+			}
+		}
+	}
+
+	// c0 > c1 selects the 4 color mode, c0 == c1 would be the 3 color mode, but then all indices are 0 anyway
+	if (c0 < c1) {
+		std::swap(c0, c1);
+		static const u8 swap_index[4] = { 1, 0, 3, 2 };
+		for (int i=0; i<16; ++i) indices[i] = swap_index[indices[i]];
+	}
+	if (c0 == c1) {
+		for (int i=0; i<16; ++i) indices[i] = 0;
+	}
+
+	u32 bits = 0;
+	for (int i=0; i<16; ++i)
+		bits |= (u32)indices[i] << (i*2);
+
+	out[0] = (u8)(c0 & 0xff);	out[1] = (u8)(c0 >> 8);
+	out[2] = (u8)(c1 & 0xff);	out[3] = (u8)(c1 >> 8);
+	out[4] = (u8)(bits);		out[5] = (u8)(bits >> 8);
+	out[6] = (u8)(bits >> 16);	out[7] = (u8)(bits >> 24);
+}
+
+static void bc1_decode_block (u8 const in[8], u8 block[16][4]) {
+	u16 c0 = (u16)(in[0] | (in[1] << 8));
+	u16 c1 = (u16)(in[2] | (in[3] << 8));
+	u32 bits = (u32)in[4] | ((u32)in[5] << 8) | ((u32)in[6] << 16) | ((u32)in[7] << 24);
+
+	int pal[4][3];
+	bc1_palette(c0, c1, pal);
+	if (c0 <= c1) { // 3 color mode
+		for (int c=0; c<3; ++c) {
+			pal[2][c] = (pal[0][c] +pal[1][c]) / 2;
+			pal[3][c] = 0;
+		}
+	}
+	for (int i=0; i<16; ++i) {
+		int p = (bits >> (i*2)) & 3;
+		for (int c=0; c<3; ++c) block[i][c] = (u8)pal[p][c];
+		block[i][3] = 255;
+	}
+}
+
+//// BC7 mode 6
+static const int bc7_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct Bc7_Mode6_Endpoints {
+	u8	e[2][4]; // 7 bit per channel
+	u8	p[2]; // pbits
+
+	int get (int endpoint, int channel) const { return (e[endpoint][channel] << 1) | p[endpoint]; }
+};
+
+// quantize a float rgba endpoint to 7 bits + pbit, trying both pbits
+static void bc7_quantize_endpoint (f32 const val[4], u8 e[4], u8* p) {
+	int best_err = INT_MAX;
+	for (int pbit=0; pbit<2; ++pbit) {
+		u8 tmp[4];
+		int err = 0;
+		for (int c=0; c<4; ++c) {
+			int q = clamp((int)((val[c] -pbit) / 2 +0.5f), 0, 127);
+			tmp[c] = (u8)q;
+			int d = (int)(val[c] +0.5f) -((q << 1) | pbit);
+			err += d*d;
+		}
+		if (err < best_err) {
+			best_err = err;
+			memcpy(e, tmp, 4);
+			*p = (u8)pbit;
+		}
+	}
+}
+
+static int bc7_find_indices (u8 const block[16][4], Bc7_Mode6_Endpoints const& ep, u8 indices[16]) {
+	int pal[16][4];
+	for (int i=0; i<16; ++i)
+		for (int c=0; c<4; ++c)
+			pal[i][c] = ((64 -bc7_weights4[i]) * ep.get(0,c) +bc7_weights4[i] * ep.get(1,c) +32) >> 6;
+
+	// project onto the endpoint line to get a first guess and only check the neighbouring indices instead of all 16
+	f32 dir[4];
+	f32 dir_len2 = 0;
+	for (int c=0; c<4; ++c) {
+		dir[c] = (f32)(pal[15][c] -pal[0][c]);
+		dir_len2 += dir[c]*dir[c];
+	}
+	f32 inv_dir_len2 = dir_len2 > 0 ? 1.0f / dir_len2 : 0;
+
+	int total_err = 0;
+	for (int i=0; i<16; ++i) {
+		f32 t = 0;
+		for (int c=0; c<4; ++c) t += (block[i][c] -pal[0][c]) * dir[c];
+		t *= inv_dir_len2;
+
+		int guess = clamp((int)(t * 15 +0.5f), 0, 15);
+
+		int best = 0, best_err = INT_MAX;
+		for (int p=max(guess -1, 0); p<=min(guess +1, 15); ++p) {
+			int err = 0;
+			for (int c=0; c<4; ++c) {
+				int d = block[i][c] -pal[p][c];
+				err += d*d;
+			}
+			if (err < best_err) { best_err = err; best = p; }
+		}
+		indices[i] = (u8)best;
+		total_err += best_err;
+	}
+	return total_err;
+}
+
+static bool bc7_refine_endpoints (u8 const block[16][4], u8 const indices[16], Bc7_Mode6_Endpoints* ep) {
+	f32 aa = 0, bb = 0, ab = 0;
+	f32 ax[4] = {}, bx[4] = {};
+	for (int i=0; i<16; ++i) {
+		f32 b = (f32)bc7_weights4[indices[i]] / 64;
+		f32 a = 1 -b;
+		aa += a*a; bb += b*b; ab += a*b;
+		for (int c=0; c<4; ++c) {
+			ax[c] += a * block[i][c];
+			bx[c] += b * block[i][c];
+		}
+	}
+
+	f32 det = aa*bb -ab*ab;
+	if (abs(det) < 1e-6f)
+		return false;
+
+	f32 e0[4], e1[4];
+	for (int c=0; c<4; ++c) {
+		e0[c] = clamp((ax[c]*bb -bx[c]*ab) / det, 0.0f, 255.0f);
+		e1[c] = clamp((bx[c]*aa -ax[c]*ab) / det, 0.0f, 255.0f);
+	}
+	bc7_quantize_endpoint(e0, ep->e[0], &ep->p[0]);
+	bc7_quantize_endpoint(e1, ep->e[1], &ep->p[1]);
+	return true;
+}
+
+struct Bit_Writer_128 {
+	u64		lo = 0, hi = 0;
+	int		pos = 0;
+
+	void write (u32 val, int bits) {
+		for (int i=0; i<bits; ++i, ++pos) {
+			u64 bit = (val >> i) & 1;
+			if (pos < 64)	lo |= bit << pos;
+			else			hi |= bit << (pos -64);
+		}
+	}
+};
+struct Bit_Reader_128 {
+	u64		lo, hi;
+	int		pos = 0;
+
+	u32 read (int bits) {
+		u32 val = 0;
+		for (int i=0; i<bits; ++i, ++pos) {
+			u64 bit = pos < 64 ? (lo >> pos) & 1 : (hi >> (pos -64)) & 1;
+			val |= (u32)bit << i;
+		}
+		return val;
+	}
+};
+
+static void bc7_encode_block (u8 const block[16][4], u8 out[16]) {
+	f32 mean[4], axis[4];
+	block_principal_axis(block, 4, mean, axis);
+
+	f32 min_t = +INF, max_t = -INF;
+	for (int i=0; i<16; ++i) {
+		f32 t = 0;
+		for (int c=0; c<4; ++c) t += (block[i][c] -mean[c]) * axis[c];
+		min_t = min(min_t, t);
+		max_t = max(max_t, t);
+	}
+	f32 axis_len2 = axis[0]*axis[0] +axis[1]*axis[1] +axis[2]*axis[2] +axis[3]*axis[3];
+	if (axis_len2 > 0) {
+		min_t /= axis_len2;
+		max_t /= axis_len2;
+	}
+
+	Bc7_Mode6_Endpoints ep;
+	{
+		f32 e0[4], e1[4];
+		for (int c=0; c<4; ++c) {
+			e0[c] = clamp(mean[c] +axis[c]*min_t, 0.0f, 255.0f);
+			e1[c] = clamp(mean[c] +axis[c]*max_t, 0.0f, 255.0f);
+		}
+		bc7_quantize_endpoint(e0, ep.e[0], &ep.p[0]);
+		bc7_quantize_endpoint(e1, ep.e[1], &ep.p[1]);
+	}
+
+	u8 indices[16];
+	int err = bc7_find_indices(block, ep, indices);
+
+	for (int iter=0; iter<2 && err > 0; ++iter) {
+		Bc7_Mode6_Endpoints r_ep = ep;
+		u8 r_indices[16];
+		if (!bc7_refine_endpoints(block, indices, &r_ep))
+			break;
+		int r_err = bc7_find_indices(block, r_ep, r_indices);
+		if (r_err >= err)
+			break;
+		err = r_err;
+		ep = r_ep;
+		memcpy(indices, r_indices, 16);
+	}
+
+	// the msb of the first index is implicit 0, swap the endpoints if needed
+	if (indices[0] & 8) {
+		for (int c=0; c<4; ++c) std::swap(ep.e[0][c], ep.e[1][c]);
+		std::swap(ep.p[0], ep.p[1]);
+		for (int i=0; i<16; ++i) indices[i] = (u8)(15 -indices[i]);
+	}
+
+	Bit_Writer_128 w;
+	w.write(1 << 6, 7); // mode 6
+	for (int c=0; c<4; ++c) {
+		w.write(ep.e[0][c], 7);
+		w.write(ep.e[1][c], 7);
+	}
+	w.write(ep.p[0], 1);
+	w.write(ep.p[1], 1);
+	w.write(indices[0], 3);
+	for (int i=1; i<16; ++i)
+		w.write(indices[i], 4);
+	assert(w.pos == 128);
+
+	memcpy(out +0, &w.lo, 8);
+	memcpy(out +8, &w.hi, 8);
+}
+
+// only decodes mode 6 (all we encode), used by the quality benchmark
+static void bc7_decode_block (u8 const in[16], u8 block[16][4]) {
+	Bit_Reader_128 r;
+	memcpy(&r.lo, in +0, 8);
+	memcpy(&r.hi, in +8, 8);
+
+	if (r.read(7) != (1 << 6)) {
+		memset(block, 0, 16*4);
+		return;
+	}
+
+	Bc7_Mode6_Endpoints ep;
+	for (int c=0; c<4; ++c) {
+		ep.e[0][c] = (u8)r.read(7);
+		ep.e[1][c] = (u8)r.read(7);
+	}
+	ep.p[0] = (u8)r.read(1);
+	ep.p[1] = (u8)r.read(1);
+
+	for (int i=0; i<16; ++i) {
+		int indx = r.read(i == 0 ? 3 : 4);
+		for (int c=0; c<4; ++c)
+			block[i][c] = (u8)(((64 -bc7_weights4[indx]) * ep.get(0,c) +bc7_weights4[indx] * ep.get(1,c) +32) >> 6);
+	}
+}
+
+//
+Mip_Image compress_mip (Image2D&& img, texture_format_e format) {
+	Mip_Image mip;
+	mip.format = format;
+	mip.size = img.size;
+
+	if (format == TF_RGBA8) {
+		mip.rgba = std::move(img);
+		return mip;
+	}
+
+	TRACE_SCOPE("compress_mip");
+
+	int block_bytes = format == TF_BC1 ? 8 : 16;
+	iv2 blocks = (img.size +3) / 4;
+
+	mip.blocks.resize((uptr)blocks.x * (uptr)blocks.y * block_bytes);
+
+	u8 block[16][4];
+	for (int by=0; by<blocks.y; ++by) {
+		for (int bx=0; bx<blocks.x; ++bx) {
+			u8* out = &mip.blocks[((uptr)by * blocks.x +bx) * block_bytes];
+
+			load_block(img, bx,by, block);
+
+			if (format == TF_BC1)	bc1_encode_block(block, out);
+			else					bc7_encode_block(block, out);
+		}
+	}
+
+	return mip;
+}
+
+// decompress back to rgba8 (for measuring quality)
+Image2D decompress_mip (Mip_Image const& mip) {
+	if (mip.format == TF_RGBA8)
+		return Image2D::copy_from(mip.rgba.pixels, mip.rgba.size);
+
+	auto img = Image2D::allocate(mip.size);
+
+	int block_bytes = mip.format == TF_BC1 ? 8 : 16;
+	iv2 blocks = (mip.size +3) / 4;
+
+	u8 block[16][4];
+	for (int by=0; by<blocks.y; ++by) {
+		for (int bx=0; bx<blocks.x; ++bx) {
+			u8 const* in = &mip.blocks[((uptr)by * blocks.x +bx) * block_bytes];
+
+			if (mip.format == TF_BC1)	bc1_decode_block(in, block);
+			else						bc7_decode_block(in, block);
+
+			for (int y=0; y<4; ++y) {
+				for (int x=0; x<4; ++x) {
+					iv2 p = iv2(bx*4 +x, by*4 +y);
+					if (all(p < mip.size))
+						img.get_pixel(p) = rgba8(block[y*4+x][0], block[y*4+x][1], block[y*4+x][2], block[y*4+x][3]);
+				}
+			}
+		}
+	}
+	return img;
+}
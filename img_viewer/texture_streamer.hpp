@@ -6,6 +6,17 @@
 #include <vector>
 #include <algorithm>
 
+#include "histogram.hpp"
+#include "texture_compression.hpp"
+#include "tiled_texture.hpp"
+#include "exif_thumbnail.hpp"
+#include "streaming_mips.hpp"
+#include "animated_gif.hpp"
+#include "thumbnail_provider.hpp"
+#include "content_model.hpp"
+#include "image_index.hpp"
+#include "texture_uploader.hpp"
+
 template <typename T, typename COMPARE=std::less<T> >
 struct sorted_vector {
 	typedef typename std::vector<T>::iterator       iterator;
@@ -85,6 +96,14 @@ struct sorted_vector {
 };
 
 
+enum thumbnail_state_e {
+	THUMB_UNKNOWN=0,	// not tried yet (or not a jpeg)
+	THUMB_QUEUED,		// thumbnail job queued
+	THUMB_NONE,			// file has no usable thumbnail
+	THUMB_LOADED,		// thumbnail_mips were filled from the thumbnail
+};
+static cstr thumbnail_state_e_str[] = { "THUMB_UNKNOWN", "THUMB_QUEUED", "THUMB_NONE", "THUMB_LOADED" };
+
 // Once this is somewhat reuseable, document this system (and make sure all includes are present)
 
 struct Texture_Streamer {
@@ -111,6 +130,8 @@ struct Texture_Streamer {
 		}
 	}
 	static std::vector<Image2D> generate_mipmaps (Image2D&& full_size) { // mips in smallest to biggest order
+		TRACE_SCOPE("generate_mipmaps");
+
 		std::vector<Image2D> mips;
 		find_mipmap_sizes_px(full_size.size, [&] (int i, iv2 size_px) {
 				mips.emplace(mips.begin());
@@ -130,8 +151,13 @@ struct Texture_Streamer {
 
 	struct Cached_Texture {
 		string					filepath;
+		u32						id = 0; // for Texture_Handle
 		
 		unique_ptr<Texture2D>	tex = nullptr; // gpu texture object, where we are trying to stream the texture into
+		int						tex_mips = 0; // lowest mips in tex, lags behind cached_mips until the upload thread has the new texture object ready
+		uptr					tex_memory_size = 0; // gpu memory of tex, counted until tex is actually replaced (see texture_memory_size_used)
+		u64						upload_generation = 0; // of the last update of the texture object, uploads of older ones are dropped (see poll_uploads)
+		rgba8					avg_col = 0; // from the last result with pixels, the grid keeps it in the Content_Model for the placeholder, a == 0: not known yet
 		
 		int						cached_mips = 0;
 		int						desired_cached_mips = 0;
@@ -140,20 +166,39 @@ struct Texture_Streamer {
 
 		bool					was_queried = false; // so we only evict textures if none of their mips are cached anymore and they are not queried for one frame (this prevents textures being added and then removed every single frame)
 		bool					threadpool_job_queued = false;
+		u64						mip_job_generation = 0; // of the queued mip job, results of any other job are stale (see next_job_generation)
+
+		// preview of jpegs from the embedded exif thumbnail or the first scans of progressive ones, loaded with a thumbnail job that runs before the full decodes and fills the lowest mips
+		thumbnail_state_e		thumbnail_state = THUMB_UNKNOWN;
+		int						thumbnail_mips = 0; // how many of the lowest mips the thumbnail fills
+		u64						thumbnail_job_generation = 0; // of the queued thumbnail job
+		bool					needs_full_decode = false; // desired mips are more than the thumbnail can fill at the current zoom, recalculated every frame
 
 		struct Mipmap {
-			iv2					size_px;
-			unique_ptr<Image2D>	img = nullptr; // cpu copy of image data, since opengl does not allow evicting mipmaps (only whole texture via glDeleteTextures)
-			flt					priority = +INF; // highest [0, +inf] lowest
+			iv2						size_px;
+			std::shared_ptr<Mip_Image const>	img = nullptr; // cpu copy of image data, since opengl does not allow evicting mipmaps (only whole texture via glDeleteTextures), shared with a running upload
+			flt						priority = +INF; // highest [0, +inf] lowest
+			texture_format_e		format = TF_RGBA8; // format we expect the mip to be cached in (for the memory budget), the loader thread decides the actual one (only it knows if the image has alpha)
 
 			uptr get_memory_size () const {
-				return (uptr)size_px.y * (uptr)size_px.x * sizeof(rgba8);
+				return img ? img->get_memory_size() : calc_texture_memory_size(format, size_px);
 			}
 		};
 		std::vector<Mipmap>		mips;
 
 		bool					debug_is_highlighted = false;
 
+		// timestamps (glfwGetTime) for latency tracking, -1 == did not happen (yet)
+		struct Latency_Timestamps {
+			f64					blurry_since = -1; // first query() or the frame it got blurry again (eg. by zooming), -1 while sharp
+			f64					job_enqueue = -1;
+			f64					job_dequeue = -1;
+			f64					decode_end = -1;
+			f64					result_pop = -1;
+			f64					upload_done = -1;
+		};
+		Latency_Timestamps		latency;
+
 		void imgui () {
 			if (tex)
 				ImGui::Value("tex.gpu_handle", tex->get_gpu_handle());
@@ -161,12 +206,20 @@ struct Texture_Streamer {
 				ImGui::Text("<null>");
 
 			ImGui::Value("cached_mips", cached_mips);
+			ImGui::Value("tex_mips", tex_mips);
 			ImGui::Value("desired_cached_mips", desired_cached_mips);
 
 			ImGui::Value("order_priority", order_priority);
 
 			ImGui::Value("was_queried", was_queried);
 			ImGui::Value("threadpool_job_queried", threadpool_job_queued);
+			ImGui::Text("mip_job_generation: %llu", (unsigned long long)mip_job_generation);
+
+			ImGui::Text("thumbnail_state: %s", thumbnail_state_e_str[thumbnail_state]);
+			ImGui::Value("thumbnail_mips", thumbnail_mips);
+			ImGui::Value("needs_full_decode", needs_full_decode);
+
+			ImGui::Value("blurry_since", (flt)latency.blurry_since);
 			
 			if (ImGui::TreeNode(prints("mips[%d]###mips", (int)mips.size()).c_str())) {
 				for (auto& m : mips) {
@@ -176,6 +229,9 @@ struct Texture_Streamer {
 					ImGui::SameLine();
 					ImGui::Text(m.img ? "cached":"null");
 
+					ImGui::SameLine();
+					ImGui::Text("%-5s", texture_format_e_str[m.img ? m.img->format : m.format]);
+
 					ImGui::SameLine();
 					ImGui::Text("%.3f", m.priority);
 
@@ -187,17 +243,21 @@ struct Texture_Streamer {
 		}
 
 		flt get_displayable_pixel_density (iv2 onscreen_size_px) const {
-			assert((cached_mips == 0) == (tex == nullptr));
+			assert((tex_mips == 0) == (tex == nullptr));
 			
-			if (cached_mips == 0)
+			if (tex_mips == 0)
 				return 0;
 
-			v2 px_dens = (v2)mips[cached_mips -1].size_px / (v2)onscreen_size_px;
+			v2 px_dens = (v2)mips[tex_mips -1].size_px / (v2)onscreen_size_px;
 			
 			return min(px_dens.x, px_dens.y);
 		}
 		bool all_mips_displayable () const {
-			return cached_mips == (int)mips.size();
+			return tex_mips == (int)mips.size();
+		}
+
+		iv2 get_full_size_px () const {
+			return mips.back().size_px;
 		}
 
 	};
@@ -205,12 +265,18 @@ struct Texture_Streamer {
 		inline bool operator() (Cached_Texture const& l,	Cached_Texture const& r) const {	return std::less<string>()(l.filepath, r.filepath); }
 		inline bool operator() (string const& l_filepath,	Cached_Texture const& r) const {	return std::less<string>()(l_filepath, r.filepath); }
 		inline bool operator() (Cached_Texture const& l,	string const& r_filepath) const {	return std::less<string>()(l.filepath, r_filepath); }
+		inline bool operator() (cstr l_filepath,			Cached_Texture const& r) const {	return strcmp(l_filepath, r.filepath.c_str()) < 0; }
+		inline bool operator() (Cached_Texture const& l,	cstr r_filepath) const {			return strcmp(l.filepath.c_str(), r_filepath) < 0; }
 	};
 
 	void imgui_texture_info (string const& filepath) {
 		auto* tex = find_texture(filepath);
 		if (tex)
 			tex->imgui();
+
+		auto* tiled = find_tiled_texture(filepath);
+		if (tiled)
+			tiled->imgui();
 	}
 
 	sorted_vector<Cached_Texture, Cached_Texture_Less>	textures; // key: filepath
@@ -218,52 +284,203 @@ struct Texture_Streamer {
 	uptr cache_memory_size_used = 0; // how many bytes of texture data we currently have cached (uploaded as textures or still cached in ram (waiting for upload), does not include temporary memory allocated by mip loader threads)
 	uptr cache_memory_size_desired = 500 * 1024*1024; // how many bytes of texture data we want at max to have uploaded
 
+	Image_Index* image_index = nullptr; // gets the signatures the loader threads compute, optional
+
+	u64 textures_resized = 0; // files that were loaded at another resolution than the texture was added with (see resize_texture)
+
 	Cached_Texture* find_texture (string const& filepath) {
 		auto it = textures.find(filepath);
 		return it != textures.end() ? &*it : nullptr;
 	}
 
+	u32 next_handle_id = 1; // ids of textures, tiled textures and gifs, never reused, so a handle can not find a different object that ended up in its slot
+
+	// usually the object is still in the slot of the handle, then this is a single integer compare instead of a binary search with a string compare per step
+	// inserts and removals shift the slots, a stale handle falls back to the search and gets updated
+	template <typename T, typename LESS>
+	static T* find_by_handle (sorted_vector<T, LESS>& vec, cstr filepath, Texture_Handle* h) {
+		if (h->slot < (u32)vec.size() && vec.v[h->slot].id == h->id)
+			return &vec.v[h->slot];
+
+		auto it = vec.find(filepath);
+		if (it == vec.end())
+			return nullptr;
+
+		h->slot = (u32)(it -vec.begin());
+		h->id = it->id;
+		return &*it;
+	}
+
 	Cached_Texture* add_texture (string filepath, iv2 full_size_px) {
 		
 		Cached_Texture tmp;
 		tmp.filepath = std::move(filepath);
+		tmp.id = next_handle_id++;
 
 		auto tex = textures.insert(std::move(tmp));
 		assert(tex != textures.end());
 
+		init_mips(&*tex, full_size_px);
+
+		return &*tex;
+	}
+
+	// the mip descriptors for an image of full_size_px, no mips may be cached
+	void init_mips (Cached_Texture* tex, iv2 full_size_px) {
+		assert(tex->cached_mips == 0);
+
+		auto format = choose_texture_format(texture_compression, full_size_px, true); // assume opaque, most images are
+
+		tex->mips.clear();
 		find_mipmap_sizes_px(full_size_px, [&] (int i, iv2 size_px) {
 				tex->mips.emplace( tex->mips.begin() );
 				tex->mips.front().size_px = size_px;
+				tex->mips.front().format = format;
 			});
+	}
 
-		return &*tex;
+	//// Texture objects
+	// created and filled on the upload thread (see texture_uploader.hpp), or on the main thread if it does not run
+	Texture_Uploader		uploader;
+	bool					async_uploads = true;
+
+	std::vector<Texture_Upload_Result>	pending_uploads; // finished by the upload thread, waiting for their fence
+	u64						stale_uploads_dropped = 0; // the texture was updated (or removed) again while it was uploaded
+	Sample_Histogram		upload_thread_ms = Sample_Histogram("upload thread");
+
+	// cache_memory_size_used counts the cpu mips, which the texture objects are made of, but an old texture object stays resident until the new one is uploaded,
+	// and the new one is allocated while the old one is still there, so the gpu memory of the texture objects is counted separately until they are actually dropped
+	// queries_end takes what is above the cpu mips off the budget
+	uptr					texture_memory_size_used = 0; // texture objects of the Cached_Textures
+	uptr					upload_memory_size_in_flight = 0; // UPLOAD_MIPS jobs pushed to the upload thread, until poll_uploads installs or drops their texture object
+
+	uptr get_texture_memory_overhang () const {
+		uptr gpu = texture_memory_size_used +upload_memory_size_in_flight;
+		return gpu > cache_memory_size_used ? gpu -cache_memory_size_used : 0;
+	}
+
+	// needs the gl context of share current, call once at startup
+	void init_uploader (GLFWwindow* share) {
+		uploader.start(share);
+	}
+	// before the gl context is destroyed
+	void stop_uploader () {
+		uploader.stop();
+
+		for (auto& u : pending_uploads)
+			glDeleteSync(u.fence);
+		pending_uploads.clear();
+		upload_memory_size_in_flight = 0;
+	}
+
+	bool uploads_async () const {
+		return async_uploads && uploader.is_running();
 	}
 
-	// Update the texture object by replacing it with a new one and uploading the stored mipmap images to it
+	void set_texture_object (Cached_Texture* tex, unique_ptr<Texture2D> obj, int mips, uptr memory_size) {
+		texture_memory_size_used -= tex->tex_memory_size;
+		texture_memory_size_used += memory_size;
+
+		tex->tex = std::move(obj);
+		tex->tex_mips = mips;
+		tex->tex_memory_size = memory_size;
+		if (tex->tex)
+			tex->latency.upload_done = glfwGetTime();
+	}
+
+	// Update the texture object by replacing it with a new one with the stored mipmap images
+	// on the upload thread the old one stays displayed until the new one is ready (see poll_uploads), removing the texture object (no mips cached) happens right away
 	void update_texture_object (Cached_Texture* tex) {
+		tex->upload_generation = next_job_generation++; // uploads still running for this texture are stale now
 
-		tex->tex = nullptr;
-		
-		if (tex->cached_mips > 0) {
+		if (tex->cached_mips == 0) {
+			set_texture_object(tex, nullptr, 0, 0);
+			return;
+		}
 
-			tex->tex = make_unique<Texture2D>(std::move( Texture2D::generate() ));
+		Texture_Upload_Job job;
+		job.kind = UPLOAD_MIPS;
+		job.filepath = tex->filepath;
+		job.generation = tex->upload_generation;
+		for (int i=0; i<tex->cached_mips; ++i) {
+			assert(tex->mips[i].img != nullptr);
+			assert(all(tex->mips[i].img->size == tex->mips[i].size_px));
+			job.mips.push_back(tex->mips[i].img);
+			job.memory_size += tex->mips[i].img->get_memory_size();
+		}
 
-			tex->tex->set_filtering_mipmapped();
-			tex->tex->set_border_clamp();
+		if (!uploads_async()) {
+			set_texture_object(tex, create_texture_object(job.mips), tex->cached_mips, job.memory_size);
+			return;
+		}
 
-			auto to_opengl_mip_index = [&] (int i) -> int { // !!! uses tex->cached_mips
-				assert(i >= 0 && i < tex->cached_mips);
-				return tex->cached_mips -1 -i;
-			};
+		uploader.jobs.cancel([&] (Texture_Upload_Job const& j) { // superseded by this one
+			bool cancel = j.kind == UPLOAD_MIPS && j.filepath == tex->filepath;
+			if (cancel)
+				upload_memory_size_in_flight -= j.memory_size;
+			return cancel;
+		});
+		upload_memory_size_in_flight += job.memory_size;
+		uploader.jobs.push(std::move(job));
+	}
+
+	// swap in the texture objects the upload thread finished once the gpu has them, never waits for a fence
+	void poll_uploads () {
+		TRACE_SCOPE("poll_uploads");
 
-			for (int i=0; i<tex->cached_mips; ++i) {
-				assert(tex->mips[i].img != nullptr);
-				assert(all(tex->mips[i].img->size == tex->mips[i].size_px));
+		Texture_Upload_Result res;
+		while (uploader.results.try_pop(&res)) {
+			upload_thread_ms.add(res.upload_ms);
+			pending_uploads.push_back(std::move(res));
+		}
 
-				tex->tex->upload_mipmap(to_opengl_mip_index(i), tex->mips[i].img->pixels, tex->mips[i].img->size);
+		// fences of one context signal in order, so the results are installed in the order they were pushed (gif frames rely on that)
+		for (auto it=pending_uploads.begin(); it!=pending_uploads.end();) {
+			if (glClientWaitSync(it->fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+				++it; // next frame
+				continue;
 			}
+			glDeleteSync(it->fence);
 
-			tex->tex->set_active_mips(0, tex->cached_mips -1);
+			if (!install_upload(&*it))
+				stale_uploads_dropped++; // texture object of the result is deleted
+
+			it = pending_uploads.erase(it);
+		}
+	}
+
+	// false if what it was uploaded for is gone or was updated again
+	bool install_upload (Texture_Upload_Result* res) {
+		switch (res->kind) {
+			case UPLOAD_MIPS: {
+				upload_memory_size_in_flight -= res->memory_size;
+
+				auto* tex = find_texture(res->filepath);
+				if (!tex || tex->upload_generation != res->generation)
+					return false;
+				set_texture_object(tex, std::move(res->tex), res->mips, res->memory_size);
+				return true;
+			}
+			case UPLOAD_TILE: {
+				auto* tex = find_tiled_texture(res->filepath);
+				if (!tex || tex->id != (u32)res->generation)
+					return false;
+				auto* tile = tex->find_tile(res->tile);
+				if (!tile)
+					return false; // can not happen, the tiled texture is the same one
+				set_tile_texture(tex, tile, std::move(res->tex));
+				return true;
+			}
+			case UPLOAD_GIF_FRAME: {
+				auto* gif = find_animated_gif(res->filepath);
+				if (!gif || gif->id != (u32)res->generation)
+					return false;
+				gif->frames_uploading--;
+				gif->ring.push_back({ std::move(res->tex), res->frame_index, res->frame_delay_ms });
+				gif_frames_uploaded++;
+				return true;
+			}
+			default: assert(false); return false;
 		}
 	}
 
@@ -272,8 +489,8 @@ struct Texture_Streamer {
 		assert(mip_indx < tex->cached_mips);
 		assert(tex->mips[mip_indx].img != nullptr);
 		
+		cache_memory_size_used -= tex->mips[mip_indx].get_memory_size(); // actual size of the cached format, so before we null img
 		tex->mips[mip_indx].img = nullptr;
-		cache_memory_size_used -= tex->mips[mip_indx].get_memory_size();
 	}
 
 	// evict all mips that do no longer count as desired_cached_mips
@@ -290,30 +507,86 @@ struct Texture_Streamer {
 		update_texture_object(tex);
 	}
 
-	// evicts all mips
-	void evict_all_mips (Cached_Texture* tex) {
+	// ONLY a helper function!! evicts all mipmap images, but leaves the texture object alone, for when new mips replace them right away
+	// (the old texture object stays displayed until the one with the new mips is uploaded)
+	void evict_all_mip_images (Cached_Texture* tex) {
 		for (int i=0; i<tex->cached_mips; ++i) {
 			evict_mip(tex, i);
 		}
 		tex->cached_mips = 0;
+	}
+
+	// evicts all mips
+	void evict_all_mips (Cached_Texture* tex) {
+		evict_all_mip_images(tex);
 
 		update_texture_object(tex);
 	}
 
-	// cache new mip data
-	void cache_mips (Cached_Texture* tex, std::vector<Image2D> new_mips) {
-		assert(tex->mips.size() == new_mips.size()); // image could have been resized while the app was running // TODO handle this later (simply update the list of mips each time we upload_mips() -> should be a good solution to images being updated while the app is running (update_mips() is basicly a full image update))
-		assert(tex->desired_cached_mips >= 0 && tex->desired_cached_mips <= new_mips.size());
+	// the file was rewritten at another resolution (render outputs, camera tethering) after the texture was added with the size probed when the directory was loaded
+	// the old mips are of the old image anyway, so evict them and switch to the mip chain of the new size
+	// mips are indexed from the 1x1 one, so mip i has about the same size in both chains, desired_cached_mips and the priorities carry over until the next frame recalculates them
+	void resize_texture (Cached_Texture* tex, iv2 full_size_px) {
+		TRACE_SCOPE("resize_texture");
+
+		iv2 old_full_size_px = tex->get_full_size_px();
+		flt old_priority = tex->mips.back().priority;
 
 		evict_all_mips(tex);
+		init_mips(tex, full_size_px);
+
+		for (auto& m : tex->mips) // priority is the pixel density of the mip on screen
+			m.priority = old_priority * min((flt)m.size_px.x / (flt)old_full_size_px.x, (flt)m.size_px.y / (flt)old_full_size_px.y);
+
+		tex->desired_cached_mips = min(tex->desired_cached_mips, (int)tex->mips.size());
+
+		// the thumbnail mips were counted in the old chain, a queued thumbnail job is rejected by its full size when it completes
+		if (tex->thumbnail_state == THUMB_LOADED || tex->thumbnail_state == THUMB_NONE)
+			tex->thumbnail_state = THUMB_UNKNOWN;
+		tex->thumbnail_mips = 0;
+
+		textures_resized++;
+	}
+
+	// cache new mip data, new_mips are the lowest mips (the job only generates as many as were desired when it was queued) of an image of full_size_px
+	void cache_mips (Cached_Texture* tex, std::vector<Mip_Image> new_mips, iv2 full_size_px) {
+		TRACE_SCOPE("cache_mips");
+
+		assert(tex->desired_cached_mips >= 0);
+
+		if (!all(full_size_px == tex->get_full_size_px()))
+			resize_texture(tex, full_size_px);
+
+		evict_all_mip_images(tex);
 
 		tex->cached_mips = min(tex->desired_cached_mips, (int)new_mips.size());
 		
 		for (int i=0; i<tex->cached_mips; ++i) {
 			assert(tex->mips[i].img == nullptr);
-			assert(all(tex->mips[i].size_px == new_mips[i].size)); // see above
+			assert(all(tex->mips[i].size_px == new_mips[i].size));
 
-			tex->mips[i].img = make_unique<Image2D>(std::move(new_mips[i]));
+			tex->mips[i].img = std::make_shared<Mip_Image const>(std::move(new_mips[i]));
+			cache_memory_size_used += tex->mips[i].get_memory_size();
+		}
+
+		update_texture_object(tex);
+	}
+
+	// cache the lowest mips from a thumbnail job, unless we already have at least as many mips (from a full decode that finished first)
+	void cache_thumbnail_mips (Cached_Texture* tex, std::vector<Mip_Image> new_mips) {
+		TRACE_SCOPE("cache_thumbnail_mips");
+
+		int count = min((int)new_mips.size(), tex->desired_cached_mips);
+		if (count <= tex->cached_mips)
+			return;
+
+		evict_all_mip_images(tex);
+
+		tex->cached_mips = count;
+
+		for (int i=0; i<tex->cached_mips; ++i) {
+			assert(all(tex->mips[i].size_px == new_mips[i].size));
+			tex->mips[i].img = std::make_shared<Mip_Image const>(std::move(new_mips[i]));
 			cache_memory_size_used += tex->mips[i].get_memory_size();
 		}
 
@@ -325,6 +598,24 @@ struct Texture_Streamer {
 		return textures.erase(it);
 	}
 
+	// the file was changed on disk (see Directory_Watcher), drop everything cached for it, so the next query starts over with the new size
+	// the rest of the cache is untouched, queued jobs for the file are cancelled
+	void invalidate_file (string const& filepath) {
+		auto t = textures.find(filepath);
+		if (t != textures.end())
+			remove_texture(t);
+
+		auto tiled = tiled_textures.find(filepath);
+		if (tiled != tiled_textures.end())
+			remove_tiled_texture(tiled);
+
+		animated_gifs.try_erase(filepath);
+
+		img_loader_threadpool.jobs.cancel([&] (Threadpool_Job const& job) {
+			return job.filepath == filepath;
+		});
+	}
+
 	void clear_cache () {
 		for (auto t=textures.begin(); t!=textures.end();) {
 			t = remove_texture(t);
@@ -332,40 +623,289 @@ struct Texture_Streamer {
 
 		img_loader_threadpool.jobs.cancel_all();
 
+		for (auto t=tiled_textures.begin(); t!=tiled_textures.end();) {
+			t = remove_tiled_texture(t);
+		}
+
+		animated_gifs.v.clear();
+
 		assert(textures.size() == 0);
 		assert(cache_memory_size_used == 0);
+		assert(tiled_textures.size() == 0);
+		assert(tile_memory_size_used == 0);
 	}
 
 	struct Threadpool_Job { // input is filepath to file to load
 		string					filepath;
+		texture_compression_e	compression;
+		std::vector<Tile_Key>	tiles; // non-empty: load these tiles of a tiled texture instead of the mips
+		bool					thumbnail; // load the embedded exif thumbnail (or the progressive preview) into the lowest mips instead of decoding the image
+		iv2						full_size_px; // for thumbnail jobs, the mips to fill are the ones of the full image
+		iv2						desired_size_px; // for thumbnail jobs, size of the biggest desired mip, to know if the progressive preview is worth decoding
+		int						mip_count; // for mip jobs, only the lowest mip_count mips are stored, the bigger ones only stream through the decoder
+		unique_ptr<Gif_Decoder>	gif; // non-null: decode the next gif_frames frames of an animated gif (downsampled by 2^gif_scale) instead
+		int						gif_frames;
+		int						gif_scale;
+		u64						generation; // see next_job_generation
 	};
 	struct Threadpool_Result {
 		string					filepath;
-		std::vector<Image2D>	mip_images;
+		u64						generation; // of the job
+		std::vector<Mip_Image>	mip_images;
+		iv2						full_size_px = -1; // of the image mip_images are the lowest mips of, as the loader found it in the file (thumbnail jobs: the one of the job)
+
+		bool					is_tile_job = false;
+		std::vector<Tile_Image>	tiles;
+
+		bool					is_thumbnail_job = false; // mip_images are only the lowest mips (empty if the file has no thumbnail)
+
+		bool					has_signature = false; // for the image_index, from the mips the job generated anyway
+		Image_Signature			signature;
+		rgba8					avg_col = 0; // of the image, from the smallest mip, a == 0: none
+		u64						file_mtime = 0; // when the job started reading the file
+
+		bool					is_gif_job = false;
+		unique_ptr<Gif_Decoder>	gif; // handed back to the Animated_Gif for the next job
+		std::vector<Gif_Frame>	gif_frames;
+
+		f64						t_dequeue = -1; // glfwGetTime is safe to call from any thread
+		f64						t_decode_end = -1;
 	};
 
 	struct Threadpool_Processor {
-		static Threadpool_Result process_job (Threadpool_Job&& job) {
+		// only decodes the part of the image the tiles cover, one region per level (downsampled to about the level's size while decoding)
+		static std::vector<Tile_Image> load_tiles (string const& filepath, std::vector<Tile_Key> const& keys) {
+			auto file_data = Image2D::read_file(filepath);
+
+			iv2 full_size;
+			int n;
+			if (!stbi_info_from_memory(file_data.data(), (int)file_data.size(), &full_size.x,&full_size.y, &n))
+				throw Expt_File_Load_Fail(filepath);
+
+			// tiles are in the oriented image
+			auto orientation = find_exif_orientation(file_data.data(), file_data.size());
+			full_size = orient_size(full_size, orientation);
+
+			int base_level = find_base_level(full_size);
+
+			std::vector<Tile_Image> tiles;
+
+			for (int level=0; level<=base_level; ++level) {
+				iv2 lo = INT_MAX, hi = INT_MIN;
+				int count = 0;
+				for (auto& key : keys) {
+					if (key.level != level || any(key.pos >= calc_tile_count(calc_level_size(full_size, key.level))))
+						continue; // other level or image changed on disk
+
+					iv2 tile_lo, tile_hi;
+					calc_tile_source_rect(full_size, key, &tile_lo, &tile_hi);
+					lo = min(lo, tile_lo);
+					hi = max(hi, tile_hi);
+					count++;
+				}
+				if (count == 0)
+					continue;
+
+				auto region = decode_region(file_data, filepath, lo, hi, calc_region_scale(full_size, level), orientation);
+
+				for (auto& key : keys) {
+					if (key.level != level || any(key.pos >= calc_tile_count(calc_level_size(full_size, key.level))))
+						continue;
+					tiles.push_back({ key, cut_tile(region, key) });
+				}
+			}
+
+			return tiles;
+		}
+
+		// mips are the lowest mips of an image of full_size_px, all of them get the same format
+		static std::vector<Mip_Image> compress_mips (std::vector<Image2D> mips, iv2 full_size_px, texture_compression_e compression, bool opaque) {
+			opaque = opaque || compression == TC_NONE;
+
+			auto format = choose_texture_format(compression, full_size_px, opaque);
+
+			std::vector<Mip_Image> mip_images;
+			mip_images.reserve(mips.size());
+			for (auto& m : mips)
+				mip_images.push_back( compress_mip(std::move(m), format) );
+			return mip_images;
+		}
+
+		// the smallest mip box filtered to 1x1, opaque, the loader generates the mips down to 1x1 anyway
+		static rgba8 calc_average_color (std::vector<Image2D> const& mips) {
+			if (mips.size() == 0)
+				return 0;
+			rgba8 col = Image2D::rescale_box_filter(mips[0], 1).get_pixel(0,0);
+			col.w = 255;
+			return col;
+		}
+
+		// the lowest mips of the full image, from the biggest one the thumbnail can fill without upscaling down to 1x1
+		// the full size mip is never filled from a thumbnail, even if the image is as small as its thumbnail
+		static std::vector<Mip_Image> generate_thumbnail_mips (Image2D const& thumb, iv2 full_size_px, texture_compression_e compression, bool* has_signature, Image_Signature* signature,
+				rgba8* avg_col) {
+			TRACE_SCOPE("generate_thumbnail_mips");
+
+			auto crop = crop_thumbnail_to_aspect(thumb, full_size_px);
+
+			iv2 biggest = -1;
+			find_mipmap_sizes_px(full_size_px, [&] (int i, iv2 size_px) {
+					if (i > 0 && biggest.x < 0 && all(size_px <= crop.size))
+						biggest = size_px;
+				});
+			if (biggest.x < 0)
+				return {}; // 1x1 image
+
+			auto mips = generate_mipmaps( Image2D::rescale_box_filter(crop, biggest) );
+			bool opaque = is_opaque(mips.back()); // downsampling can not create alpha, so checking the biggest mip is enough
+			*has_signature = compute_image_signature(mips, signature);
+			*avg_col = calc_average_color(mips);
+			return compress_mips(std::move(mips), full_size_px, compression, opaque);
+		}
+
+		static Threadpool_Result process_job (Threadpool_Job&& job, Worker_Helpers& helpers) {
 			Threadpool_Result res;
 
+			res.t_dequeue = glfwGetTime();
+
 			res.filepath = std::move(job.filepath);
+			res.generation = job.generation;
 			
+			if (job.thumbnail) {
+				res.is_thumbnail_job = true;
+
+				u64 file_size;
+				get_file_size_and_mtime(res.filepath, &file_size, &res.file_mtime);
+
+				Image2D thumb;
+				orientation_e orientation;
+				bool has_thumb = load_exif_thumbnail(res.filepath, &thumb, &orientation);
+
+				// the first scans of progressive jpegs give a 1/8 scale image, which is usually bigger than the exif thumbnail, but needs more of the file
+				if (!has_thumb || any(thumb.size < job.desired_size_px)) {
+					Image2D preview;
+					if (Image2D::load_progressive_jpeg_preview(res.filepath, &preview) && (!has_thumb || preview.size.x > thumb.size.x)) {
+						thumb = std::move(preview);
+						has_thumb = true;
+					}
+				}
+
+				if (has_thumb) {
+					thumb = orient_image(thumb, orientation, true); // decoded top-down, thumbnails are tiny so a separate pass is fine
+					res.mip_images = generate_thumbnail_mips(thumb, job.full_size_px, job.compression, &res.has_signature, &res.signature, &res.avg_col);
+				}
+				res.full_size_px = job.full_size_px;
+
+				res.t_decode_end = glfwGetTime();
+				return res;
+			}
+
 			// load image from disk
 			try {
-				Image2D src = Image2D::load_from_file(res.filepath);
-				
-				res.mip_images = generate_mipmaps( std::move(src) );
+				if (job.gif) {
+					res.is_gif_job = true;
+					res.gif = std::move(job.gif);
+					res.gif_frames = decode_gif_frames(res.gif.get(), res.filepath, job.gif_frames, job.gif_scale);
+
+					res.t_decode_end = glfwGetTime();
+					return res;
+				}
+
+				if (job.tiles.size() > 0) {
+					res.is_tile_job = true;
+					res.tiles = load_tiles(res.filepath, job.tiles);
+
+					res.t_decode_end = glfwGetTime();
+					return res;
+				}
+
+				u64 file_size;
+				get_file_size_and_mtime(res.filepath, &file_size, &res.file_mtime);
+
+				// videos (and other files stb can not decode) are their representative frame, through the same mips
+				if (auto* provider = find_thumbnail_provider(res.filepath)) {
+					bool opaque;
+					auto frame = load_provided_thumbnail(provider, res.filepath);
+					auto mips = generate_mips_from_image(frame, job.mip_count, ORIENT_NORMAL, &opaque, &helpers);
+					res.has_signature = compute_image_signature(mips, &res.signature);
+					res.avg_col = calc_average_color(mips);
+					res.full_size_px = frame.size;
+					res.mip_images = compress_mips(std::move(mips), res.full_size_px, job.compression, opaque);
+
+					res.t_decode_end = glfwGetTime();
+					return res;
+				}
+
+				auto file_data = Image2D::read_file(res.filepath);
+				auto orientation = find_exif_orientation(file_data.data(), file_data.size());
+
+				// generate the mips while decoding, only the desired ones are stored
+				std::vector<Image2D> mips;
+				bool opaque;
+				if (!decode_mips_streaming(file_data, res.filepath, job.mip_count, orientation, &mips, &opaque, &res.full_size_px, &helpers)) {
+					// progressive jpeg or interlaced png
+					auto full = Image2D::decode_from_memory_top_down(res.filepath, file_data);
+					mips = generate_mips_from_image(full, job.mip_count, orientation, &opaque, &helpers);
+					res.full_size_px = orient_size(full.size, orientation);
+				}
+
+				res.has_signature = compute_image_signature(mips, &res.signature);
+				res.avg_col = calc_average_color(mips);
+
+				res.mip_images = compress_mips(std::move(mips), res.full_size_px, job.compression, opaque);
 
 			} catch (Expt_File_Load_Fail const& e) {
 				// signifies that image was not loaded
+				res.is_tile_job = job.tiles.size() > 0;
 			}
 
+			res.t_decode_end = glfwGetTime();
+
 			return res;
 		}
 	};
 
 	Threadpool<Threadpool_Job, Threadpool_Result, Threadpool_Processor> img_loader_threadpool;
 
+	// every job gets the next generation, the texture (tiled texture) remembers the one of the job it waits for
+	// a job can not be cancelled once a worker took it, so when a texture is removed (evicted, invalidate_file) and added again for the same file,
+	// the result of the old job arrives while the new one is queued, these stale results are dropped before any upload work
+	u64 next_job_generation = 1;
+	u64 stale_results_dropped = 0; // decodes that were wasted, but at least not uploaded (results for removed textures included)
+
+	u64 push_job (Threadpool_Job&& job) {
+		job.generation = next_job_generation++;
+		u64 generation = job.generation;
+		img_loader_threadpool.jobs.push(std::move(job));
+		return generation;
+	}
+
+	// block compression of cached mips, see texture_compression.hpp
+	texture_compression_e	texture_compression = TC_NONE;
+
+	bool					gl_supports_bc1 = false; // EXT_texture_compression_s3tc
+	bool					gl_supports_bc7 = false; // ARB_texture_compression_bptc (core in 4.2)
+
+	bool is_compression_supported (texture_compression_e mode) const {
+		switch (mode) {
+			case TC_FAST:		return gl_supports_bc1;
+			case TC_QUALITY:	return gl_supports_bc1 && gl_supports_bc7;
+			default:			return true;
+		}
+	}
+
+	// needs the gl context, picks the best supported mode
+	void init_texture_compression () {
+		GLint major = 0, minor = 0;
+		glGetIntegerv(GL_MAJOR_VERSION, &major);
+		glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+		gl_supports_bc1 = gl_has_extension("GL_EXT_texture_compression_s3tc");
+		gl_supports_bc7 = gl_has_extension("GL_ARB_texture_compression_bptc") || major > 4 || (major == 4 && minor >= 2);
+
+		texture_compression = is_compression_supported(TC_QUALITY) ? TC_QUALITY : (is_compression_supported(TC_FAST) ? TC_FAST : TC_NONE);
+	}
+
 	void init_thread_pool () {
 		int cpu_threads = (int)std::thread::hardware_concurrency();
 		
@@ -382,6 +922,318 @@ struct Texture_Streamer {
 		img_loader_threadpool.start_threads(threads);
 	}
 
+	//// Tiled textures
+	struct Tiled_Texture_Less { // for sorted_vector
+		inline bool operator() (Tiled_Texture const& l,	Tiled_Texture const& r) const {	return std::less<string>()(l.filepath, r.filepath); }
+		inline bool operator() (string const& l_filepath,	Tiled_Texture const& r) const {	return std::less<string>()(l_filepath, r.filepath); }
+		inline bool operator() (Tiled_Texture const& l,	string const& r_filepath) const {	return std::less<string>()(l.filepath, r_filepath); }
+		inline bool operator() (cstr l_filepath,			Tiled_Texture const& r) const {		return strcmp(l_filepath, r.filepath.c_str()) < 0; }
+		inline bool operator() (Tiled_Texture const& l,	cstr r_filepath) const {			return strcmp(l.filepath.c_str(), r_filepath) < 0; }
+	};
+	sorted_vector<Tiled_Texture, Tiled_Texture_Less>	tiled_textures; // key: filepath
+
+	uptr	tile_memory_size_used = 0;
+	uptr	tile_memory_size_desired = 256 * 1024*1024; // budget for tiles seperate from the mip cache, tiles that were not used for the longest time get evicted when over it
+	int		tiled_threshold_px = 8192; // images with a side bigger than this are tiled
+
+	static constexpr int MAX_TILES_PER_JOB = 64; // every job reads the whole file, so batch the missing tiles of an image
+
+	bool is_tiled (iv2 full_size_px) const {
+		return any(full_size_px > tiled_threshold_px);
+	}
+
+	Tiled_Texture* find_tiled_texture (string const& filepath) {
+		auto it = tiled_textures.find(filepath);
+		return it != tiled_textures.end() ? &*it : nullptr;
+	}
+
+	void evict_tile (Tiled_Texture* tex, Tiled_Texture::Tile* tile) {
+		assert(tile->tex);
+		tile_memory_size_used -= tile->get_memory_size();
+		tile->tex = nullptr;
+		tex->resident_tiles--;
+	}
+
+	decltype(tiled_textures)::iterator remove_tiled_texture (decltype(tiled_textures)::iterator it) {
+		for (auto& l : it->levels)
+			for (auto& t : l.tiles)
+				if (t.tex)
+					evict_tile(&*it, &t);
+		return tiled_textures.erase(it);
+	}
+
+	// request the tiles of a tiled texture that are visible in the view at the onscreen size, onscreen rect of the whole image and view rect in px top-down
+	Tiled_Texture* query_tiled (cstr filepath, Texture_Handle* handle, iv2 full_size_px, v2 onscreen_pos_px, v2 onscreen_size_px, v2 view_lo_px, v2 view_hi_px, flt order_priority) {
+		
+		auto* tex = find_by_handle(tiled_textures, filepath, handle);
+		if (!tex) {
+			Tiled_Texture tmp (filepath, full_size_px);
+			tmp.id = next_handle_id++;
+
+			auto it = tiled_textures.insert(std::move(tmp));
+			assert(it != tiled_textures.end());
+			tex = &*it;
+			*handle = { (u32)(it -tiled_textures.begin()), tex->id };
+		}
+
+		tex->order_priority = min(tex->order_priority, order_priority);
+		tex->was_queried = true;
+
+		tex->desired_level = tex->calc_desired_level(onscreen_size_px);
+
+		auto request = [&] (Tile_Key key, Tiled_Texture::Tile& tile) {
+			tile.last_used_frame = frame_i;
+			if (!tile.tex && !tile.requested && !tile.uploading)
+				tex->missing_tiles.push_back(key);
+		};
+
+		// base level is always needed as fallback
+		int base = tex->get_base_level();
+		request({ base, 0 }, tex->levels[base].get_tile(0));
+
+		tex->all_visible_tiles_resident = true;
+		tex->foreach_visible_tile(tex->desired_level, onscreen_pos_px, onscreen_size_px, view_lo_px, view_hi_px,
+			[&] (Tile_Key key, Tiled_Texture::Tile& tile, v2 pos_px, v2 size_px) {
+				request(key, tile);
+				if (!tile.tex)
+					tex->all_visible_tiles_resident = false;
+			});
+
+		return tex;
+	}
+
+	void update_tiled_textures (sorted_vector<string>* jobs_to_cancel) {
+		for (auto t=tiled_textures.begin(); t!=tiled_textures.end();) {
+			
+			if (!t->was_queried) {
+				if (t->threadpool_job_queued)
+					jobs_to_cancel->insert(t->filepath);
+
+				if (t->resident_tiles == 0) {
+					t = remove_tiled_texture(t);
+					continue;
+				}
+			} else if (!t->threadpool_job_queued && t->missing_tiles.size() > 0) {
+				
+				// base and coarse levels first
+				std::stable_sort(t->missing_tiles.begin(), t->missing_tiles.end(), [] (Tile_Key const& l, Tile_Key const& r) { return l.level > r.level; });
+
+				Threadpool_Job job = { t->filepath, TC_NONE };
+				for (int i=0; i<min((int)t->missing_tiles.size(), MAX_TILES_PER_JOB); ++i) {
+					auto& key = t->missing_tiles[i];
+					
+					t->levels[key.level].get_tile(key.pos).requested = true;
+					job.tiles.push_back(key);
+				}
+
+				t->job_generation = push_job(std::move(job));
+				t->threadpool_job_queued = true;
+			}
+
+			++t;
+		}
+
+		// evict least recently used tiles until we are in budget again, tiles used this frame are never evicted
+		if (tile_memory_size_used > tile_memory_size_desired) {
+			struct Lru_Tile {
+				Tiled_Texture*			tex;
+				Tiled_Texture::Tile*	tile;
+			};
+			std::vector<Lru_Tile> lru;
+
+			for (auto& t : tiled_textures)
+				for (auto& l : t.levels)
+					for (auto& tile : l.tiles)
+						if (tile.tex && tile.last_used_frame != frame_i)
+							lru.push_back({ &t, &tile });
+
+			std::sort(lru.begin(), lru.end(), [] (Lru_Tile const& l, Lru_Tile const& r) { return l.tile->last_used_frame < r.tile->last_used_frame; });
+
+			for (auto& l : lru) {
+				if (tile_memory_size_used <= tile_memory_size_desired)
+					break;
+				evict_tile(l.tex, l.tile);
+			}
+		}
+	}
+
+	void cache_tiles (Tiled_Texture* tex, std::vector<Tile_Image> tiles) {
+		TRACE_SCOPE("cache_tiles");
+
+		for (auto& l : tex->levels)
+			for (auto& t : l.tiles)
+				t.requested = false;
+
+		for (auto& ti : tiles) {
+			auto* tile = tex->find_tile(ti.key);
+			if (!tile)
+				continue; // image was resized
+
+			if (!uploads_async()) {
+				set_tile_texture(tex, tile, create_image_texture(ti.img, nullptr));
+				continue;
+			}
+
+			Texture_Upload_Job job;
+			job.kind = UPLOAD_TILE;
+			job.filepath = tex->filepath;
+			job.generation = tex->id;
+			job.memory_size = ti.img.calc_size();
+			job.img = std::move(ti.img);
+			job.tile = ti.key;
+			uploader.jobs.push(std::move(job));
+
+			tile->uploading = true; // not requested again until it is installed
+		}
+	}
+
+	// the tile is counted against the tile budget once its texture object exists
+	void set_tile_texture (Tiled_Texture* tex, Tiled_Texture::Tile* tile, unique_ptr<Texture2D> obj) {
+		if (tile->tex)
+			evict_tile(tex, tile);
+
+		tile->tex = std::move(obj);
+		tile->uploading = false;
+
+		tile_memory_size_used += tile->get_memory_size();
+		tex->resident_tiles++;
+	}
+
+	//// Animated gifs
+	struct Animated_Gif_Less { // for sorted_vector
+		inline bool operator() (Animated_Gif const& l,	Animated_Gif const& r) const {	return std::less<string>()(l.filepath, r.filepath); }
+		inline bool operator() (string const& l_filepath,	Animated_Gif const& r) const {	return std::less<string>()(l_filepath, r.filepath); }
+		inline bool operator() (Animated_Gif const& l,	string const& r_filepath) const {	return std::less<string>()(l.filepath, r_filepath); }
+		inline bool operator() (cstr l_filepath,			Animated_Gif const& r) const {		return strcmp(l_filepath, r.filepath.c_str()) < 0; }
+		inline bool operator() (Animated_Gif const& l,	cstr r_filepath) const {			return strcmp(l.filepath.c_str(), r_filepath) < 0; }
+	};
+	sorted_vector<Animated_Gif, Animated_Gif_Less>	animated_gifs; // key: filepath
+
+	flt		gif_decode_budget_px = 24 * 1000*1000; // canvas px decoded per second over all gifs
+	flt		gif_decode_tokens = 0; // token bucket for gif_decode_budget_px
+	f64		gif_budget_refill_t = -1;
+	int		gif_frames_uploaded = 0;
+
+	static constexpr flt GIF_BUDGET_BURST = 0.25f; // the bucket holds at most this many seconds of budget
+
+	Animated_Gif* find_animated_gif (string const& filepath) {
+		auto it = animated_gifs.find(filepath);
+		return it != animated_gifs.end() ? &*it : nullptr;
+	}
+
+	// animated gifs in cells of at least GIF_MIN_ANIMATED_PX, returns the frame to draw instead of the still first frame (from query()), null if it is not decoded yet or the gif is not animated
+	Texture2D* query_animated_gif (cstr filepath, Texture_Handle* handle, iv2 size_px, iv2 onscreen_size_px, flt order_priority) {
+		if (max(onscreen_size_px.x, onscreen_size_px.y) < GIF_MIN_ANIMATED_PX)
+			return nullptr; // tiny cells only show the first frame, the gif is removed if no other cell queries it
+
+		auto* gif = find_by_handle(animated_gifs, filepath, handle);
+		if (!gif) {
+			Animated_Gif tmp;
+			tmp.filepath = filepath;
+			tmp.id = next_handle_id++;
+			tmp.size_px = size_px;
+
+			auto it = animated_gifs.insert(std::move(tmp));
+			assert(it != animated_gifs.end());
+			gif = &*it;
+			*handle = { (u32)(it -animated_gifs.begin()), gif->id };
+		}
+
+		gif->order_priority = min(gif->order_priority, order_priority);
+		gif->was_queried = true;
+		gif->desired_scale = calc_gif_frame_scale(gif->size_px, onscreen_size_px);
+
+		if (gif->frame_count == 1)
+			return nullptr;
+		return gif->get_displayed_frame();
+	}
+
+	// queue frame decodes within the budget, least recently served gifs first
+	void update_animated_gifs (sorted_vector<string>* jobs_to_cancel) {
+		f64 now = glfwGetTime();
+		if (gif_budget_refill_t >= 0)
+			gif_decode_tokens = min(gif_decode_tokens +(flt)(now -gif_budget_refill_t) * gif_decode_budget_px, gif_decode_budget_px * GIF_BUDGET_BURST);
+		gif_budget_refill_t = now;
+
+		std::vector<Animated_Gif*> want_frames;
+
+		for (auto g=animated_gifs.begin(); g!=animated_gifs.end();) {
+			if (!g->was_queried) {
+				if (g->threadpool_job_queued)
+					jobs_to_cancel->insert(g->filepath);
+
+				g = animated_gifs.erase(g);
+				continue;
+			}
+
+			if (!g->threadpool_job_queued && g->frame_count != 1 && g->get_free_frames() > 0)
+				want_frames.push_back(&*g);
+			++g;
+		}
+
+		std::stable_sort(want_frames.begin(), want_frames.end(), [] (Animated_Gif const* l, Animated_Gif const* r) { return l->last_job_t < r->last_job_t; });
+
+		for (auto* g : want_frames) {
+			flt cost = (flt)g->size_px.x * (flt)g->size_px.y;
+
+			int frames = min(g->get_free_frames(), (int)(gif_decode_tokens / cost));
+			if (frames == 0 && gif_decode_tokens >= gif_decode_budget_px * GIF_BUDGET_BURST)
+				frames = 1; // canvas is bigger than the bucket, go into debt
+			if (frames == 0)
+				break; // keep the order, so big gifs do not starve
+
+			gif_decode_tokens -= cost * (flt)frames;
+
+			Threadpool_Job job = { g->filepath, TC_NONE };
+			job.gif = g->decoder ? std::move(g->decoder) : make_unique<Gif_Decoder>();
+			job.gif_frames = frames;
+			job.gif_scale = g->desired_scale;
+
+			g->decoder_in_job = job.gif.get();
+			g->threadpool_job_queued = true;
+			g->last_job_t = now;
+
+			push_job(std::move(job));
+		}
+	}
+
+	void cache_gif_frames (Animated_Gif* gif, std::vector<Gif_Frame> frames) {
+		TRACE_SCOPE("cache_gif_frames");
+
+		for (auto& f : frames) {
+			if (gif->get_free_frames() == 0)
+				break;
+
+			unique_ptr<Texture2D> spare;
+			if (gif->spare_textures.size() > 0) {
+				spare = std::move(gif->spare_textures.back());
+				gif->spare_textures.pop_back();
+			}
+
+			if (!uploads_async()) {
+				gif->ring.push_back({ create_image_texture(f.img, std::move(spare)), f.index, f.delay_ms });
+				gif_frames_uploaded++;
+				continue;
+			}
+
+			// the spare texture could still be used by draw commands of the last frame, which respecifying it from another context does not wait for,
+			// so the upload thread always creates a new one (deleting the spare is deferred by gl until it is unused)
+			spare = nullptr;
+
+			Texture_Upload_Job job;
+			job.kind = UPLOAD_GIF_FRAME;
+			job.filepath = gif->filepath;
+			job.generation = gif->id;
+			job.memory_size = f.img.calc_size();
+			job.img = std::move(f.img);
+			job.frame_index = f.index;
+			job.frame_delay_ms = f.delay_ms;
+			uploader.jobs.push(std::move(job));
+
+			gif->frames_uploading++;
+		}
+	}
+
 	flt calc_priority (iv2 size_px, iv2 needed_size_px, flt order_priority) {
 		v2 px_dens = (v2)size_px / (v2)needed_size_px;
 		return min(px_dens.x, px_dens.y) * lerp(1, 1.25f, order_priority); // use pixel density as priority and bias by desired "order"
@@ -395,17 +1247,33 @@ struct Texture_Streamer {
 				m.priority = +INF;
 			}
 		}
+		for (auto& t : tiled_textures) {
+			t.order_priority = +INF;
+			t.was_queried = false;
+			t.missing_tiles.clear();
+		}
+		f64 now = glfwGetTime();
+		for (auto& g : animated_gifs) {
+			g.order_priority = +INF;
+			g.was_queried = false;
+			g.advance(now); // before the frame is drawn
+		}
 	}
 
-	Cached_Texture* query (string const& filepath, iv2 onscreen_size_px, iv2 full_size_px, flt order_priority) { // priority_bias [0,1]
+	Cached_Texture* query (cstr filepath, Texture_Handle* handle, iv2 onscreen_size_px, iv2 full_size_px, flt order_priority) { // priority_bias [0,1]
 
-		auto* tex = find_texture(filepath);
-		if (!tex)
+		auto* tex = find_by_handle(textures, filepath, handle);
+		if (!tex) {
 			tex = add_texture(filepath, full_size_px);
+			*handle = { (u32)(tex -textures.v.data()), tex->id };
+		}
 
 		tex->order_priority = min(tex->order_priority, order_priority);
 		tex->was_queried = true;
 
+		if (tex->latency.blurry_since < 0 && tex->cached_mips == 0)
+			tex->latency.blurry_since = glfwGetTime(); // first query
+
 		for (auto& m : tex->mips) {
 			m.priority = min(m.priority, calc_priority(m.size_px, onscreen_size_px, order_priority));
 		}
@@ -413,8 +1281,69 @@ struct Texture_Streamer {
 		return tex;
 	}
 
+	// latency from the image being queried while blurry to it being displayed sharp, split into the stages in between
+	struct Latency_Stats {
+		Sample_Histogram	total =			Sample_Histogram("query -> sharp");
+		Sample_Histogram	until_enqueue =	Sample_Histogram("query -> enqueue");
+		Sample_Histogram	queue_wait =	Sample_Histogram("enqueue -> dequeue");
+		Sample_Histogram	decode =		Sample_Histogram("dequeue -> decode end");
+		Sample_Histogram	result_wait =	Sample_Histogram("decode end -> pop");
+		Sample_Histogram	upload =		Sample_Histogram("pop -> upload done");
+
+		template <typename FOREACH>
+		void foreach (FOREACH f) {
+			for (auto* h : { &total, &until_enqueue, &queue_wait, &decode, &result_wait, &upload })
+				f(*h);
+		}
+
+		bool write_csv (string const& filepath) {
+			FILE* f = fopen(filepath.c_str(), "wb");
+			if (!f)
+				return false;
+
+			fprintf(f, "stage,ms\n");
+			foreach([&] (Sample_Histogram& h) { h.write_csv(f); });
+
+			fclose(f);
+			return true;
+		}
+	};
+	Latency_Stats	latency_stats;
+
+	// call for textures that are actually visible with the pixel density they are displayed at, to track when they become sharp
+	void report_displayed (Cached_Texture* tex, flt displayable_pixel_density) {
+		auto& l = tex->latency;
+
+		bool sharp = displayable_pixel_density >= 1 || tex->all_mips_displayable();
+
+		if (!sharp) {
+			if (l.blurry_since < 0)
+				l.blurry_since = glfwGetTime(); // got blurry again (zoomed in)
+			return;
+		}
+		if (l.blurry_since < 0)
+			return; // was already sharp
+
+		f64 now = glfwGetTime();
+		auto ms = [] (f64 a, f64 b) { return (f32)((b -a) * 1000); };
+
+		latency_stats.total.add(ms(l.blurry_since, now));
+
+		// the stages are only meaningful if the job that made the image sharp was queued after it got blurry (prefetched images can have older jobs)
+		if (l.job_enqueue >= l.blurry_since && l.job_dequeue >= l.job_enqueue && l.decode_end >= l.job_dequeue && l.result_pop >= l.decode_end && l.upload_done >= l.result_pop) {
+			latency_stats.until_enqueue	.add(ms(l.blurry_since,	l.job_enqueue));
+			latency_stats.queue_wait	.add(ms(l.job_enqueue,	l.job_dequeue));
+			latency_stats.decode		.add(ms(l.job_dequeue,	l.decode_end));
+			latency_stats.result_wait	.add(ms(l.decode_end,	l.result_pop));
+			latency_stats.upload		.add(ms(l.result_pop,	l.upload_done));
+		}
+
+		l.blurry_since = -1;
+	}
+
 	void queries_end () {
-		
+		TRACE_SCOPE("queries_end");
+
 		// Create list of all mipmaps
 		struct Mip {
 			Cached_Texture*					tex;
@@ -433,13 +1362,17 @@ struct Texture_Streamer {
 		}
 
 		// sort it by the priority that was calculated when the textures were queried
-		std::stable_sort(mips_sorted.begin(),mips_sorted.end(),
-			[] (Mip const& l, Mip const& r) {
-				return l.tex->mips[l.mip_indx].priority < r.tex->mips[r.mip_indx].priority;
-			});
+		{
+			TRACE_SCOPE("sort mips");
+			std::stable_sort(mips_sorted.begin(),mips_sorted.end(),
+				[] (Mip const& l, Mip const& r) {
+					return l.tex->mips[l.mip_indx].priority < r.tex->mips[r.mip_indx].priority;
+				});
+		}
 
 		// recalculate desired_cached_mips for each texture
-		uptr memory_size_total = 0;
+		// old texture objects that are still displayed until their replacement is uploaded (and the replacements in flight) take gpu memory beyond the cached mips
+		uptr memory_size_total = get_texture_memory_overhang();
 
 		for (auto& m : mips_sorted) {
 			uptr mip_sz = m.tex->mips[m.mip_indx].get_memory_size();
@@ -459,6 +1392,8 @@ struct Texture_Streamer {
 
 		sorted_vector<string> jobs_to_cancel;
 
+		u64 phase_begin_ns = tracer.get_time_ns();
+
 		for (auto t=textures.begin(); t!=textures.end();) {
 			
 			bool texture_erased = false;
@@ -466,7 +1401,7 @@ struct Texture_Streamer {
 			if (t->desired_cached_mips == 0 && !t->was_queried) {
 				// evict whole texture
 
-				if (t->threadpool_job_queued) {
+				if (t->threadpool_job_queued || t->thumbnail_state == THUMB_QUEUED) {
 					jobs_to_cancel.insert(t->filepath);
 				}
 
@@ -482,12 +1417,35 @@ struct Texture_Streamer {
 				
 			} else if (t->desired_cached_mips > t->cached_mips) {
 				// recaching_desired
+
+				if (t->thumbnail_state == THUMB_LOADED && t->cached_mips < min(t->desired_cached_mips, t->thumbnail_mips))
+					t->thumbnail_state = THUMB_UNKNOWN; // thumbnail mips were evicted, just load them again
 				
-				if (t->threadpool_job_queued) {
-					// job is already queued, nothing to do
+				if (t->thumbnail_state == THUMB_UNKNOWN && has_jpeg_extension(t->filepath)) {
+					Threadpool_Job job = { t->filepath, texture_compression };
+					job.thumbnail = true;
+					job.full_size_px = t->mips.back().size_px;
+					job.desired_size_px = t->mips[t->desired_cached_mips -1].size_px;
+
+					t->thumbnail_job_generation = push_job(std::move(job));
+					t->thumbnail_state = THUMB_QUEUED;
+					t->latency.job_enqueue = glfwGetTime();
+				}
+
+				if (t->thumbnail_state == THUMB_QUEUED) // thumbnail size not known yet, wait for it unless even a 1/8 scale progressive preview could not be enough
+					t->needs_full_decode = t->desired_cached_mips > (int)t->mips.size() -3;
+				else
+					t->needs_full_decode = t->desired_cached_mips > (t->thumbnail_state == THUMB_LOADED ? t->thumbnail_mips : 0);
+
+				if (t->threadpool_job_queued || !t->needs_full_decode) {
+					// job is already queued or the thumbnail is enough, nothing to do
 				} else {
-					img_loader_threadpool.jobs.push({ t->filepath });
+					Threadpool_Job job = { t->filepath, texture_compression };
+					job.mip_count = t->desired_cached_mips;
+
+					t->mip_job_generation = push_job(std::move(job));
 					t->threadpool_job_queued = true;
+					t->latency.job_enqueue = glfwGetTime();
 				}
 
 			} else if (t->desired_cached_mips < t->cached_mips) {
@@ -506,48 +1464,151 @@ struct Texture_Streamer {
 				++t;
 		}
 
-		if (jobs_to_cancel.size() != 0) {
+		update_tiled_textures(&jobs_to_cancel);
+
+		sorted_vector<string> gif_jobs_to_cancel; // seperate, gifs share the filepath with the still image of their first frame
+		update_animated_gifs(&gif_jobs_to_cancel);
+
+		tracer.phase("update textures", &phase_begin_ns);
+
+		if (jobs_to_cancel.size() != 0 || gif_jobs_to_cancel.size() != 0) {
 			img_loader_threadpool.jobs.cancel([&] (Threadpool_Job const& job) {
+				if (job.gif)
+					return gif_jobs_to_cancel.contains(job.filepath); // the gif was already removed
+
 				bool cancel = jobs_to_cancel.contains(job.filepath);
 				if (cancel) {
 					auto* tex = find_texture(job.filepath);
-					if (tex)
+					if (tex && job.thumbnail)
+						tex->thumbnail_state = THUMB_UNKNOWN;
+					else if (tex)
 						tex->threadpool_job_queued = false;
+
+					auto* tiled = find_tiled_texture(job.filepath);
+					if (tiled) {
+						tiled->threadpool_job_queued = false;
+						for (auto& key : job.tiles)
+							tiled->levels[key.level].get_tile(key.pos).requested = false;
+					}
 				}
 				return cancel;
 			});
 		}
+		auto get_order_priority = [&] (Threadpool_Job const& job) -> flt {
+			if (job.gif) {
+				auto* g = find_animated_gif(job.filepath);
+				return g ? g->order_priority : +INF;
+			}
+			if (job.tiles.size() > 0) {
+				auto* t = find_tiled_texture(job.filepath);
+				return t ? t->order_priority : +INF;
+			}
+			auto* t = find_texture(job.filepath);
+			assert(t); // since we cancelled the ones that dont exist anymore (this triggered when evicted textures only had a thumbnail job queued, which was not cancelled)
+			return t ? t->order_priority : +INF;
+		};
 		img_loader_threadpool.jobs.sort([&] (Threadpool_Job const& l, Threadpool_Job const& r) {
-			auto* lt = find_texture(l.filepath);
-			auto* rt = find_texture(r.filepath);
-
-			// BUG: TODO: why do these sometimes trigger even though they should be impossible??
-			//assert(lt); // since we cancelled the ones that dont exist anymore
-			//assert(rt);
-
-			return (lt ? lt->order_priority : +INF) < (rt ? rt->order_priority : +INF);
+			if (l.thumbnail != r.thumbnail)
+				return l.thumbnail; // thumbnails always first, they complete way faster
+			return get_order_priority(l) < get_order_priority(r);
 		});
 		
+		tracer.phase("update jobs", &phase_begin_ns);
+
+		poll_uploads();
+
+		tracer.phase("poll uploads", &phase_begin_ns);
+
 		// 
 		for (;;) {
 		
 			Threadpool_Result res;
 			if (!img_loader_threadpool.results.try_pop(&res))
 				break; // currently no images loaded async, stop polling
+
+			// describes the file even if the result is stale for its texture, a thumbnail only if there is nothing better for this version of the file
+			if (res.has_signature && image_index) {
+				u32 i = image_index->find(res.filepath);
+				if (!res.is_thumbnail_job || i == Image_Index::NO_ENTRY || image_index->mtimes[i] != res.file_mtime)
+					image_index->add(res.filepath, res.file_mtime, res.signature);
+			}
 			
+			if (res.is_gif_job) {
+				auto* gif = find_animated_gif(res.filepath);
+				if (!gif || !gif->threadpool_job_queued || gif->decoder_in_job != res.gif.get()) {
+					stale_results_dropped++; // gifs recognize their job by the decoder they gave it
+				} else {
+					gif->threadpool_job_queued = false;
+					gif->decoder_in_job = nullptr;
+
+					if (res.gif->frame_count > 0)
+						gif->frame_count = res.gif->frame_count;
+					if (res.gif_frames.size() == 0 && gif->frame_count == 0)
+						gif->frame_count = 1; // could not be decoded, only show the still image
+
+					if (gif->frame_count == 1) {
+						gif->ring.clear();
+						gif->spare_textures.clear();
+					} else {
+						gif->decoder = std::move(res.gif);
+						cache_gif_frames(gif, std::move(res.gif_frames));
+					}
+				}
+				continue;
+			}
+
+			if (res.is_tile_job) {
+				auto* tiled = find_tiled_texture(res.filepath);
+				if (!tiled || !tiled->threadpool_job_queued || res.generation != tiled->job_generation) {
+					stale_results_dropped++;
+				} else {
+					tiled->threadpool_job_queued = false;
+					cache_tiles(tiled, std::move(res.tiles));
+				}
+				continue;
+			}
+
 			auto* tex = find_texture(res.filepath);
+
+			if (res.is_thumbnail_job) {
+				if (!tex || tex->thumbnail_state != THUMB_QUEUED || res.generation != tex->thumbnail_job_generation) {
+					stale_results_dropped++;
+				} else if (!all(res.full_size_px == tex->get_full_size_px())) {
+					tex->thumbnail_state = THUMB_UNKNOWN; // made for the mips of the size before resize_texture
+				} else {
+					if (res.mip_images.size() == 0) {
+						tex->thumbnail_state = THUMB_NONE;
+					} else {
+						tex->thumbnail_state = THUMB_LOADED;
+						tex->thumbnail_mips = (int)res.mip_images.size();
+						tex->avg_col = res.avg_col;
+
+						tex->latency.job_dequeue = res.t_dequeue;
+						tex->latency.decode_end = res.t_decode_end;
+						tex->latency.result_pop = glfwGetTime();
+
+						cache_thumbnail_mips(tex, std::move(res.mip_images)); // upload_done is set when the texture object is swapped in
+					}
+				}
+				continue;
+			}
 			
-			if (!tex) {
-				// texture not cached anymore, was evicted, ignore result
+			if (!tex || !tex->threadpool_job_queued || res.generation != tex->mip_job_generation) {
+				// texture not cached anymore (was evicted), or the job was for an earlier texture of the same file, ignore result
+				// (the latter used to be uploaded too, and cleared threadpool_job_queued while the current job was still running)
+				stale_results_dropped++;
 			} else if (res.mip_images.size() == 0) {
 				// image could not be loaded
-				//assert(tex->threadpool_job_queued); // BUG: TODO: This triggers? threadpool_job_queued should be 100% reliable according to my logic, bug in threadsafe queue ??
 				tex->threadpool_job_queued = false;
 			} else {
-				//assert(tex->threadpool_job_queued);
 				tex->threadpool_job_queued = false;
+				tex->avg_col = res.avg_col;
 
-				cache_mips(tex, std::move(res.mip_images));
+				tex->latency.job_dequeue = res.t_dequeue;
+				tex->latency.decode_end = res.t_decode_end;
+				tex->latency.result_pop = glfwGetTime();
+
+				cache_mips(tex, std::move(res.mip_images), res.full_size_px);
 			}
 				
 			assert((sptr)cache_memory_size_used >= 0);
@@ -555,10 +1616,12 @@ struct Texture_Streamer {
 			auto t_now = glfwGetTime();
 			auto t_elapsed = t_now -t_begin;
 			if (t_elapsed > 0.005f)
-				break; // limit uploads
+				break; // limit the results handled per frame (they upload on this thread if the upload thread does not run)
 
 		}
 		
+		tracer.phase("drain results", &phase_begin_ns);
+
 		auto t_end = glfwGetTime();
 		upload_time = (flt)(t_end -t_begin);
 
@@ -570,7 +1633,33 @@ struct Texture_Streamer {
 
 			ImGui::Value("threadpool threads", img_loader_threadpool.get_thread_count());
 
+			{
+				int mode = texture_compression;
+				if (ImGui::Combo("texture_compression", &mode, texture_compression_e_str, ARRLEN(texture_compression_e_str))) {
+					if (!is_compression_supported((texture_compression_e)mode)) {
+						fprintf(stderr, "%s not supported by the gpu driver\n", texture_compression_e_str[mode]);
+					} else if (mode != texture_compression) {
+						texture_compression = (texture_compression_e)mode;
+						clear_cache(); // budget predictions and cached mips are for the old mode
+					}
+				}
+				ImGui::SameLine();
+				ImGui::Text("BC1: %s  BC7: %s", gl_supports_bc1 ? "yes":"no", gl_supports_bc7 ? "yes":"no");
+			}
+
 			ImGui::Value_Bytes("cache_memory_size_used", cache_memory_size_used);
+			ImGui::Text("textures_resized: %llu", (unsigned long long)textures_resized);
+			ImGui::Text("stale_results_dropped: %llu", (unsigned long long)stale_results_dropped);
+
+			ImGui::Value("upload thread running", uploader.is_running());
+			ImGui::SameLine();
+			ImGui::Checkbox("async_uploads", &async_uploads);
+			ImGui::Value("pending_uploads", (int)pending_uploads.size());
+			ImGui::Text("stale_uploads_dropped: %llu", (unsigned long long)stale_uploads_dropped);
+			ImGui::Value_Bytes("texture_memory_size_used", texture_memory_size_used);
+			ImGui::Value_Bytes("upload_memory_size_in_flight", upload_memory_size_in_flight);
+			ImGui::Value_Bytes("texture_memory_overhang", get_texture_memory_overhang());
+			upload_thread_ms.imgui();
 
 			static f32 sz_in_mb[256] = {};
 			static int cur_val = 0;
@@ -586,10 +1675,65 @@ struct Texture_Streamer {
 
 			ImGui::Value_Bytes("cache_memory_size_desired", cache_memory_size_desired);
 
+			if (ImGui::TreeNode("Tiled textures")) {
+				ImGui::DragInt("tiled_threshold_px", &tiled_threshold_px, 16, TILE_SIZE);
+
+				ImGui::Value("tiled_textures", (int)tiled_textures.size());
+				ImGui::Value_Bytes("tile_memory_size_used", tile_memory_size_used);
+
+				flt tmp = (flt)tile_memory_size_desired / 1024 / 1024;
+				ImGui::DragFloat("tile_memory_size_desired", &tmp, 1.0f/16, 0,+INF, "%.5f MB");
+				tile_memory_size_desired = (uptr)roundf(tmp * 1024 * 1024);
+
+				for (auto& t : tiled_textures) {
+					if (ImGui::TreeNode(t.filepath.c_str())) {
+						t.imgui();
+						ImGui::TreePop();
+					}
+				}
+				ImGui::TreePop();
+			}
+
+			if (ImGui::TreeNode("Animated gifs")) {
+				flt tmp = gif_decode_budget_px / 1000 / 1000;
+				ImGui::DragFloat("gif_decode_budget_px", &tmp, 1.0f/16, 0,+INF, "%.3f Mpx/s");
+				gif_decode_budget_px = tmp * 1000 * 1000;
+
+				uptr mem = 0;
+				for (auto& g : animated_gifs)
+					mem += g.get_memory_size();
+
+				ImGui::Value("animated_gifs", (int)animated_gifs.size());
+				ImGui::Value_Bytes("frame memory", mem);
+				ImGui::Value("gif_frames_uploaded", gif_frames_uploaded);
+
+				for (auto& g : animated_gifs) {
+					if (ImGui::TreeNode(g.filepath.c_str())) {
+						g.imgui();
+						ImGui::TreePop();
+					}
+				}
+				ImGui::TreePop();
+			}
+
 			ImGui::PushItemWidth(-1);
 			ImGui::PlotLines("##cache_memory_size_used", sz_in_mb, ARRLEN(sz_in_mb), cur_val, "memory_size in MB", 0, (flt)cache_memory_size_desired/1024/1024 *1.2f, ImVec2(0,80));
 			ImGui::PopItemWidth();
 
+			if (ImGui::TreeNode("Latency")) {
+				if (ImGui::Button("Reset"))
+					latency_stats.foreach([] (Sample_Histogram& h) { h.clear(); });
+				ImGui::SameLine();
+				if (ImGui::Button("Export latency.csv")) {
+					if (!latency_stats.write_csv("latency.csv"))
+						fprintf(stderr, "Could not write latency.csv\n");
+				}
+
+				latency_stats.foreach([] (Sample_Histogram& h) { h.imgui(); });
+
+				ImGui::TreePop();
+			}
+
 			static bool window_texture = false;
 			ImGui::Checkbox("Texture Window", &window_texture);
 
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <thread>
+#include <memory>
+#include <vector>
+#include <cstdio>
+
+#include <string>
+using std::string;
+
+#include "glad_helper.hpp"
+#include "glfw3.h"
+
+#include "basic_typedefs.hpp"
+
+#include "texture.hpp"
+#include "texture_compression.hpp"
+#include "tiled_texture.hpp"
+#include "threadsafe_queue.hpp"
+#include "tracing.hpp"
+
+/* Creating and filling the texture objects of the streamer on a thread with its own gl context (of a hidden window, sharing its objects with the one of the main window)
+	so frames where many decodes finish do not spend their time in glTexImage2D, and the frame rate does not depend on how much gets uploaded
+	The main thread pushes the cpu copies of the mips (shared, so evicting them on the main thread does not free them under the upload), the pixels of tiles and gif frames,
+	the upload thread creates a texture object with them and puts a fence after the upload commands
+	The main thread polls the fences every frame without waiting (see Texture_Streamer::poll_uploads) and only swaps the finished texture objects in,
+	until then the old ones stay displayed
+	If the shared context can not be created the streamer uploads on the main thread
+*/
+
+// new texture object with mips[0] as the 1x1 mip and mips.back() as the biggest one, on whatever thread has a gl context current
+unique_ptr<Texture2D> create_texture_object (std::vector<std::shared_ptr<Mip_Image const>> const& mips) {
+	TRACE_SCOPE("create_texture_object");
+
+	auto tex = make_unique<Texture2D>(std::move( Texture2D::generate() ));
+
+	tex->set_filtering_mipmapped();
+	tex->set_border_clamp();
+
+	int count = (int)mips.size();
+	for (int i=0; i<count; ++i) {
+		int gl_mip = count -1 -i; // gl mip 0 is the biggest
+		auto& img = *mips[i];
+		switch (img.format) {
+			case TF_RGBA8:	tex->upload_mipmap(gl_mip, img.rgba.pixels, img.size); break;
+			case TF_BC1:	tex->upload_compressed_mipmap(gl_mip, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, img.blocks.data(), img.blocks.size(), img.size); break;
+			case TF_BC7:	tex->upload_compressed_mipmap(gl_mip, GL_COMPRESSED_RGBA_BPTC_UNORM_ARB, img.blocks.data(), img.blocks.size(), img.size); break;
+		}
+	}
+
+	tex->set_active_mips(0, count -1);
+	return tex;
+}
+
+// single level texture of a tile or a gif frame, uploaded into reuse if it is not null (the spare textures of gifs, only on the main thread)
+unique_ptr<Texture2D> create_image_texture (Image2D const& img, unique_ptr<Texture2D> reuse) {
+	TRACE_SCOPE("create_image_texture");
+
+	auto tex = reuse ? std::move(reuse) : make_unique<Texture2D>(std::move( Texture2D::generate() ));
+	tex->set_filtering_mipmapped();
+	tex->set_border_clamp();
+	tex->upload(img.pixels, img.size);
+	return tex;
+}
+
+enum texture_upload_e {
+	UPLOAD_MIPS =0,	// new texture object of a Cached_Texture
+	UPLOAD_TILE,		// tile of a Tiled_Texture
+	UPLOAD_GIF_FRAME,	// frame of an Animated_Gif
+};
+
+struct Texture_Upload_Job {
+	texture_upload_e						kind = UPLOAD_MIPS;
+	string									filepath;
+	u64										generation; // UPLOAD_MIPS: see Cached_Texture::upload_generation, otherwise the id of the Tiled_Texture or Animated_Gif
+	uptr									memory_size = 0; // of the texture object, for the gpu memory accounting of the streamer
+
+	std::vector<std::shared_ptr<Mip_Image const>>	mips; // UPLOAD_MIPS
+
+	Image2D									img; // UPLOAD_TILE, UPLOAD_GIF_FRAME
+
+	Tile_Key								tile = {}; // UPLOAD_TILE
+	int										frame_index = 0; // UPLOAD_GIF_FRAME
+	int										frame_delay_ms = 0;
+};
+struct Texture_Upload_Result {
+	texture_upload_e						kind;
+	string									filepath;
+	u64										generation;
+	uptr									memory_size;
+
+	unique_ptr<Texture2D>					tex;
+	int										mips; // UPLOAD_MIPS
+
+	Tile_Key								tile;
+	int										frame_index;
+	int										frame_delay_ms;
+
+	GLsync									fence = 0; // signaled when the gpu has the texture, only then it can be used by the main context
+	f32										upload_ms; // cpu time of the upload thread
+};
+
+struct Texture_Uploader {
+	Threadsafe_Queue<Texture_Upload_Job>	jobs;
+	Threadsafe_Queue<Texture_Upload_Result>	results;
+
+	GLFWwindow*								context_window = nullptr; // hidden, only for its context
+	std::thread								thread;
+
+	bool is_running () const {
+		return thread.joinable();
+	}
+
+	// on the main thread, glfw only creates windows there, share is the window the textures are drawn in
+	bool start (GLFWwindow* share) {
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE); // the other hints (version, profile) are still the ones of the main window, which they have to match for sharing
+		context_window = glfwCreateWindow(1, 1, "texture uploads", NULL, share);
+		glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+		if (!context_window) {
+			fprintf(stderr, "Could not create the shared gl context for texture uploads, uploading on the main thread\n");
+			return false;
+		}
+
+		thread = std::thread(&Texture_Uploader::upload_thread, this);
+		return true;
+	}
+
+	// before the main window is destroyed, the results still queued are dropped
+	void stop () {
+		if (!is_running())
+			return;
+
+		jobs.stop_all();
+		thread.join();
+
+		Texture_Upload_Result res;
+		while (results.try_pop(&res))
+			glDeleteSync(res.fence);
+
+		glfwDestroyWindow(context_window);
+		context_window = nullptr;
+	}
+
+private:
+	void upload_thread () {
+		tracer.set_thread_name("texture uploads");
+
+		glfwMakeContextCurrent(context_window);
+
+		Texture_Upload_Job job;
+		while (jobs.pop_or_stop(&job) == decltype(jobs)::POP) {
+			TRACE_SCOPE("texture upload");
+
+			f64 t_begin = glfwGetTime();
+
+			Texture_Upload_Result res;
+			res.kind = job.kind;
+			res.filepath = std::move(job.filepath);
+			res.generation = job.generation;
+			res.memory_size = job.memory_size;
+			res.mips = (int)job.mips.size();
+			res.tile = job.tile;
+			res.frame_index = job.frame_index;
+			res.frame_delay_ms = job.frame_delay_ms;
+
+			if (job.kind == UPLOAD_MIPS)
+				res.tex = create_texture_object(job.mips);
+			else
+				res.tex = create_image_texture(job.img, nullptr);
+
+			res.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			glFlush(); // the fence has to be flushed in this context, or the main thread could poll it forever
+
+			// release the cpu copies now, not when the next job overwrites them
+			job.mips.clear();
+			job.img = Image2D();
+
+			res.upload_ms = (f32)((glfwGetTime() -t_begin) * 1000);
+			results.push(std::move(res));
+		}
+
+		glfwMakeContextCurrent(NULL);
+	}
+};
@@ -1,14 +1,215 @@
 #pragma once
 
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <vector>
 
 #include "threadsafe_queue.hpp"
+#include "mpsc_ring.hpp"
+#include "tracing.hpp"
+
+/* Splitting the work of a single job (eg. decoding one huge image) across the workers of the pool
+	A job splits its work into parts, the calling worker always works on them itself, and idle workers take parts before waiting for the next job
+	So this never waits for a free worker, if all of them are busy with their own jobs the calling worker simply does all the parts
+*/
+class Worker_Helpers {
+public:
+	struct Task {
+		std::function<void(int)>	f; // called with the part index
+		int							count;
+		int							next; // next part to take, protected by m
+		std::atomic<int>			done;
+	};
+
+	std::function<void()>	wake_idle_workers; // set by the Threadpool
+
+	// run f(0) .. f(count -1), on the calling thread and on idle workers, returns when all parts are done
+	template <typename F>
+	void parallel_for (int count, F f) {
+		Task task;
+		task.f = f;
+		task.count = count;
+		task.next = 0;
+		task.done = 0;
+
+		if (count > 1)
+			push(&task);
+
+		int part;
+		while ((part = take_part(&task)) >= 0) {
+			task.f(part);
+			task.done++;
+		}
+
+		wait(&task);
+	}
+
+	// run f on an idle worker while the caller continues, returns null if no worker took it within a short time (f then does not run at all)
+	// the caller has to call join() on the returned task
+	Task* try_run_async (std::function<void()> f) {
+		TRACE_SCOPE("try_run_async");
+
+		auto* task = new Task;
+		task->f = [f] (int) { f(); };
+		task->count = 1;
+		task->next = 0;
+		task->done = 0;
+
+		push(task);
+
+		// idle workers wake up in microseconds, if none did they are all busy
+		auto t0 = std::chrono::steady_clock::now();
+		for (;;) {
+			{
+				std::lock_guard<std::mutex> lock(m);
+				if (task->next > 0)
+					return task;
+
+				if (std::chrono::steady_clock::now() -t0 > std::chrono::milliseconds(1)) {
+					remove(task);
+					break;
+				}
+			}
+			std::this_thread::yield();
+		}
+
+		delete task;
+		return nullptr;
+	}
+	void join (Task* task) {
+		wait(task);
+		delete task;
+	}
+
+	// called by idle workers, run one part of any task, false if there was nothing to do
+	bool help () {
+		Task* task;
+		int part;
+		{
+			std::lock_guard<std::mutex> lock(m);
+			if (tasks.empty())
+				return false;
+			task = tasks.front();
+			part = take_part_locked(task);
+		}
+
+		TRACE_SCOPE("help");
+		task->f(part);
+		task->done++; // task can be gone after this
+		return true;
+	}
+
+	bool has_work () {
+		std::lock_guard<std::mutex> lock(m);
+		return !tasks.empty();
+	}
+
+private:
+	std::mutex			m;
+	std::vector<Task*>	tasks; // tasks that still have parts to take
+
+	void push (Task* task) {
+		{
+			std::lock_guard<std::mutex> lock(m);
+			tasks.push_back(task);
+		}
+		wake_idle_workers();
+	}
+	void remove (Task* task) {
+		auto it = std::find(tasks.begin(), tasks.end(), task);
+		if (it != tasks.end())
+			tasks.erase(it);
+	}
+
+	int take_part_locked (Task* task) {
+		if (task->next >= task->count)
+			return -1;
+		int part = task->next++;
+		if (task->next == task->count)
+			remove(task); // all parts taken
+		return part;
+	}
+	int take_part (Task* task) {
+		std::lock_guard<std::mutex> lock(m);
+		return take_part_locked(task);
+	}
+
+	void wait (Task* task) {
+		TRACE_SCOPE("wait for helpers");
+		while (task->done.load() < task->count)
+			std::this_thread::yield();
+	}
+};
+
+/* Threads that do nothing but help with Worker_Helpers tasks, for work that is split up on the main thread (eg. sorting the Content_View)
+	They are started once and sleep until a task is pushed, so splitting some work costs a wakeup instead of creating threads
+*/
+class Helper_Threads {
+public:
+	Worker_Helpers				helpers;
+
+	Helper_Threads () {
+		helpers.wake_idle_workers = [this] () {
+			{ std::lock_guard<std::mutex> lock(m); } // a thread between has_work() and the wait sees the task or gets the notify
+			c.notify_all();
+		};
+	}
+
+	void start_threads (int thread_count) {
+		for (int i=0; i<thread_count; ++i) {
+			threads.emplace_back( &Helper_Threads::helper_thread, this, i );
+		}
+	}
+	int get_thread_count () { return (int)threads.size(); }
+
+	~Helper_Threads () {
+		{
+			std::lock_guard<std::mutex> lock(m);
+			stop = true;
+		}
+		c.notify_all();
+
+		for (auto& t : threads)
+			t.join();
+	}
+
+private:
+	std::vector< std::thread >	threads;
+
+	std::mutex					m;
+	std::condition_variable		c;
+	bool						stop = false; // protected by m
+
+	void helper_thread (int thread_indx) {
+
+		tracer.set_thread_name(prints("helper %d", thread_indx));
+
+		for (;;) {
+			while (helpers.help());
+
+			std::unique_lock<std::mutex> lock(m);
+			c.wait(lock, [this] () { return stop || helpers.has_work(); });
+			if (stop)
+				break;
+		}
+	}
+};
 
 template <typename Job, typename Result, typename Job_Processor>
 class Threadpool {
 public:
 	Threadsafe_Queue<Job>		jobs;
-	Threadsafe_Queue<Result>	results;
+	Mpsc_Ring<Result>			results; // lock-free, so the main thread draining the results every frame does not contend with the workers
+
+	Worker_Helpers				helpers; // passed to process_job, so a job can use idle workers
+
+	Threadpool () {
+		helpers.wake_idle_workers = [this] () { jobs.notify_all(); };
+	}
 
 	void start_threads (int thread_count) {
 		for (int i=0; i<thread_count; ++i) {
@@ -20,6 +221,7 @@ public:
 	~Threadpool () {
 
 		jobs.stop_all();
+		results.stop_all(); // workers blocked on a full ring would never finish their job otherwise
 
 		for (auto& t : threads)
 			t.join();
@@ -30,13 +232,33 @@ private:
 
 	void img_loader_thread_pool_thread (int thread_indx) {
 		
+		tracer.set_thread_name(prints("img_loader %d", thread_indx));
+
 		Job job;
 		
-		while (jobs.pop_or_stop(&job) != decltype(jobs)::STOP) {
-			
-			Result res = Job_Processor::process_job(std::move(job));
+		for (;;) {
+			// help the jobs of other workers before taking a new one, those are already in progress
+			while (helpers.help());
+
+			{
+				TRACE_SCOPE("queue wait");
+				auto ret = jobs.pop_or_stop_or_wake(&job, [this] () { return helpers.has_work(); });
+				if (ret == decltype(jobs)::PW_STOP)
+					break;
+				if (ret == decltype(jobs)::PW_WAKE)
+					continue;
+			}
+
+			Result res;
+			{
+				TRACE_SCOPE("process_job");
+				res = Job_Processor::process_job(std::move(job), helpers);
+			}
 			
-			results.push( std::move(res) );
+			{
+				TRACE_SCOPE("result handoff");
+				results.push( std::move(res) );
+			}
 		}
 	}
 };
@@ -50,6 +50,34 @@ public:
 		return POP;
 	}
 
+	enum pop_wake_e { PW_STOP=0, PW_POP, PW_WAKE };
+	// like pop_or_stop, but also returns PW_WAKE when wake() is true, wake() is called with the queue locked, call notify_all() after making it true
+	template <typename WAKE>
+	pop_wake_e pop_or_stop_or_wake (T* out, WAKE wake) {
+		std::unique_lock<std::mutex> lock(m);
+
+		while(!stop && q.empty() && !wake()) {
+
+			c.wait(lock); // release lock as long as the wait and reaquire it afterwards.
+		}
+
+		if (stop)
+			return PW_STOP;
+		if (q.empty())
+			return PW_WAKE;
+
+		*out = std::move(q.front());
+		q.pop_front();
+
+		return PW_POP;
+	}
+
+	// wake all threads waiting in pop_or_stop_or_wake, so they check their wake condition
+	void notify_all () {
+		std::lock_guard<std::mutex> lock(m);
+		c.notify_all();
+	}
+
 	// deque one element from the queue if there is one
 	bool try_pop (T* out) {
 		std::lock_guard<std::mutex> lock(m);
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <vector>
+#include <cstdio>
+
+#include "windows.h"
+
+#include "basic_typedefs.hpp"
+#include "vector_util.hpp"
+
+#include "image.hpp"
+#include "tracing.hpp"
+
+/* Thumbnail providers for files stb can not decode (videos)
+	A provider supplies one representative frame of a file, which then goes through the same pipeline as images (Texture_Streamer jobs, generate_mips_from_image, the mip cache)
+	Extracted frames are cached in THUMBNAIL_CACHE_DIR, keyed by the filepath, size and modification time of the file, so every file is only decoded once (also across runs of the app)
+	Providers are registered once at startup, backends that need optional dependencies only exist if they were compiled in (see video_thumbnail.hpp)
+*/
+
+constexpr int THUMBNAIL_PROVIDER_MAX_SIZE = 512; // frames are scaled to fit, the grid never shows them bigger than a cell, and it keeps the cache files small
+#define THUMBNAIL_CACHE_DIR "saves/thumbnail_cache"
+
+struct Thumbnail_Provider {
+	virtual ~Thumbnail_Provider () {}
+
+	virtual cstr get_name () = 0;
+	// by extension, called for every file of a directory on load, so this must not open the file
+	virtual bool handles (string const& filepath) = 0;
+	// size of the representative frame (unscaled), called while loading the directory, so this should only read the header
+	virtual bool probe_size (string const& filepath, iv2* size_px) = 0;
+	// decode the representative frame scaled to exactly size_px, TOP-DOWN, called from the loader threads concurrently
+	virtual bool extract_frame (string const& filepath, iv2 size_px, Image2D* top_down) = 0;
+};
+
+std::vector< unique_ptr<Thumbnail_Provider> >	thumbnail_providers; // registered at startup, only read after that
+
+Thumbnail_Provider* find_thumbnail_provider (string const& filepath) {
+	for (auto& p : thumbnail_providers)
+		if (p->handles(filepath))
+			return p.get();
+	return nullptr;
+}
+
+iv2 calc_provided_thumbnail_size (iv2 size_px) {
+	flt scale = min((flt)THUMBNAIL_PROVIDER_MAX_SIZE / (flt)max(size_px.x, size_px.y), 1.0f);
+	return max((iv2)floor((v2)size_px * scale +0.5f), 1);
+}
+
+//// Persistent cache, one file per source file: header + rgba8 top-down
+struct Thumbnail_Cache_Header {
+	u32		magic;
+	u32		version;
+	u64		file_size; // of the source file, the cache entry is stale if size or modification time differ
+	u64		file_mtime;
+	iv2		size_px;
+};
+constexpr u32 THUMBNAIL_CACHE_MAGIC = 0x6d756874; // "thum"
+constexpr u32 THUMBNAIL_CACHE_VERSION = 1;
+
+bool get_file_size_and_mtime (string const& filepath, u64* size, u64* mtime) {
+	WIN32_FILE_ATTRIBUTE_DATA attr;
+	if (!GetFileAttributesExA(filepath.c_str(), GetFileExInfoStandard, &attr))
+		return false;
+	*size = ((u64)attr.nFileSizeHigh << 32) | attr.nFileSizeLow;
+	*mtime = ((u64)attr.ftLastWriteTime.dwHighDateTime << 32) | attr.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+
+string get_thumbnail_cache_filepath (string const& filepath) {
+	u64 hash = 0xcbf29ce484222325ull; // FNV-1a
+	for (char c : filepath) {
+		hash ^= (u8)c;
+		hash *= 0x100000001b3ull;
+	}
+	return prints(THUMBNAIL_CACHE_DIR "/%016llx.bin", (unsigned long long)hash);
+}
+
+// reads only the header if pixels is null
+bool read_thumbnail_cache (string const& filepath, iv2* size_px, Image2D* pixels) {
+	u64 file_size, file_mtime;
+	if (!get_file_size_and_mtime(filepath, &file_size, &file_mtime))
+		return false;
+
+	FILE* f = fopen(get_thumbnail_cache_filepath(filepath).c_str(), "rb");
+	if (!f)
+		return false;
+
+	Thumbnail_Cache_Header h;
+	bool ok = fread(&h, sizeof(h), 1, f) == 1 &&
+		h.magic == THUMBNAIL_CACHE_MAGIC && h.version == THUMBNAIL_CACHE_VERSION && h.file_size == file_size && h.file_mtime == file_mtime &&
+		all(h.size_px >= 1 && h.size_px <= THUMBNAIL_PROVIDER_MAX_SIZE);
+
+	if (ok && pixels) {
+		*pixels = Image2D::allocate(h.size_px);
+		ok = fread(pixels->pixels, sizeof(rgba8), (uptr)h.size_px.x * (uptr)h.size_px.y, f) == (uptr)h.size_px.x * (uptr)h.size_px.y;
+	}
+	fclose(f);
+
+	if (ok)
+		*size_px = h.size_px;
+	return ok;
+}
+
+void write_thumbnail_cache (string const& filepath, Image2D const& img) {
+	Thumbnail_Cache_Header h = {};
+	if (!get_file_size_and_mtime(filepath, &h.file_size, &h.file_mtime))
+		return;
+	h.magic = THUMBNAIL_CACHE_MAGIC;
+	h.version = THUMBNAIL_CACHE_VERSION;
+	h.size_px = img.size;
+
+	CreateDirectoryA("saves", NULL); // fails if it exists, which is fine
+	CreateDirectoryA(THUMBNAIL_CACHE_DIR, NULL);
+
+	// write to a temp file and rename, so a loader thread (or the next run of the app) never sees a half written entry
+	string cache_filepath = get_thumbnail_cache_filepath(filepath);
+	string tmp_filepath = prints("%s.%u.tmp", cache_filepath.c_str(), (u32)GetCurrentThreadId());
+
+	FILE* f = fopen(tmp_filepath.c_str(), "wb");
+	if (!f)
+		return;
+
+	uptr count = (uptr)img.size.x * (uptr)img.size.y;
+	bool ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(img.pixels, sizeof(rgba8), count, f) == count;
+	fclose(f);
+
+	if (!ok || !MoveFileExA(tmp_filepath.c_str(), cache_filepath.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+		fprintf(stderr, "Could not write thumbnail cache entry %s for %s\n", cache_filepath.c_str(), filepath.c_str());
+		DeleteFileA(tmp_filepath.c_str());
+	}
+}
+
+// size the image of a provided file has in the grid and the mip pipeline, from the cache if possible, since that only reads a few bytes
+bool probe_provided_thumbnail (Thumbnail_Provider* provider, string const& filepath, iv2* size_px) {
+	if (read_thumbnail_cache(filepath, size_px, nullptr))
+		return true;
+
+	iv2 full_size;
+	if (!provider->probe_size(filepath, &full_size) || any(full_size <= 0))
+		return false;
+
+	*size_px = calc_provided_thumbnail_size(full_size);
+	return true;
+}
+
+// the representative frame of a provided file, TOP-DOWN like Image2D::decode_from_memory_top_down, extracted only if it is not in the cache
+Image2D load_provided_thumbnail (Thumbnail_Provider* provider, string const& filepath) {
+	TRACE_SCOPE("load_provided_thumbnail");
+
+	Image2D img;
+	iv2 size_px;
+	if (read_thumbnail_cache(filepath, &size_px, &img))
+		return img;
+
+	iv2 full_size;
+	if (!provider->probe_size(filepath, &full_size) || any(full_size <= 0))
+		throw Expt_File_Load_Fail(filepath);
+
+	if (!provider->extract_frame(filepath, calc_provided_thumbnail_size(full_size), &img))
+		throw Expt_File_Load_Fail(filepath);
+
+	write_thumbnail_cache(filepath, img);
+	return img;
+}
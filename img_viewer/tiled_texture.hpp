@@ -0,0 +1,246 @@
+#pragma once
+
+#include <vector>
+
+#include "basic_typedefs.hpp"
+#include "math.hpp"
+#include "vector_util.hpp"
+#include "colors.hpp"
+
+#include "image.hpp"
+#include "region_decode.hpp"
+#include "texture.hpp"
+#include "tracing.hpp"
+
+/* Tiled textures for images that are too big to be cached as one texture with a full mip chain (eg. 20k x 20k scans or panoramas)
+	Each mip level is split into fixed size tiles, each tile is its own small texture
+	Only the tiles that intersect the onscreen rect at the level that matches the onscreen size are requested, plus the base level (the first level that fits in a single tile), which is always kept as fallback
+	Missing tiles are drawn with the best resident coarser level, so drawing goes from the base level to the desired level, only drawing the resident tiles
+
+	The page table is simply a grid of tile slots per level on the cpu, instead of a page table texture indirection in the shader, since we only ever draw a few dozen tiles per image per frame
+	Tiles have a border of pixels from their neighbours, so bilinear filtering has no seams between tiles
+*/
+
+constexpr int TILE_SIZE = 256;
+constexpr int TILE_BORDER = 1;
+
+struct Tile_Key {
+	int		level;
+	iv2		pos; // in tiles, top-down
+};
+
+// pixels of one tile (with border) in the same bottom-up row order as all our images
+struct Tile_Image {
+	Tile_Key	key;
+	Image2D		img;
+};
+
+iv2 calc_level_size (iv2 full_size_px, int level) { // same sizes as Texture_Streamer::find_mipmap_sizes_px
+	iv2 sz = full_size_px;
+	for (int i=0; i<level; ++i)
+		sz = max(sz / 2, 1);
+	return sz;
+}
+iv2 calc_tile_count (iv2 level_size_px) {
+	return (level_size_px +(TILE_SIZE -1)) / TILE_SIZE;
+}
+int find_base_level (iv2 full_size_px) { // first level that fits in a single tile
+	int level = 0;
+	for (iv2 sz = full_size_px; any(sz > TILE_SIZE); sz = max(sz / 2, 1))
+		level++;
+	return level;
+}
+
+iv2 calc_tile_content_size (iv2 level_size_px, iv2 tile_pos) { // tiles at the right and bottom edge are smaller
+	return min(level_size_px -tile_pos * TILE_SIZE, TILE_SIZE);
+}
+
+// full image px per level px
+v2 calc_level_scale (iv2 full_size_px, int level) {
+	return (v2)full_size_px / (v2)calc_level_size(full_size_px, level);
+}
+
+// scale for decode_region when decoding tiles of a level, the biggest power of 2 that is not bigger than the level's scale, so the region is never smaller than the level
+int calc_region_scale (iv2 full_size_px, int level) {
+	v2 scale = calc_level_scale(full_size_px, level);
+	return max((int)floor(log2(min(scale.x, scale.y))), 0);
+}
+
+// rect of the full image (px top-down) that a tile (with border) covers
+void calc_tile_source_rect (iv2 full_size_px, Tile_Key key, iv2* lo, iv2* hi) {
+	iv2 level_size = calc_level_size(full_size_px, key.level);
+	v2 scale = calc_level_scale(full_size_px, key.level);
+
+	iv2 tile_lo = max(key.pos * TILE_SIZE -TILE_BORDER, 0);
+	iv2 tile_hi = min(key.pos * TILE_SIZE +calc_tile_content_size(level_size, key.pos) +TILE_BORDER, level_size);
+
+	*lo = clamp((iv2)floor((v2)tile_lo * scale), 0, full_size_px);
+	*hi = clamp((iv2)ceil((v2)tile_hi * scale), 0, full_size_px);
+}
+
+// cut a tile out of a decoded region of the image (that contains the source rect of the tile), resampling it to the tile's level
+// every output pixel averages up to 4x4 samples from its footprint in the region, the region is already box filtered down to roughly the level's size, so this is only the remaining non power of 2 part of the scale
+Image2D cut_tile (Image_Region const& src, Tile_Key key) {
+	TRACE_SCOPE("cut_tile");
+
+	iv2 level_size = calc_level_size(src.full_size_px, key.level);
+	v2 scale = calc_level_scale(src.full_size_px, key.level);
+	flt region_px = (flt)(1 << src.scale);
+
+	iv2 content_size = calc_tile_content_size(level_size, key.pos);
+	iv2 tex_size = content_size +TILE_BORDER*2;
+	iv2 origin = key.pos * TILE_SIZE -TILE_BORDER;
+
+	iv2 samples = clamp((iv2)ceil(scale / region_px), 1, 4);
+
+	auto dst = Image2D::allocate(tex_size);
+
+	for (int y=0; y<tex_size.y; ++y) {
+		int ly = clamp(origin.y +(tex_size.y -1 -y), 0, level_size.y -1); // top-down level pixel (texture rows are bottom-up)
+
+		for (int x=0; x<tex_size.x; ++x) {
+			int lx = clamp(origin.x +x, 0, level_size.x -1);
+
+			u32 sum[4] = {};
+			for (int sy=0; sy<samples.y; ++sy) {
+				flt fy = ((flt)ly +((flt)sy +0.5f) / (flt)samples.y) * scale.y; // full image px
+				int py = clamp((int)((fy -(flt)src.lo_px.y) / region_px), 0, src.img.size.y -1);
+				auto* row = &src.img.pixels[(uptr)(src.img.size.y -1 -py) * src.img.size.x]; // region is bottom-up too
+
+				for (int sx=0; sx<samples.x; ++sx) {
+					flt fx = ((flt)lx +((flt)sx +0.5f) / (flt)samples.x) * scale.x;
+					int px = clamp((int)((fx -(flt)src.lo_px.x) / region_px), 0, src.img.size.x -1);
+					for (int c=0; c<4; ++c)
+						sum[c] += row[px].arr[c];
+				}
+			}
+
+			u32 count = (u32)(samples.x * samples.y);
+			dst.get_pixel(x,y) = rgba8((u8)((sum[0] +count/2) / count), (u8)((sum[1] +count/2) / count), (u8)((sum[2] +count/2) / count), (u8)((sum[3] +count/2) / count));
+		}
+	}
+
+	return dst;
+}
+
+struct Tiled_Texture {
+	string					filepath;
+	u32						id = 0; // for Texture_Handle
+	iv2						full_size_px;
+
+	struct Tile {
+		unique_ptr<Texture2D>	tex = nullptr; // null == not resident
+		int						last_used_frame = -1; // for lru eviction
+		bool					requested = false; // in the currently queued job
+		bool					uploading = false; // decoded, texture object is created on the upload thread (see Texture_Streamer::cache_tiles)
+
+		uptr get_memory_size () const {
+			iv2 sz = tex->get_size_px();
+			return (uptr)sz.x * (uptr)sz.y * sizeof(rgba8);
+		}
+	};
+	struct Level {
+		iv2					size_px;
+		iv2					tile_count;
+		std::vector<Tile>	tiles; // tile_count.y rows of tile_count.x
+
+		Tile& get_tile (iv2 pos) {		return tiles[pos.y * tile_count.x +pos.x]; }
+	};
+	std::vector<Level>		levels; // level 0 is the full size, levels.back() is the base level
+
+	flt						order_priority = +1;
+	bool					was_queried = false;
+	bool					threadpool_job_queued = false;
+	u64						job_generation = 0; // of the queued job (see Texture_Streamer::next_job_generation)
+
+	int						desired_level = 0; // level that matches the onscreen size
+	bool					all_visible_tiles_resident = false;
+	std::vector<Tile_Key>	missing_tiles; // visible tiles that are not resident, collected during the queries
+
+	int						resident_tiles = 0;
+
+	Tiled_Texture () {}
+	Tiled_Texture (string filepath, iv2 full_size_px): filepath{std::move(filepath)}, full_size_px{full_size_px} {
+		int base = find_base_level(full_size_px);
+		for (int i=0; i<=base; ++i) {
+			Level l;
+			l.size_px = calc_level_size(full_size_px, i);
+			l.tile_count = calc_tile_count(l.size_px);
+			l.tiles.resize((uptr)l.tile_count.x * (uptr)l.tile_count.y);
+			levels.push_back(std::move(l));
+		}
+	}
+
+	int get_base_level () const {	return (int)levels.size() -1; }
+
+	Tile* find_tile (Tile_Key key) {
+		if (key.level < 0 || key.level >= (int)levels.size() || any(key.pos < 0) || any(key.pos >= levels[key.level].tile_count))
+			return nullptr;
+		return &levels[key.level].get_tile(key.pos);
+	}
+
+	// onscreen rect of the whole image and the rect of the view, both in px top-down
+	int calc_desired_level (v2 onscreen_size_px) const {
+		v2 ratio = (v2)full_size_px / onscreen_size_px;
+		flt r = min(ratio.x, ratio.y);
+		return r <= 1 ? 0 : clamp((int)floor(log2(r)), 0, get_base_level());
+	}
+
+	// calls f(Tile_Key, Tile&, v2 tile_pos_px, v2 tile_size_px) for all tiles of the level that are inside the view
+	template <typename FOREACH>
+	void foreach_visible_tile (int level, v2 onscreen_pos_px, v2 onscreen_size_px, v2 view_lo_px, v2 view_hi_px, FOREACH f) {
+		auto& l = levels[level];
+
+		v2 uv_lo = clamp((view_lo_px -onscreen_pos_px) / onscreen_size_px, 0, 1);
+		v2 uv_hi = clamp((view_hi_px -onscreen_pos_px) / onscreen_size_px, 0, 1);
+		if (any(uv_hi <= uv_lo))
+			return; // offscreen
+
+		iv2 lo = clamp((iv2)floor(uv_lo * (v2)l.size_px / (flt)TILE_SIZE), 0, l.tile_count -1);
+		iv2 hi = clamp((iv2)floor(uv_hi * (v2)l.size_px / (flt)TILE_SIZE), 0, l.tile_count -1);
+
+		for (int y=lo.y; y<=hi.y; ++y) {
+			for (int x=lo.x; x<=hi.x; ++x) {
+				iv2 pos = iv2(x,y);
+
+				v2 tile_lo = (v2)(pos * TILE_SIZE) / (v2)l.size_px;
+				v2 tile_sz = (v2)calc_tile_content_size(l.size_px, pos) / (v2)l.size_px;
+
+				f(Tile_Key{level, pos}, l.get_tile(pos), onscreen_pos_px +tile_lo * onscreen_size_px, tile_sz * onscreen_size_px);
+			}
+		}
+	}
+
+	// calls f(Texture2D const&, v2 pos_px, v2 size_px, v2 uv_lo, v2 uv_hi) for every resident tile that should be drawn, coarsest first so finer tiles get drawn on top
+	template <typename FOREACH>
+	void foreach_drawable_tile (v2 onscreen_pos_px, v2 onscreen_size_px, v2 view_lo_px, v2 view_hi_px, FOREACH f) {
+		for (int level=get_base_level(); level>=desired_level; --level) {
+			foreach_visible_tile(level, onscreen_pos_px, onscreen_size_px, view_lo_px, view_hi_px,
+				[&] (Tile_Key key, Tile& tile, v2 pos_px, v2 size_px) {
+					if (!tile.tex)
+						return;
+
+					v2 tex_size = (v2)tile.tex->get_size_px();
+					f(*tile.tex, pos_px, size_px, (flt)TILE_BORDER / tex_size, (tex_size -(flt)TILE_BORDER) / tex_size);
+				});
+		}
+	}
+
+	void imgui () {
+		ImGui::Value("full_size_px", full_size_px);
+		ImGui::Value("desired_level", desired_level);
+		ImGui::Value("resident_tiles", resident_tiles);
+		ImGui::Value("threadpool_job_queued", threadpool_job_queued);
+
+		if (ImGui::TreeNode(prints("levels[%d]###levels", (int)levels.size()).c_str())) {
+			for (auto& l : levels) {
+				int resident = 0;
+				for (auto& t : l.tiles)
+					resident += t.tex ? 1 : 0;
+
+				ImGui::Text("%5d x %5d  tiles: %3d x %3d  resident: %d", l.size_px.x,l.size_px.y, l.tile_count.x,l.tile_count.y, resident);
+			}
+			ImGui::TreePop();
+		}
+	}
+};
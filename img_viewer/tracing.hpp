@@ -0,0 +1,163 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include <memory>
+using std::unique_ptr;
+using std::make_unique;
+
+#include <string>
+using std::string;
+
+#include "stdio.h"
+
+#include "basic_typedefs.hpp"
+#include "preprocessor_stuff.hpp"
+#include "prints.hpp"
+
+/* Lightweight scoped trace markers
+	Each thread that records a marker gets its own ring buffer of events (single writer, so recording does not need any locks, only a release store of the write counter)
+	The rings are never freed so dumping is safe even after the thread has exited, old events simply get overwritten when a ring is full
+	dump_chrome_trace() writes everything into Chrome trace json (open in chrome://tracing or ui.perfetto.dev)
+
+	use like: { TRACE_SCOPE("decode"); ... } // name has to be a string literal, only the pointer is stored
+*/
+
+struct Trace_Event {
+	cstr	name;
+	u64		begin_ns;
+	u64		end_ns;
+};
+
+struct Trace_Thread_Buffer {
+	static constexpr u32	CAPACITY = 1 << 16; // ~1.5 MB per thread
+
+	string					thread_name;
+	int						thread_id;
+
+	std::atomic<u64>		write_count; // total events ever written, event i lives in events[i % CAPACITY]
+	Trace_Event				events[CAPACITY];
+
+	Trace_Thread_Buffer (int id): thread_id{id}, write_count{0} {}
+
+	void record (cstr name, u64 begin_ns, u64 end_ns) {
+		u64 i = write_count.load(std::memory_order_relaxed); // only we write this
+		events[i % CAPACITY] = { name, begin_ns, end_ns };
+		write_count.store(i +1, std::memory_order_release);
+	}
+};
+
+struct Tracer {
+	std::atomic<bool>	enabled {true};
+
+	std::chrono::steady_clock::time_point	start_time = std::chrono::steady_clock::now();
+
+	u64 get_time_ns () const {
+		return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -start_time).count();
+	}
+
+	// get the ring buffer of the calling thread, registers it on the first call
+	Trace_Thread_Buffer* get_thread_buffer () {
+		static thread_local Trace_Thread_Buffer* buf = nullptr;
+		if (!buf) {
+			std::lock_guard<std::mutex> lock(m);
+
+			buffers.emplace_back( make_unique<Trace_Thread_Buffer>((int)buffers.size() +1) );
+			buf = buffers.back().get();
+			buf->thread_name = prints("thread %d", buf->thread_id);
+		}
+		return buf;
+	}
+
+	void set_thread_name (string name) {
+		auto* buf = get_thread_buffer();
+
+		std::lock_guard<std::mutex> lock(m); // dump reads the names
+		buf->thread_name = std::move(name);
+	}
+
+	void record (cstr name, u64 begin_ns, u64 end_ns) {
+		get_thread_buffer()->record(name, begin_ns, end_ns);
+	}
+
+	// for marking consecutive phases of a function without having to put a scope around each of them
+	void phase (cstr name, u64* phase_begin_ns) {
+		u64 now = get_time_ns();
+		if (enabled.load(std::memory_order_relaxed))
+			record(name, *phase_begin_ns, now);
+		*phase_begin_ns = now;
+	}
+
+	bool dump_chrome_trace (string const& filepath) {
+		FILE* f = fopen(filepath.c_str(), "wb");
+		if (!f)
+			return false;
+
+		std::lock_guard<std::mutex> lock(m); // only protects the list of buffers and the names, the rings keep getting written to while we read them
+
+		fprintf(f, "{\"traceEvents\":[\n");
+
+		bool first = true;
+		auto sep = [&] () {
+			if (!first) fprintf(f, ",\n");
+			first = false;
+		};
+
+		std::vector<Trace_Event> tmp;
+
+		for (auto& b : buffers) {
+			sep();
+			fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", b->thread_id, b->thread_name.c_str());
+
+			u64 count = b->write_count.load(std::memory_order_acquire);
+			u64 first_valid = count > Trace_Thread_Buffer::CAPACITY ? count -Trace_Thread_Buffer::CAPACITY : 0;
+
+			tmp.clear();
+			for (u64 i=first_valid; i<count; ++i)
+				tmp.push_back(b->events[i % Trace_Thread_Buffer::CAPACITY]);
+
+			// the writer could have wrapped around while we were copying, drop the events that might have been overwritten
+			u64 count_after = b->write_count.load(std::memory_order_acquire);
+			u64 overwritten = count_after > Trace_Thread_Buffer::CAPACITY ? count_after -Trace_Thread_Buffer::CAPACITY : 0;
+			u64 skip = overwritten > first_valid ? min(overwritten -first_valid, (u64)tmp.size()) : 0;
+
+			for (u64 i=skip; i<(u64)tmp.size(); ++i) {
+				auto& e = tmp[i];
+				sep();
+				fprintf(f, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+					e.name, b->thread_id, (f64)e.begin_ns / 1000, (f64)(e.end_ns -e.begin_ns) / 1000);
+			}
+		}
+
+		fprintf(f, "\n]}\n");
+		fclose(f);
+		return true;
+	}
+
+private:
+	std::mutex									m;
+	std::vector< unique_ptr<Trace_Thread_Buffer> >	buffers;
+} tracer;
+
+struct Trace_Scope {
+	cstr	name;
+	u64		begin_ns;
+	bool	active;
+
+	Trace_Scope (cstr name): name{name} {
+		active = tracer.enabled.load(std::memory_order_relaxed);
+		if (active)
+			begin_ns = tracer.get_time_ns();
+	}
+	~Trace_Scope () {
+		if (active)
+			tracer.record(name, begin_ns, tracer.get_time_ns());
+	}
+};
+
+#define _TRACE_SCOPE(name, counter) Trace_Scope CONCAT(_trace_scope, counter) (name)
+#define TRACE_SCOPE(name) _TRACE_SCOPE(name, __COUNTER__)
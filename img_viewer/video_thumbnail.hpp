@@ -0,0 +1,154 @@
+#pragma once
+
+#include "basic_typedefs.hpp"
+#include "vector_util.hpp"
+
+#include "image.hpp"
+#include "thumbnail_provider.hpp"
+#include "tracing.hpp"
+
+/* Video thumbnails (mp4 and friends) with libavformat/libavcodec/libswscale (FFmpeg)
+	Optional dependency, define IMG_VIEWER_LIBAVCODEC 1 and put the FFmpeg dev headers and import libs in the include/library paths to enable it,
+	without it no provider is registered and videos keep showing their file icon
+
+	The representative frame is the keyframe at or before 10% of the duration (the first seconds are often black or a title card),
+	seeking backwards to a keyframe and discarding non-keyframes in the decoder means only a single frame is ever decoded
+*/
+
+#ifndef IMG_VIEWER_LIBAVCODEC
+	#define IMG_VIEWER_LIBAVCODEC 0
+#endif
+
+#if IMG_VIEWER_LIBAVCODEC
+extern "C" {
+	#include "libavformat/avformat.h"
+	#include "libavcodec/avcodec.h"
+	#include "libswscale/swscale.h"
+}
+#pragma comment(lib, "avformat.lib")
+#pragma comment(lib, "avcodec.lib")
+#pragma comment(lib, "avutil.lib")
+#pragma comment(lib, "swscale.lib")
+
+constexpr flt VIDEO_THUMBNAIL_POSITION = 0.1f; // of the duration
+
+struct Libav_Video_Thumbnail_Provider : Thumbnail_Provider {
+	cstr get_name () {	return "libavcodec"; }
+
+	bool handles (string const& filepath) {
+		auto dot = filepath.find_last_of('.');
+		if (dot == string::npos)
+			return false;
+
+		string ext = filepath.substr(dot +1);
+		for (auto& c : ext)
+			c = (char)tolower(c);
+		return ext == "mp4" || ext == "m4v" || ext == "mov" || ext == "mkv" || ext == "webm" || ext == "avi";
+	}
+
+	// mp4 and mkv have the codec parameters in the header, so this does not need avformat_find_stream_info (which decodes a few frames)
+	bool probe_size (string const& filepath, iv2* size_px) {
+		AVFormatContext* fmt = nullptr;
+		if (avformat_open_input(&fmt, filepath.c_str(), nullptr, nullptr) < 0)
+			return false;
+
+		int stream = av_find_best_stream(fmt, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+		bool ok = stream >= 0;
+		if (ok) {
+			auto* par = fmt->streams[stream]->codecpar;
+			*size_px = iv2(par->width, par->height);
+			ok = par->width > 0 && par->height > 0;
+		}
+
+		avformat_close_input(&fmt);
+		return ok;
+	}
+
+	bool extract_frame (string const& filepath, iv2 size_px, Image2D* top_down) {
+		TRACE_SCOPE("extract video frame");
+
+		AVFormatContext*	fmt = nullptr;
+		AVCodecContext*		ctx = nullptr;
+		AVFrame*			frame = nullptr;
+		AVPacket*			pkt = nullptr;
+		bool				got_frame = false;
+
+		if (avformat_open_input(&fmt, filepath.c_str(), nullptr, nullptr) < 0)
+			return false;
+
+		int stream = -1;
+		if (avformat_find_stream_info(fmt, nullptr) >= 0)
+			stream = av_find_best_stream(fmt, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+
+		auto* codec = stream >= 0 ? avcodec_find_decoder(fmt->streams[stream]->codecpar->codec_id) : nullptr;
+		if (codec) {
+			ctx = avcodec_alloc_context3(codec);
+			frame = av_frame_alloc();
+			pkt = av_packet_alloc();
+		}
+
+		if (ctx && frame && pkt && avcodec_parameters_to_context(ctx, fmt->streams[stream]->codecpar) >= 0 && avcodec_open2(ctx, codec, nullptr) >= 0) {
+			ctx->skip_frame = AVDISCARD_NONKEY; // we only want the keyframe we seek to
+
+			AVStream* s = fmt->streams[stream];
+			s64 start = s->start_time != AV_NOPTS_VALUE ? s->start_time : 0;
+			s64 duration = s->duration;
+			if (duration == AV_NOPTS_VALUE && fmt->duration != AV_NOPTS_VALUE)
+				duration = av_rescale_q(fmt->duration, AVRational{1, AV_TIME_BASE}, s->time_base);
+
+			// backwards == the keyframe at or before the target, if seeking fails we just take the first keyframe
+			if (duration != AV_NOPTS_VALUE && duration > 0)
+				av_seek_frame(fmt, stream, start +(s64)((f64)duration * VIDEO_THUMBNAIL_POSITION), AVSEEK_FLAG_BACKWARD);
+
+			bool eof = false;
+			while (!got_frame) {
+				if (!eof) {
+					if (av_read_frame(fmt, pkt) < 0) {
+						eof = true;
+						avcodec_send_packet(ctx, nullptr); // flush
+					} else {
+						if (pkt->stream_index == stream)
+							avcodec_send_packet(ctx, pkt);
+						av_packet_unref(pkt);
+					}
+				}
+
+				int ret = avcodec_receive_frame(ctx, frame);
+				if (ret == 0)
+					got_frame = true;
+				else if (ret != AVERROR(EAGAIN) || eof)
+					break; // error or end of stream
+			}
+		}
+
+		if (got_frame) {
+			// convert to rgba and scale in one pass
+			auto* sws = sws_getContext(frame->width, frame->height, (AVPixelFormat)frame->format, size_px.x, size_px.y, AV_PIX_FMT_RGBA, SWS_AREA, nullptr, nullptr, nullptr);
+			if (sws) {
+				*top_down = Image2D::allocate(size_px);
+
+				u8* dst[4] = { (u8*)top_down->pixels };
+				int dst_stride[4] = { size_px.x * (int)sizeof(rgba8) };
+				sws_scale(sws, frame->data, frame->linesize, 0, frame->height, dst, dst_stride);
+
+				sws_freeContext(sws);
+			} else {
+				got_frame = false;
+			}
+		}
+
+		av_packet_free(&pkt);
+		av_frame_free(&frame);
+		avcodec_free_context(&ctx);
+		avformat_close_input(&fmt);
+		return got_frame;
+	}
+};
+#endif
+
+// call once at startup, before any directory is loaded
+void register_video_thumbnail_providers () {
+	#if IMG_VIEWER_LIBAVCODEC
+	thumbnail_providers.push_back(make_unique<Libav_Video_Thumbnail_Provider>());
+	#endif
+}